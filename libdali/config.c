@@ -28,6 +28,7 @@
 char *
 dl_read_streamlist (DLCP *dlconn, const char *streamfile)
 {
+  DLLineBuffer linebuf;
   char *regex = 0;
   char line[100];
   char *ptr;
@@ -52,7 +53,10 @@ dl_read_streamlist (DLCP *dlconn, const char *streamfile)
 
   dl_log_r (dlconn, 1, 1, "Reading list of streams from %s\n", streamfile);
 
-  while ((dl_readline (streamfd, line, sizeof (line))) >= 0)
+  linebuf.offset = 0;
+  linebuf.length = 0;
+
+  while ((dl_readline_buffered (streamfd, line, sizeof (line), &linebuf)) >= 0)
   {
     ptr = line;
 
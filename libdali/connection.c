@@ -21,7 +21,9 @@
  *
  * Allocate, initialze and return a pointer to a new DLCP struct.
  *
- * @param address Address of DataLink server in "host:port" format
+ * @param address Address of DataLink server in "host:port" format, or
+ * a comma separated list of endpoints, see dl_connect().  A list is
+ * stored in the DLCP addrlist and as much of it as fits in addr.
  * @param progname Name of program, usually argv[0]
  *
  * @return allocated DLCP struct on success, NULL on error.
@@ -40,7 +42,8 @@ dl_newdlcp (char *address, char *progname)
   }
 
   /* Set defaults */
-  strncpy (dlconn->addr, address, sizeof (dlconn->addr));
+  strncpy (dlconn->addr, address, sizeof (dlconn->addr) - 1);
+  dlconn->addr[sizeof (dlconn->addr) - 1] = '\0';
   if (dlp_genclientid (progname, dlconn->clientid, sizeof (dlconn->clientid)) < 0)
     dlconn->clientid[0]  = '\0';
   dlconn->keepalive      = 600;
@@ -58,6 +61,21 @@ dl_newdlcp (char *address, char *progname)
 
   dlconn->log = NULL;
 
+  dlconn->recvbuf    = NULL;
+  dlconn->recvoffset = 0;
+  dlconn->recvlen    = 0;
+
+  dlconn->endpoint[0] = '\0';
+  dlconn->failed[0]   = '\0';
+  dlconn->addrlist    = NULL;
+
+  if (strchr (address, ',') && (dlconn->addrlist = strdup (address)) == NULL)
+  {
+    dl_log_r (NULL, 2, 0, "dl_newdlcp(): error allocating memory\n");
+    free (dlconn);
+    return NULL;
+  }
+
   return dlconn;
 } /* End of dl_newdlcp() */
 
@@ -74,6 +92,12 @@ dl_freedlcp (DLCP *dlconn)
   if (dlconn->log)
     free (dlconn->log);
 
+  if (dlconn->recvbuf)
+    free (dlconn->recvbuf);
+
+  if (dlconn->addrlist)
+    free (dlconn->addrlist);
+
   free (dlconn);
 } /* End of dl_freedlcp() */
 
@@ -1020,13 +1044,16 @@ dl_collect (DLCP *dlconn, DLPacket *packet, void *packetdata,
       dlconn->keepalive_trig = -1;
     }
 
-    /* Poll the socket for available data */
+    /* Poll the socket for available data unless already received */
     FD_ZERO (&select_fd);
     FD_SET ((unsigned int)dlconn->link, &select_fd);
     select_tv.tv_sec  = 0;
     select_tv.tv_usec = 500000; /* Block up to 0.5 seconds */
 
-    select_ret = select ((dlconn->link + 1), &select_fd, NULL, NULL, &select_tv);
+    if (dlconn->recvlen > 0)
+      select_ret = 1;
+    else
+      select_ret = select ((dlconn->link + 1), &select_fd, NULL, NULL, &select_tv);
 
     /* Check the return from select(), an interrupted system call error
 	 will be reported if a signal handler was used.  If the terminate
@@ -0,0 +1,390 @@
+/***************************************************************************
+ * dalibench.c
+ *
+ * A benchmark of the libdali write path.
+ *
+ * Packets are written with dl_write() to a fake DataLink server that
+ * runs in a thread of the same process and is connected using a
+ * socketpair(), so only the client side library code and the local
+ * socket are measured.  Packet sizes from 128 bytes to the largest
+ * that fits in a DataLink packet are used, each with and without
+ * acknowledgements, and the packets/s, bytes/s and number of socket
+ * related system calls per packet are reported.
+ *
+ * System calls are counted by wrapping the calls made by libdali
+ * with the GNU linker --wrap option, see the Makefile.  When built
+ * without WRAPSYSCALLS the system calls are not counted.
+ *
+ * modified 2026.291
+ ***************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <libdali.h>
+
+#define PACKAGE "dalibench"
+#define VERSION LIBDALI_VERSION
+
+static short int verbose = 0;
+static long count        = 20000;
+
+static int parameter_proc (int argcount, char **argvec);
+static void *fakeserver (void *arg);
+static int benchrun (int packetsize, int ack, long packets);
+static void usage (void);
+
+/* Counts of socket related system calls made by libdali */
+static long syscalls = 0;
+
+#if defined(WRAPSYSCALLS)
+extern ssize_t __real_send (int sockfd, const void *buf, size_t len, int flags);
+extern ssize_t __real_recv (int sockfd, void *buf, size_t len, int flags);
+extern int __real_select (int nfds, fd_set *readfds, fd_set *writefds,
+                          fd_set *exceptfds, struct timeval *timeout);
+extern int __real_fcntl (int fd, int cmd, ...);
+extern int __real_setitimer (int which, const struct itimerval *value,
+                             struct itimerval *ovalue);
+
+ssize_t
+__wrap_send (int sockfd, const void *buf, size_t len, int flags)
+{
+  syscalls++;
+  return __real_send (sockfd, buf, len, flags);
+}
+ssize_t
+__wrap_recv (int sockfd, void *buf, size_t len, int flags)
+{
+  syscalls++;
+  return __real_recv (sockfd, buf, len, flags);
+}
+int
+__wrap_select (int nfds, fd_set *readfds, fd_set *writefds,
+               fd_set *exceptfds, struct timeval *timeout)
+{
+  syscalls++;
+  return __real_select (nfds, readfds, writefds, exceptfds, timeout);
+}
+int
+__wrap_fcntl (int fd, int cmd, ...)
+{
+  va_list ap;
+  void *ptrarg;
+  int intarg;
+
+  syscalls++;
+
+  /* Only read the argument for commands that take one */
+  switch (cmd)
+  {
+  case F_GETFD:
+  case F_GETFL:
+  case F_GETOWN:
+    return __real_fcntl (fd, cmd);
+
+  case F_GETLK:
+  case F_SETLK:
+  case F_SETLKW:
+    va_start (ap, cmd);
+    ptrarg = va_arg (ap, void *);
+    va_end (ap);
+    return __real_fcntl (fd, cmd, ptrarg);
+
+  default:
+    va_start (ap, cmd);
+    intarg = va_arg (ap, int);
+    va_end (ap);
+    return __real_fcntl (fd, cmd, intarg);
+  }
+}
+int
+__wrap_setitimer (int which, const struct itimerval *value,
+                  struct itimerval *ovalue)
+{
+  syscalls++;
+  return __real_setitimer (which, value, ovalue);
+}
+#endif
+
+int
+main (int argc, char **argv)
+{
+  int sizes[] = {128, 256, 512, 1024, 2048, 4096, 8192, 0};
+  int idx;
+  int ack;
+
+  struct sigaction sa;
+
+  sigemptyset (&sa.sa_mask);
+  sa.sa_flags   = 0;
+  sa.sa_handler = SIG_IGN;
+  sigaction (SIGPIPE, &sa, NULL);
+
+  /* Process given parameters (command line and parameter file) */
+  if (parameter_proc (argc, argv) < 0)
+  {
+    fprintf (stderr, "Parameter processing failed\n\n");
+    fprintf (stderr, "Try '-h' for detailed help\n");
+    return -1;
+  }
+
+  /* The largest size is the most packet data allowed with a maximum length header */
+  sizes[sizeof (sizes) / sizeof (sizes[0]) - 1] = MAXPACKETSIZE - 3 - 255;
+
+  printf ("%6s %4s %10s %14s %13s\n", "Size", "ACK", "Packets/s", "Bytes/s", "Syscalls/pkt");
+
+  for (idx = 0; idx < (int)(sizeof (sizes) / sizeof (sizes[0])); idx++)
+  {
+    for (ack = 0; ack <= 1; ack++)
+    {
+      if (benchrun (sizes[idx], ack, count))
+        return 1;
+    }
+  }
+
+  return 0;
+} /* End of main() */
+
+/***************************************************************************
+ * benchrun():
+ * Write packets of the specified size to a fake server and report
+ * the rates.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+benchrun (int packetsize, int ack, long packets)
+{
+  pthread_t server;
+  DLCP *dlconn;
+  char packet[MAXPACKETSIZE];
+  int sockets[2];
+  long idx;
+  long startcalls;
+  dltime_t start;
+  dltime_t end;
+  double seconds;
+
+  if (socketpair (AF_UNIX, SOCK_STREAM, 0, sockets))
+  {
+    fprintf (stderr, "socketpair(): %s\n", strerror (errno));
+    return -1;
+  }
+
+  if (!(dlconn = dl_newdlcp ("socketpair", PACKAGE)))
+    return -1;
+
+  dl_loginit_r (dlconn, verbose, NULL, NULL, NULL, NULL);
+
+  /* Set up the connection as dl_connect() would */
+  if (dlp_setsocktimeo (sockets[0], dlconn->iotimeout) == 1)
+    dlconn->iotimeout = -dlconn->iotimeout;
+
+  if (dlp_socknoblock (sockets[0]))
+  {
+    fprintf (stderr, "Error setting socket to non-blocking\n");
+    return -1;
+  }
+
+  dlconn->link       = sockets[0];
+  dlconn->maxpktsize = MAXPACKETSIZE;
+
+  if (pthread_create (&server, NULL, fakeserver, &sockets[1]))
+  {
+    fprintf (stderr, "Cannot create server thread\n");
+    return -1;
+  }
+
+  for (idx = 0; idx < packetsize; idx++)
+    packet[idx] = (char)idx;
+
+  startcalls = syscalls;
+  start      = dlp_time ();
+
+  for (idx = 0; idx < packets; idx++)
+  {
+    if (dl_write (dlconn, packet, packetsize, "XX_TEST_00_BHZ/MSEED",
+                  idx * DLTMODULUS, (idx + 1) * DLTMODULUS, ack) < 0)
+    {
+      fprintf (stderr, "Error writing packet %ld\n", idx);
+      return -1;
+    }
+  }
+
+  end     = dlp_time ();
+  seconds = (double)(end - start) / DLTMODULUS;
+
+  /* Closing the client side ends the server thread */
+  dl_disconnect (dlconn);
+  pthread_join (server, NULL);
+  dl_freedlcp (dlconn);
+
+  if (seconds <= 0.0)
+    seconds = 1.0 / DLTMODULUS;
+
+  printf ("%6d %4s %10.0f %14.0f ", packetsize, (ack) ? "yes" : "no",
+          packets / seconds, packets * packetsize / seconds);
+
+  if (syscalls > startcalls)
+    printf ("%13.2f\n", (double)(syscalls - startcalls) / packets);
+  else
+    printf ("%13s\n", "-");
+
+  return 0;
+} /* End of benchrun() */
+
+/***************************************************************************
+ * fakeserver():
+ * Receive DataLink packets and acknowledge WRITE commands that request
+ * it, until the client closes the socket.  Only read() and write() are
+ * used to avoid counting the server system calls.
+ ***************************************************************************/
+static void *
+fakeserver (void *arg)
+{
+  int fd = *(int *)arg;
+  char *buffer;
+  char header[256];
+  char reply[64];
+  char flags[10];
+  long long int pktid = 0;
+  int buflen = 0;
+  int offset = 0;
+  int nread;
+  int headerlen;
+  int replylen;
+  int size;
+
+  if (!(buffer = (char *)malloc (4 * MAXPACKETSIZE)))
+    return NULL;
+
+  for (;;)
+  {
+    /* Parse complete packets from the buffer */
+    while (buflen - offset >= 3 && buflen - offset >= 3 + (uint8_t)buffer[offset + 2])
+    {
+      headerlen = (uint8_t)buffer[offset + 2];
+      memcpy (header, buffer + offset + 3, headerlen);
+      header[headerlen] = '\0';
+
+      size     = 0;
+      flags[0] = '\0';
+      sscanf (header, "WRITE %*s %*d %*d %9s %d", flags, &size);
+
+      if (buflen - offset < 3 + headerlen + size)
+        break;
+
+      offset += 3 + headerlen + size;
+      pktid++;
+
+      if (flags[0] == 'A')
+      {
+        headerlen = snprintf (reply + 3, sizeof (reply) - 3, "OK %lld 0", pktid);
+        reply[0]  = 'D';
+        reply[1]  = 'L';
+        reply[2]  = (char)headerlen;
+        replylen  = 3 + headerlen;
+
+        if (write (fd, reply, replylen) != replylen)
+          break;
+      }
+    }
+
+    /* Shift partial packet to the beginning of the buffer */
+    if (offset > 0)
+    {
+      memmove (buffer, buffer + offset, buflen - offset);
+      buflen -= offset;
+      offset = 0;
+    }
+
+    if ((nread = read (fd, buffer + buflen, 4 * MAXPACKETSIZE - buflen)) <= 0)
+      break;
+
+    buflen += nread;
+  }
+
+  close (fd);
+  free (buffer);
+
+  return NULL;
+} /* End of fakeserver() */
+
+/***************************************************************************
+ * parameter_proc:
+ *
+ * Process the command line parameters.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+parameter_proc (int argcount, char **argvec)
+{
+  int optind;
+
+  /* Process all command line arguments */
+  for (optind = 1; optind < argcount; optind++)
+  {
+    if (strcmp (argvec[optind], "-V") == 0)
+    {
+      fprintf (stderr, "%s version: %s\n", PACKAGE, VERSION);
+      exit (0);
+    }
+    else if (strcmp (argvec[optind], "-h") == 0)
+    {
+      usage ();
+      exit (0);
+    }
+    else if (strncmp (argvec[optind], "-v", 2) == 0)
+    {
+      verbose += strspn (&argvec[optind][1], "v");
+    }
+    else if (strcmp (argvec[optind], "-n") == 0 && (optind + 1) < argcount)
+    {
+      count = strtol (argvec[++optind], NULL, 10);
+    }
+    else
+    {
+      fprintf (stderr, "Unknown option: %s\n", argvec[optind]);
+      exit (1);
+    }
+  }
+
+  if (count <= 0)
+  {
+    fprintf (stderr, "Packet count must be positive\n");
+    return -1;
+  }
+
+  return 0;
+} /* End of parameter_proc() */
+
+/***************************************************************************
+ * usage:
+ * Print the usage message and exit.
+ ***************************************************************************/
+static void
+usage (void)
+{
+  fprintf (stderr, "%s version: %s\n\n", PACKAGE, VERSION);
+  fprintf (stderr, "Usage: %s [options]\n\n", PACKAGE);
+  fprintf (stderr,
+           " ## Options ##\n"
+           " -V             Report program version\n"
+           " -h             Show this usage message\n"
+           " -v             Be more verbose, multiple flags can be used\n"
+           " -n count       Number of packets written per test, default 20000\n"
+           "\n"
+           "This program benchmarks the libdali write path using a fake server\n"
+           "connected with a socketpair\n"
+           "\n");
+} /* End of usage() */
@@ -143,6 +143,10 @@ dl_dabs (double value)
  * read or buflen-1 characters have been read.  The buffer will always
  * contain a NULL-terminated string.
  *
+ * Characters are read one at a time so that nothing past the line is
+ * consumed from the stream, to read all the lines of a file use
+ * dl_readline_buffered() instead.
+ *
  * @return The number of characters read on success and -1 on error.
  ***************************************************************************/
 int
@@ -176,3 +180,72 @@ dl_readline (int fd, char *buffer, int buflen)
 
   return nread;
 } /* End of dl_readline() */
+
+/***********************************************************************/ /**
+ * @brief Read a line from a file stream using a read buffer
+ *
+ * Read a line in the same way as dl_readline() but read the stream
+ * in large blocks into @a linebuf and return lines from there, each
+ * block read usually contains many lines.  All reads from @a fd must
+ * use the same @a linebuf, the offset and length of which must be set
+ * to 0 before the first call.  A last line that is not terminated by a newline character is
+ * also returned.
+ *
+ * @return The number of characters read on success and -1 on error
+ * or end of file.
+ ***************************************************************************/
+int
+dl_readline_buffered (int fd, char *buffer, int buflen, DLLineBuffer *linebuf)
+{
+  char *newline;
+  int nread = 0;
+  int ncopy;
+
+  if (!buffer || !linebuf)
+    return -1;
+
+  /* Copy data from buffer until newline character or max characters */
+  while (nread < (buflen - 1))
+  {
+    /* Refill the buffer when empty */
+    if (linebuf->length <= 0)
+    {
+      linebuf->offset = 0;
+      linebuf->length = read (fd, linebuf->data, sizeof (linebuf->data));
+
+      if (linebuf->length <= 0)
+      {
+        linebuf->length = 0;
+
+        if (nread == 0)
+          return -1;
+
+        break;
+      }
+    }
+
+    ncopy = (linebuf->length < (buflen - 1 - nread)) ? linebuf->length : (buflen - 1 - nread);
+
+    /* Trap door for newline character, which is consumed but not copied */
+    if ((newline = memchr (linebuf->data + linebuf->offset, '\n', ncopy)))
+    {
+      ncopy = newline - (linebuf->data + linebuf->offset);
+
+      memcpy (buffer + nread, linebuf->data + linebuf->offset, ncopy);
+      linebuf->offset += ncopy + 1;
+      linebuf->length -= ncopy + 1;
+      nread += ncopy;
+      break;
+    }
+
+    memcpy (buffer + nread, linebuf->data + linebuf->offset, ncopy);
+    linebuf->offset += ncopy;
+    linebuf->length -= ncopy;
+    nread += ncopy;
+  }
+
+  /* Terminate string in buffer */
+  buffer[nread] = '\0';
+
+  return nread;
+} /* End of dl_readline_buffered() */
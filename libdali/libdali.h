@@ -37,6 +37,7 @@ extern "C" {
 #define LIBDALI_RELEASE "2016.291"   /**< libdali release date */
 
 #define MAXPACKETSIZE       16384    /**< Maximum packet size for libdali */
+#define RECVBUFSIZE         65536    /**< Size of connection receive buffer */
 #define MAXREGEXSIZE        16384    /**< Maximum regex pattern size */
 #define MAX_LOG_MSG_LENGTH  200      /**< Maximum length of log messages */
 
@@ -101,6 +102,12 @@ typedef struct DLCP_s
   int8_t      streaming;        /**< Boolean flag to indicate streaming status, maintained internally */
   
   DLLog      *log;              /**< Logging parameters, maintained internally */
+  char       *recvbuf;          /**< Buffer of received data, maintained internally */
+  int32_t     recvoffset;       /**< Offset to unread data in receive buffer, maintained internally */
+  int32_t     recvlen;          /**< Length of unread data in receive buffer, maintained internally */
+  char        endpoint[100];    /**< The host:port of the connected endpoint, maintained internally */
+  char        failed[100];      /**< The host:port of the endpoint last lost or rejected, maintained internally */
+  char       *addrlist;         /**< Comma separated list of server endpoints used instead of addr, or NULL */
 } DLCP;
 
 /** DataLink packet */
@@ -160,10 +167,20 @@ extern dltime_t dl_seedtimestr2dltime (char *seedtimestr);
 extern dltime_t dl_timestr2dltime (char *timestr);
 
 /* genutils.c */
+
+/* Read buffer for dl_readline_buffered(), offset and length start at 0 */
+typedef struct DLLineBuffer_s {
+  int32_t     offset;           /**< Offset to unread data in buffer */
+  int32_t     length;           /**< Length of unread data in buffer */
+  char        data[16384];      /**< Data read from the file */
+} DLLineBuffer;
+
 extern int     dl_splitstreamid (char *streamid, char *w, char *x, char *y, char *z, char *type);
 extern int     dl_bigendianhost (void);
 extern double  dl_dabs (double value);
 extern int     dl_readline (int fd, char *buffer, int buflen);
+extern int     dl_readline_buffered (int fd, char *buffer, int buflen,
+				     DLLineBuffer *linebuf);
 
 /* logging.c */
 extern int     dl_log (int level, int verb, ...);
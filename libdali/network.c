@@ -14,6 +14,28 @@
 
 #include "libdali.h"
 
+/* Maximum number of addresses tried by dl_connect() */
+#define DL_MAXADDRS 16
+
+/* Maximum length of a packet header, longer reads bypass the receive buffer */
+#define DL_MAXHEADERLEN 255
+
+/* Candidate address for a connection */
+typedef struct DLCandidate_s
+{
+  struct sockaddr_storage addr; /* Address for connect() */
+  size_t addrlen;               /* Length of address */
+  int endpoint;                 /* Index of endpoint in address list */
+  SOCKET sock;                  /* Socket while connecting, -1 otherwise */
+  int8_t failed;                /* Connecting failed or was rejected */
+  int8_t deferred;              /* Endpoint failed before, tried last */
+} DLCandidate;
+
+static int dl_parseaddr (DLCP *dlconn, char *address, char *nodename,
+                         size_t namesize, char *nodeport, size_t portsize);
+static int dl_raceconnect (DLCP *dlconn, DLCandidate *cands, int candcount,
+                           char **endpoints);
+
 /***********************************************************************/ /**
  * @brief Connect to a DataLink server
  *
@@ -23,7 +45,22 @@
  * optional, if the host is not specified 'localhost' is assumed, if
  * the port is not specified '16000' is assumed, if neither is
  * specified (only a colon) then 'localhost' and port '16000' are
- * assumed.
+ * assumed.  An IPv6 address must be enclosed in brackets,
+ * e.g. '[::1]:16000'.
+ *
+ * Multiple server endpoints may be specified as a comma separated
+ * list, e.g. 'host1:16000,host2:16000', in 'dlconn->addrlist', which
+ * is used instead of 'dlconn->addr' when set, see dl_newdlcp().  Connections are started to
+ * all IPv4 and IPv6 addresses of all endpoints at once and the first
+ * connection established, the one with the lowest latency, is used.
+ * If a server does not accept the connection (the ID exchange fails)
+ * the next fastest of the remaining endpoints is used.  The endpoint
+ * connected to is set in 'dlconn->endpoint'.
+ *
+ * The endpoint of a previous connection, which is only re-established
+ * after it was lost, and an endpoint that rejected the connection are
+ * recorded in 'dlconn->failed'.  That endpoint is only tried again if
+ * none of the other endpoints can be connected to.
  *
  * If a permanent error is detected (invalid port specified) the
  * dlconn->terminate flag will be set so the dl_collect() family of
@@ -37,13 +74,24 @@
 SOCKET
 dl_connect (DLCP *dlconn)
 {
+  DLCandidate cands[DL_MAXADDRS];
+  struct sockaddr_storage addrs[DL_MAXADDRS];
+  size_t addrlens[DL_MAXADDRS];
   SOCKET sock;
-  long int nport;
+  dltime_t start;
+  char *addrlist;
+  char *endpoints[DL_MAXADDRS];
   char nodename[300];
   char nodeport[100];
-  char *ptr, *tail;
-  size_t addrlen;
-  struct sockaddr addr;
+  char *ptr;
+  int endpointcount = 0;
+  int candcount     = 0;
+  int addrcount;
+  int winner;
+  int deferred;
+  SOCKET rv = -1;
+  int idx;
+  int aidx;
 
   if (dlp_sockstartup ())
   {
@@ -51,104 +99,381 @@ dl_connect (DLCP *dlconn)
     return -1;
   }
 
-  /* Check server address string and use defaults if needed:
-   * If only ':' is specified neither host nor port specified
-   * If no ':' is included no port was specified
-   * If ':' is the first character no host was specified
-   */
-  if (!strcmp (dlconn->addr, ":"))
+  /* A connection is only re-established after it was lost */
+  if (dlconn->endpoint[0])
   {
-    strcpy (nodename, "localhost");
-    strcpy (nodeport, "16000");
+    strncpy (dlconn->failed, dlconn->endpoint, sizeof (dlconn->failed) - 1);
+    dlconn->failed[sizeof (dlconn->failed) - 1] = '\0';
   }
-  else if ((ptr = strchr (dlconn->addr, ':')) == NULL)
+
+  dlconn->endpoint[0] = '\0';
+
+  /* Split address into endpoints, the list is kept separately from addr */
+  if (!(addrlist = strdup ((dlconn->addrlist) ? dlconn->addrlist : dlconn->addr)))
   {
-    strncpy (nodename, dlconn->addr, sizeof (nodename));
-    strcpy (nodeport, "16000");
+    dl_log_r (dlconn, 2, 0, "cannot allocate memory for server address\n");
+    return -1;
   }
-  else
+
+  for (ptr = addrlist; ptr && endpointcount < DL_MAXADDRS;)
+  {
+    endpoints[endpointcount++] = ptr;
+
+    if ((ptr = strchr (ptr, ',')))
+      *ptr++ = '\0';
+  }
+
+  /* Resolve the addresses of all endpoints */
+  for (idx = 0; idx < endpointcount; idx++)
   {
-    if (ptr == dlconn->addr)
+    if (dl_parseaddr (dlconn, endpoints[idx], nodename, sizeof (nodename),
+                      nodeport, sizeof (nodeport)))
     {
-      strcpy (nodename, "localhost");
+      dl_log_r (dlconn, 2, 0, "server port specified incorrectly\n");
+      dlconn->terminate = 1;
+      free (addrlist);
+      return -1;
     }
-    else
+
+    if ((addrcount = DL_MAXADDRS - candcount) <= 0)
+      break;
+
+    if (dlp_getaddrinfo_all (nodename, nodeport, addrs, addrlens, &addrcount))
     {
-      strncpy (nodename, dlconn->addr, (ptr - dlconn->addr));
-      nodename[(ptr - dlconn->addr)] = '\0';
+      dl_log_r (dlconn, 2, 0, "cannot resolve hostname %s\n", nodename);
+      continue;
     }
 
-    strcpy (nodeport, ptr + 1);
+    for (aidx = 0; aidx < addrcount; aidx++)
+    {
+      memcpy (&cands[candcount].addr, &addrs[aidx], addrlens[aidx]);
+      cands[candcount].addrlen  = addrlens[aidx];
+      cands[candcount].endpoint = idx;
+      cands[candcount].sock     = -1;
+      cands[candcount].failed   = 0;
+      cands[candcount].deferred = (endpointcount > 1 && !strcmp (endpoints[idx], dlconn->failed));
+      candcount++;
+    }
+  }
+
+  /* Connect to the fastest endpoint, excluding endpoints that reject the connection */
+  for (;;)
+  {
+    start = dlp_time ();
+
+    if ((winner = dl_raceconnect (dlconn, cands, candcount, endpoints)) == -2)
+      break;
 
-    /* Sanity test the port number */
-    nport = strtoul (nodeport, &tail, 10);
-    if (*tail || (nport <= 0 || nport > 0xffff))
+    if (winner < 0)
     {
-      dl_log_r (dlconn, 2, 0, "server port specified incorrectly\n");
-      dlconn->terminate = 1;
-      return -1;
+      /* Try the endpoint that failed before when no other endpoint is left */
+      for (deferred = 0, idx = 0; idx < candcount; idx++)
+      {
+        if (cands[idx].deferred && !cands[idx].failed)
+          deferred++;
+
+        cands[idx].deferred = 0;
+      }
+
+      if (deferred)
+      {
+        dl_log_r (dlconn, 1, 1, "[%s] trying previously failed endpoint %s\n",
+                  dlconn->addr, dlconn->failed);
+        continue;
+      }
+
+      dl_log_r (dlconn, 2, 0, "[%s] cannot connect to server\n", dlconn->addr);
+      break;
+    }
+
+    sock = cands[winner].sock;
+    cands[winner].sock = -1;
+
+    strncpy (dlconn->endpoint, endpoints[cands[winner].endpoint], sizeof (dlconn->endpoint) - 1);
+    dlconn->endpoint[sizeof (dlconn->endpoint) - 1] = '\0';
+
+    /* Set socket I/O timeouts if possible */
+    if (dlconn->iotimeout)
+    {
+      int timeout = (dlconn->iotimeout > 0) ? dlconn->iotimeout : -dlconn->iotimeout;
+
+      if (dlp_setsocktimeo (sock, timeout) == 1)
+      {
+        dl_log_r (dlconn, 1, 2, "[%s] using system socket timeouts\n", dlconn->addr);
+
+        /* Negate timeout to indicate socket timeouts are set */
+        dlconn->iotimeout = -timeout;
+      }
     }
+
+    /* socket connected */
+    dl_log_r (dlconn, 1, 1, "[%s] network socket opened in %.1f ms\n", dlconn->endpoint,
+              (double)(dlp_time () - start) / (DLTMODULUS / 1000));
+
+    dlconn->link       = sock;
+    dlconn->recvoffset = 0;
+    dlconn->recvlen    = 0;
+
+    /* Everything should be connected, exchange IDs */
+    if (dl_exchangeIDs (dlconn, 1) != -1)
+    {
+      rv = sock;
+      break;
+    }
+
+    dlp_sockclose (sock);
+    dlconn->link = -1;
+
+    strncpy (dlconn->failed, dlconn->endpoint, sizeof (dlconn->failed) - 1);
+    dlconn->failed[sizeof (dlconn->failed) - 1] = '\0';
+
+    /* Do not try other addresses of the endpoint */
+    for (idx = 0; idx < candcount; idx++)
+      if (cands[idx].endpoint == cands[winner].endpoint)
+        cands[idx].failed = 1;
+
+    dlconn->endpoint[0] = '\0';
   }
 
-  /* Resolve server address */
-  if (dlp_getaddrinfo (nodename, nodeport, &addr, &addrlen))
+  free (addrlist);
+
+  return rv;
+} /* End of dl_connect() */
+
+/***********************************************************************/ /**
+ * @brief Parse a server endpoint into host and port
+ *
+ * Parse a single 'host:port' endpoint using the defaults described
+ * for dl_connect().  A host enclosed in brackets may contain colons
+ * (an IPv6 address).
+ *
+ * @param dlconn DataLink Connection Parameters
+ * @param address Endpoint in 'host:port' format
+ * @param nodename Returned host name
+ * @param namesize Size of @a nodename
+ * @param nodeport Returned port
+ * @param portsize Size of @a nodeport
+ *
+ * @return 0 on success and -1 if the port is invalid.
+ ***************************************************************************/
+static int
+dl_parseaddr (DLCP *dlconn, char *address, char *nodename, size_t namesize,
+              char *nodeport, size_t portsize)
+{
+  long int nport;
+  char *ptr, *tail;
+  char *host = address;
+  size_t hostlen;
+
+  /* Find the port separator, after a bracketed host */
+  if (*address == '[' && (ptr = strchr (address, ']')))
   {
-    dl_log_r (dlconn, 2, 0, "cannot resolve hostname %s\n", nodename);
-    return -1;
+    host    = address + 1;
+    hostlen = ptr - host;
+    ptr     = (ptr[1] == ':') ? ptr + 1 : NULL;
+  }
+  else
+  {
+    ptr     = strrchr (address, ':');
+    hostlen = (ptr) ? (size_t) (ptr - address) : strlen (address);
   }
 
-  /* Create socket */
-  if ((sock = socket (PF_INET, SOCK_STREAM, 0)) < 0)
+  /* Check server address string and use defaults if needed:
+   * If only ':' is specified neither host nor port specified
+   * If no ':' is included no port was specified
+   * If ':' is the first character no host was specified
+   */
+  if (hostlen == 0)
   {
-    dl_log_r (dlconn, 2, 0, "[%s] socket(): %s\n", dlconn->addr, dlp_strerror ());
-    dlp_sockclose (sock);
+    strncpy (nodename, "localhost", namesize - 1);
+    nodename[namesize - 1] = '\0';
+  }
+  else
+  {
+    if (hostlen >= namesize)
+      hostlen = namesize - 1;
+
+    strncpy (nodename, host, hostlen);
+    nodename[hostlen] = '\0';
+  }
+
+  if (!ptr || !ptr[1])
+  {
+    strncpy (nodeport, "16000", portsize - 1);
+    nodeport[portsize - 1] = '\0';
+    return 0;
+  }
+
+  strncpy (nodeport, ptr + 1, portsize - 1);
+  nodeport[portsize - 1] = '\0';
+
+  /* Sanity test the port number */
+  nport = strtoul (nodeport, &tail, 10);
+  if (*tail || (nport <= 0 || nport > 0xffff))
+  {
+    dl_log_r (dlconn, 1, 2, "[%s] invalid port: %s\n", address, nodeport);
     return -1;
   }
 
-  /* Set socket I/O timeouts if possible */
-  if (dlconn->iotimeout)
+  return 0;
+} /* End of dl_parseaddr() */
+
+/***********************************************************************/ /**
+ * @brief Connect to the first of several addresses to respond
+ *
+ * Start non-blocking connections to all candidate addresses that
+ * have not failed and are not deferred and wait for the first one to
+ * be established, limited by the connection I/O timeout.  The other
+ * connections are closed and addresses that could not be connected to
+ * are marked as failed.  Waiting ends when interrupted by a signal.
+ *
+ * @param dlconn DataLink Connection Parameters
+ * @param cands Candidate addresses
+ * @param candcount Number of @a cands
+ * @param endpoints Endpoints of the candidates, for log messages
+ *
+ * @return the index of the connected candidate, its socket is in the
+ * candidate sock field.
+ * @retval -1 if no connection could be established
+ * @retval -2 if interrupted by a signal
+ ***************************************************************************/
+static int
+dl_raceconnect (DLCP *dlconn, DLCandidate *cands, int candcount, char **endpoints)
+{
+  struct timeval select_tv;
+  fd_set write_fd;
+  fd_set except_fd;
+  dltime_t deadline;
+  dltime_t now;
+  SOCKET maxsock;
+  int timeout;
+  int pending     = 0;
+  int winner      = -1;
+  int interrupted = 0;
+  int error;
+  int idx;
+#if defined(DLP_WIN)
+  int errlen;
+#else
+  socklen_t errlen;
+#endif
+
+  timeout  = (dlconn->iotimeout < 0) ? -dlconn->iotimeout : dlconn->iotimeout;
+  deadline = dlp_time () + (dltime_t)timeout * DLTMODULUS;
+
+  /* Start connecting to all candidates */
+  for (idx = 0; idx < candcount; idx++)
   {
-    int timeout = (dlconn->iotimeout > 0) ? dlconn->iotimeout : -dlconn->iotimeout;
+    if (cands[idx].failed || cands[idx].deferred)
+      continue;
 
-    if (dlp_setsocktimeo (sock, timeout) == 1)
+    if ((cands[idx].sock = socket (cands[idx].addr.ss_family, SOCK_STREAM, 0)) < 0)
     {
-      dl_log_r (dlconn, 1, 2, "[%s] using system socket timeouts\n", dlconn->addr);
+      dl_log_r (dlconn, 1, 2, "[%s] socket(): %s\n", endpoints[cands[idx].endpoint], dlp_strerror ());
+      cands[idx].sock   = -1;
+      cands[idx].failed = 1;
+      continue;
+    }
 
-      /* Negate timeout to indicate socket timeouts are set */
-      dlconn->iotimeout = -timeout;
+    if (dlp_socknoblock (cands[idx].sock) ||
+        dlp_sockconnect (cands[idx].sock, (struct sockaddr *)&cands[idx].addr,
+                         (int)cands[idx].addrlen))
+    {
+      dl_log_r (dlconn, 1, 2, "[%s] connect(): %s\n", endpoints[cands[idx].endpoint], dlp_strerror ());
+      dlp_sockclose (cands[idx].sock);
+      cands[idx].sock   = -1;
+      cands[idx].failed = 1;
+      continue;
     }
+
+    pending++;
   }
 
-  /* Connect socket */
-  if ((dlp_sockconnect (sock, (struct sockaddr *)&addr, addrlen)))
+  /* Wait for the first connection to be established */
+  while (pending > 0 && winner < 0)
   {
-    dl_log_r (dlconn, 2, 0, "[%s] connect(): %s\n", dlconn->addr, dlp_strerror ());
-    dlp_sockclose (sock);
-    return -1;
+    FD_ZERO (&write_fd);
+    FD_ZERO (&except_fd);
+    maxsock = 0;
+
+    for (idx = 0; idx < candcount; idx++)
+    {
+      if (cands[idx].sock < 0)
+        continue;
+
+      FD_SET ((unsigned int)cands[idx].sock, &write_fd);
+      FD_SET ((unsigned int)cands[idx].sock, &except_fd);
+
+      if (cands[idx].sock > maxsock)
+        maxsock = cands[idx].sock;
+    }
+
+    now = dlp_time ();
+
+    if (timeout && now >= deadline)
+      break;
+
+    if (timeout)
+    {
+      select_tv.tv_sec  = (long)((deadline - now) / DLTMODULUS);
+      select_tv.tv_usec = (long)((deadline - now) % DLTMODULUS);
+    }
+
+    if (select (maxsock + 1, NULL, &write_fd, &except_fd, (timeout) ? &select_tv : NULL) < 0)
+    {
+#if !defined(DLP_WIN)
+      /* Return to the caller on signals, e.g. to terminate */
+      if (errno == EINTR)
+        interrupted = 1;
+#endif
+      break;
+    }
+
+    for (idx = 0; idx < candcount && winner < 0; idx++)
+    {
+      if (cands[idx].sock < 0 ||
+          (!FD_ISSET (cands[idx].sock, &write_fd) && !FD_ISSET (cands[idx].sock, &except_fd)))
+        continue;
+
+      error  = 0;
+      errlen = sizeof (error);
+
+      if (getsockopt (cands[idx].sock, SOL_SOCKET, SO_ERROR, (char *)&error, &errlen) || error)
+      {
+        dl_log_r (dlconn, 1, 2, "[%s] connect(): %s\n", endpoints[cands[idx].endpoint],
+                  (error) ? strerror (error) : dlp_strerror ());
+        dlp_sockclose (cands[idx].sock);
+        cands[idx].sock   = -1;
+        cands[idx].failed = 1;
+        pending--;
+        continue;
+      }
+
+      winner = idx;
+    }
   }
 
-  /* Set socket to non-blocking */
-  if (dlp_socknoblock (sock))
+  /* Close all other connections, addresses that did not respond in time are not retried */
+  for (idx = 0; idx < candcount; idx++)
   {
-    dl_log_r (dlconn, 2, 0, "Error setting socket to non-blocking\n");
-    dlp_sockclose (sock);
-    return -1;
-  }
+    if (idx == winner || cands[idx].sock < 0)
+      continue;
 
-  /* socket connected */
-  dl_log_r (dlconn, 1, 1, "[%s] network socket opened\n", dlconn->addr);
+    dlp_sockclose (cands[idx].sock);
+    cands[idx].sock = -1;
 
-  dlconn->link = sock;
+    if (winner < 0)
+      cands[idx].failed = 1;
+  }
 
-  /* Everything should be connected, exchange IDs */
-  if (dl_exchangeIDs (dlconn, 1) == -1)
+  if (interrupted)
   {
-    dlp_sockclose (sock);
-    return -1;
+    dl_log_r (dlconn, 1, 1, "[%s] connecting interrupted\n", dlconn->addr);
+    return -2;
   }
 
-  return sock;
-} /* End of dl_connect() */
+  return winner;
+} /* End of dl_raceconnect() */
 
 /***********************************************************************/ /**
  * @brief Disconnect a DataLink connection
@@ -166,6 +491,10 @@ dl_disconnect (DLCP *dlconn)
     dlp_sockclose (dlconn->link);
     dlconn->link = -1;
 
+    /* Discard any unread data from the closed connection */
+    dlconn->recvoffset = 0;
+    dlconn->recvlen    = 0;
+
     dl_log_r (dlconn, 1, 1, "[%s] network socket closed\n", dlconn->addr);
   }
 } /* End of dl_disconnect() */
@@ -333,6 +662,88 @@ dl_sendpacket (DLCP *dlconn, void *headerbuf, size_t headerlen,
   return bytesread;
 } /* End of dl_sendpacket() */
 
+/***********************************************************************/ /**
+ * @brief Wait for data to be available on a DataLink connection
+ *
+ * Wait until the network socket is readable or the network I/O
+ * timeout (in either form, alarm or system socket level) expires.
+ * The socket itself always stays in non-blocking mode.
+ *
+ * @return 1 when data is available, 0 on timeout, -1 on error.
+ ***************************************************************************/
+static int
+dl_recvwait (DLCP *dlconn)
+{
+  struct timeval select_tv;
+  fd_set select_fd;
+  int select_ret;
+
+  FD_ZERO (&select_fd);
+  FD_SET ((unsigned int)dlconn->link, &select_fd);
+  select_tv.tv_sec  = (dlconn->iotimeout < 0) ? -dlconn->iotimeout : dlconn->iotimeout;
+  select_tv.tv_usec = 0;
+
+  select_ret = select ((dlconn->link + 1), &select_fd, NULL, NULL,
+                       (dlconn->iotimeout) ? &select_tv : NULL);
+
+  if (select_ret > 0)
+    return 1;
+
+  return (select_ret == 0) ? 0 : -1;
+} /* End of dl_recvwait() */
+
+/***********************************************************************/ /**
+ * @brief Receive available data from the network socket
+ *
+ * Receive up to @a readlen bytes into @a buffer with a single recv()
+ * if data is available.  If no data is available and @a blockflag is
+ * true wait for data using dl_recvwait().
+ *
+ * @return number of bytes read on success
+ * @retval 0 when no data available and @a blockflag is false
+ * @retval -1 on connection shutdown
+ * @retval -2 on error.
+ ***************************************************************************/
+static int
+dl_recvsocket (DLCP *dlconn, char *buffer, size_t readlen, uint8_t blockflag)
+{
+  int nrecv;
+  int rv;
+
+  for (;;)
+  {
+    if ((nrecv = recv (dlconn->link, buffer, readlen, 0)) > 0)
+      return nrecv;
+
+    /* Peer completed an orderly shutdown */
+    if (nrecv == 0)
+      return -1;
+
+    /* The only acceptable error is no data on non-blocking */
+    if (dlp_noblockcheck ())
+    {
+      dl_log_r (dlconn, 2, 0, "[%s] recv(%d): %d %s\n",
+                dlconn->addr, dlconn->link, nrecv, dlp_strerror ());
+      return -2;
+    }
+
+    if (!blockflag)
+      return 0;
+
+    if ((rv = dl_recvwait (dlconn)) <= 0)
+    {
+      if (rv == 0)
+        dl_log_r (dlconn, 2, 0, "[%s] recv(%d): timeout after %d seconds\n",
+                  dlconn->addr, dlconn->link,
+                  (dlconn->iotimeout < 0) ? -dlconn->iotimeout : dlconn->iotimeout);
+      else
+        dl_log_r (dlconn, 2, 0, "[%s] select(%d): %s\n",
+                  dlconn->addr, dlconn->link, dlp_strerror ());
+      return -2;
+    }
+  }
+} /* End of dl_recvsocket() */
+
 /***********************************************************************/ /**
  * @brief Receive arbitrary data from a DataLink server
  *
@@ -346,9 +757,14 @@ dl_sendpacket (DLCP *dlconn, void *headerbuf, size_t headerlen,
  * return.  If @a blockflag is false and some initial data is received
  * the function will block until @a readlen bytes have been read.
  *
- * If a user specified network I/O timeout was not applied at the
- * system socket level this routine will implement the timeout using
- * an alarm timer to interrupt the blocked send.
+ * Data is received from the socket in reads of up to RECVBUFSIZE
+ * bytes into a receive buffer associated with the connection and
+ * copied from there, so a single recv() usually returns the header
+ * and data of many packets.  When the receive buffer is empty,
+ * requests larger than a packet header, i.e. packet data, are read
+ * directly into @a buffer to avoid copying them.  The socket is left in
+ * non-blocking mode and blocking reads wait for data using select(),
+ * the user specified network I/O timeout limits each wait.
  *
  * @param dlconn DataLink Connection Parameters
  * @param buffer Buffer for received data
@@ -363,8 +779,9 @@ dl_sendpacket (DLCP *dlconn, void *headerbuf, size_t headerlen,
 int
 dl_recvdata (DLCP *dlconn, void *buffer, size_t readlen, uint8_t blockflag)
 {
+  size_t nread = 0;
+  size_t ncopy;
   int nrecv;
-  int nread  = 0;
   char *bptr = buffer;
 
   if (!buffer)
@@ -372,88 +789,61 @@ dl_recvdata (DLCP *dlconn, void *buffer, size_t readlen, uint8_t blockflag)
     return -2;
   }
 
-  /* Set socket to blocking if requested */
-  if (blockflag)
+  if (!dlconn->recvbuf)
   {
-    if (dlp_sockblock (dlconn->link))
+    if ((dlconn->recvbuf = (char *)malloc (RECVBUFSIZE)) == NULL)
     {
-      dl_log_r (dlconn, 2, 0, "[%s] Error setting socket to blocking: %s\n",
-                dlconn->addr, dlp_strerror ());
+      dl_log_r (dlconn, 2, 0, "[%s] Error allocating receive buffer\n",
+                dlconn->addr);
       return -2;
     }
-  }
 
-  /* Set timeout alarm if needed */
-  if (dlconn->iotimeout > 0)
-  {
-    if (dlp_setioalarm (dlconn->iotimeout))
-    {
-      dl_log_r (dlconn, 2, 0, "[%s] error setting network I/O timeout\n",
-                dlconn->addr);
-    }
+    dlconn->recvoffset = 0;
+    dlconn->recvlen    = 0;
   }
 
-  /* Recv until readlen bytes have been read */
-  while (nread < (ssize_t)readlen)
+  /* Recv until readlen bytes have been read, once some data has been
+   * read the remainder is always waited for */
+  while (nread < readlen)
   {
-    if ((nrecv = recv (dlconn->link, bptr, readlen - nread, 0)) < 0)
+    /* Copy from data already buffered */
+    if (dlconn->recvlen > 0)
     {
-      /* The only acceptable error is no data on non-blocking */
-      if (!blockflag && !dlp_noblockcheck ())
-      {
-        /* Only break out if no data has yet been received */
-        if (nread == 0)
-          break;
+      ncopy = ((size_t)dlconn->recvlen < (readlen - nread)) ? (size_t)dlconn->recvlen : (readlen - nread);
 
-        /* Corner case: if some data has been received in non-blocking
-		 mode we will loop forever until readlen bytes are read */
-      }
-      else
-      {
-        dl_log_r (dlconn, 2, 0, "[%s] recv(%d): %d %s\n",
-                  dlconn->addr, dlconn->link, nrecv, dlp_strerror ());
-        nread = -2;
-        break;
-      }
-    }
+      memcpy (bptr + nread, dlconn->recvbuf + dlconn->recvoffset, ncopy);
+      dlconn->recvoffset += ncopy;
+      dlconn->recvlen -= ncopy;
+      nread += ncopy;
 
-    /* Peer completed an orderly shutdown */
-    if (nrecv == 0)
-    {
-      nread = -1;
-      break;
+      continue;
     }
 
-    /* Update recv pointer and byte count */
-    if (nrecv > 0)
-    {
-      bptr += nrecv;
-      nread += nrecv;
-    }
-  }
+    dlconn->recvoffset = 0;
 
-  /* Cancel timeout alarm if set */
-  if (dlconn->iotimeout > 0)
-  {
-    if (dlp_setioalarm (0))
+    /* Read remainders larger than a header directly, otherwise refill the buffer */
+    if ((readlen - nread) > DL_MAXHEADERLEN)
     {
-      dl_log_r (dlconn, 2, 0, "[%s] error cancelling network I/O timeout\n",
-                dlconn->addr);
-    }
-  }
+      nrecv = dl_recvsocket (dlconn, bptr + nread, readlen - nread,
+                             (blockflag || nread > 0));
 
-  /* Set socket to non-blocking if set to blocking */
-  if (blockflag)
-  {
-    if (dlp_socknoblock (dlconn->link))
+      if (nrecv > 0)
+        nread += nrecv;
+    }
+    else
     {
-      dl_log_r (dlconn, 2, 0, "[%s] Error setting socket to non-blocking: %s\n",
-                dlconn->addr, dlp_strerror ());
-      return -2;
+      nrecv = dl_recvsocket (dlconn, dlconn->recvbuf, RECVBUFSIZE,
+                             (blockflag || nread > 0));
+
+      if (nrecv > 0)
+        dlconn->recvlen = nrecv;
     }
+
+    if (nrecv <= 0)
+      return nrecv;
   }
 
-  return nread;
+  return (int)nread;
 } /* End of dl_recvdata() */
 
 /***********************************************************************/ /**
@@ -17,7 +17,7 @@
  *
  * @author Chad Trabant, IRIS Data Management Center
  *
- * modified: 2016.291
+ * modified: 2026.291
  ***************************************************************************/
 
 #include <errno.h>
@@ -366,6 +366,98 @@ dlp_getaddrinfo (char *nodename, char *nodeport,
   return 0;
 } /* End of dlp_getaddrinfo() */
 
+/***********************************************************************/ /**
+ * @brief Resolve IP addresses and prepare parameters for connect()
+ *
+ * On WIN this will use the older gethostbyname() for consistent
+ * compatibility with older OS versions and is limited to IPv4
+ * addresses.  In the future we should be able to use getaddrinfo()
+ * even on Windows.
+ *
+ * On all other platforms use POSIX 1003.1g getaddrinfo() because it
+ * is standardized, thread-safe and protocol independent (i.e. IPv4,
+ * IPv6, etc.) and has broad support.  All IPv4 and IPv6 addresses
+ * are returned in the order of preference given by getaddrinfo(),
+ * unlike dlp_getaddrinfo() which returns the first IPv4 address.
+ *
+ * @param nodename Hostname to resolve
+ * @param nodeport Port number to connect to
+ * @param addrs Returned addresses for connect()
+ * @param addrlens Returned lengths of @a addrs
+ * @param addrcount Maximum number of @a addrs on input, number of
+ * addresses returned on output
+ *
+ * @return 0 on success and non-zero on error.  On everything but WIN
+ * an error value is the return value of getaddrinfo().
+ ***************************************************************************/
+int
+dlp_getaddrinfo_all (char *nodename, char *nodeport,
+                     struct sockaddr_storage *addrs, size_t *addrlens, int *addrcount)
+{
+  int maxcount = *addrcount;
+
+  *addrcount = 0;
+
+#if defined(DLP_WIN)
+  struct hostent *result;
+  struct sockaddr_in inet_addr;
+  long int nport;
+  char *tail;
+  int idx;
+
+  if ((result = gethostbyname (nodename)) == NULL)
+  {
+    return -1;
+  }
+
+  nport = strtoul (nodeport, &tail, 0);
+
+  for (idx = 0; result->h_addr_list[idx] && *addrcount < maxcount; idx++)
+  {
+    memset (&inet_addr, 0, sizeof (inet_addr));
+    inet_addr.sin_family = AF_INET;
+    inet_addr.sin_port   = htons ((unsigned short int)nport);
+    inet_addr.sin_addr   = *(struct in_addr *)result->h_addr_list[idx];
+
+    memcpy (&addrs[*addrcount], &inet_addr, sizeof (inet_addr));
+    addrlens[*addrcount] = sizeof (inet_addr);
+    (*addrcount)++;
+  }
+
+#else
+  /* getaddrinfo() will be used by all others */
+  struct addrinfo *ptr    = NULL;
+  struct addrinfo *result = NULL;
+  struct addrinfo hints;
+  int rv;
+
+  memset (&hints, 0, sizeof (hints));
+  hints.ai_family   = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  if ((rv = getaddrinfo (nodename, nodeport, &hints, &result)))
+  {
+    return rv;
+  }
+
+  for (ptr = result; ptr != NULL && *addrcount < maxcount; ptr = ptr->ai_next)
+  {
+    if ((ptr->ai_family == AF_INET || ptr->ai_family == AF_INET6) &&
+        ptr->ai_addrlen <= sizeof (struct sockaddr_storage))
+    {
+      memcpy (&addrs[*addrcount], ptr->ai_addr, ptr->ai_addrlen);
+      addrlens[*addrcount] = (size_t)ptr->ai_addrlen;
+      (*addrcount)++;
+    }
+  }
+
+  freeaddrinfo (result);
+
+#endif
+
+  return (*addrcount > 0) ? 0 : -1;
+} /* End of dlp_getaddrinfo_all() */
+
 /***********************************************************************/ /**
  * @brief Open a file stream
  *
@@ -20,7 +20,7 @@
  *
  * Copyright (C) 2016 Chad Trabant, IRIS Data Management Center
  *
- * modified: 2016.291
+ * modified: 2026.291
  ***************************************************************************/
 
 #ifndef PORTABLE_H
@@ -161,6 +161,9 @@ extern int dlp_setsocktimeo (SOCKET socket, int timeout);
 extern int dlp_setioalarm (int timeout);
 extern int dlp_getaddrinfo (char * nodename, char * nodeport,
 			    struct sockaddr * addr, size_t * addrlen);
+extern int dlp_getaddrinfo_all (char * nodename, char * nodeport,
+			        struct sockaddr_storage * addrs, size_t * addrlens,
+			        int * addrcount);
 extern int dlp_openfile (const char *filename, char perm);
 extern const char *dlp_strerror (void);
 extern int64_t dlp_time (void);
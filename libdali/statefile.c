@@ -20,6 +20,11 @@
  * Save the all the current the sequence numbers and time stamps into the
  * given state file.
  *
+ * The state is written with a single write to a temporary file (the
+ * state file name with a ".tmp" extension) that is then renamed to
+ * overwrite the state file, a partially written state file is never
+ * left in place if the program is killed while saving.
+ *
  * @param dlconn DataLink Connection Parameters
  * @param statefile File to save state to
  *
@@ -29,15 +34,30 @@
 int
 dl_savestate (DLCP *dlconn, const char *statefile)
 {
-  char line[200];
+  char tmpstatefile[1024];
+  char line[sizeof (dlconn->addr) + 48];
   int linelen;
   int statefd;
 
   if (!dlconn || !statefile)
     return -1;
 
-  /* Open the state file */
-  if ((statefd = dlp_openfile (statefile, 'w')) < 0)
+  /* Create temporary state file name */
+  if (snprintf (tmpstatefile, sizeof (tmpstatefile), "%s.tmp", statefile) >= (int)sizeof (tmpstatefile))
+  {
+    dl_log_r (dlconn, 2, 0, "temporary state file name too long: %s.tmp\n", statefile);
+    return -1;
+  }
+
+  /* Remove any previous temporary file, the file is not truncated by opening */
+  if (remove (tmpstatefile) && errno != ENOENT)
+  {
+    dl_log_r (dlconn, 2, 0, "cannot remove temporary state file, %s\n", strerror (errno));
+    return -1;
+  }
+
+  /* Open the temporary state file */
+  if ((statefd = dlp_openfile (tmpstatefile, 'w')) < 0)
   {
     dl_log_r (dlconn, 2, 0, "cannot open state file for writing\n");
     return -1;
@@ -50,9 +70,30 @@ dl_savestate (DLCP *dlconn, const char *statefile)
                       dlconn->addr, (long long int)dlconn->pktid,
                       (long long int)dlconn->pkttime);
 
+  if (linelen < 0 || linelen >= (int)sizeof (line))
+  {
+    dl_log_r (dlconn, 2, 0, "state line too long for state file: %s\n", dlconn->addr);
+    close (statefd);
+    remove (tmpstatefile);
+    return -1;
+  }
+
   if (write (statefd, line, linelen) != linelen)
   {
     dl_log_r (dlconn, 2, 0, "cannot write to state file, %s\n", strerror (errno));
+    close (statefd);
+    return -1;
+  }
+
+  /* Flush the new state to disk before it replaces the current state file */
+#if defined(DLP_WIN)
+  if (_commit (statefd))
+#else
+  if (fsync (statefd))
+#endif
+  {
+    dl_log_r (dlconn, 2, 0, "cannot sync state file, %s\n", strerror (errno));
+    close (statefd);
     return -1;
   }
 
@@ -62,6 +103,18 @@ dl_savestate (DLCP *dlconn, const char *statefile)
     return -1;
   }
 
+#if defined(DLP_WIN)
+  /* rename() does not replace an existing file on Windows */
+  remove (statefile);
+#endif
+
+  /* Rename temporary state file overwriting the current state file */
+  if (rename (tmpstatefile, statefile))
+  {
+    dl_log_r (dlconn, 2, 0, "cannot rename temporary state file, %s\n", strerror (errno));
+    return -1;
+  }
+
   return 0;
 } /* End of dl_savestate() */
 
@@ -81,9 +134,11 @@ dl_savestate (DLCP *dlconn, const char *statefile)
 int
 dl_recoverstate (DLCP *dlconn, const char *statefile)
 {
+  DLLineBuffer linebuf;
   int statefd;
-  char line[200];
-  char addrstr[100];
+  char line[sizeof (dlconn->addr) + 48];
+  char addrstr[sizeof (dlconn->addr)];
+  char format[30];
   int fields;
   int found = 0;
   int count = 1;
@@ -108,15 +163,21 @@ dl_recoverstate (DLCP *dlconn, const char *statefile)
 
   dl_log_r (dlconn, 1, 1, "recovering connection state from state file\n");
 
+  linebuf.offset = 0;
+  linebuf.length = 0;
+
+  /* Limit the server address field to the size of the address */
+  snprintf (format, sizeof (format), "%%%ds %%lld %%lld\n", (int)sizeof (addrstr) - 1);
+
   /* Loop through lines in the file and find the matching server address */
-  while ((dl_readline (statefd, line, sizeof (line))) >= 0)
+  while ((dl_readline_buffered (statefd, line, sizeof (line), &linebuf)) >= 0)
   {
     long long int spktid;
     long long int spkttime;
 
     addrstr[0] = '\0';
 
-    fields = sscanf (line, "%s %lld %lld\n", addrstr, &spktid, &spkttime);
+    fields = sscanf (line, format, addrstr, &spktid, &spkttime);
 
     if (fields < 0)
       continue;
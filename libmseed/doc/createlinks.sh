@@ -31,7 +31,7 @@ for link in $LIST ; do
 done
 
 ORIG=ms_readmsr.3
-LIST="ms_readmsr_r.3 ms_readtraces.3 ms_readtracelist.3"
+LIST="ms_readmsr_r.3 ms_readtraces.3 ms_readtracelist.3 ms_readtracelist_files.3"
 for link in $LIST ; do
     ln -s $ORIG $link
 done
@@ -49,7 +49,7 @@ for link in $LIST ; do
 done
 
 ORIG=ms_time.3
-LIST="ms_btime3hptime.3 ms_btime2isotimestr.3 ms_btime2mdtimestr.3 ms_btime2seedtimestr.3 ms_hptime2btime.3 ms_hptime2isotimestr.3 ms_hptime2mdtimestr.3 ms_hptime2seedtimestr.3 ms_time2hptime.3 ms_seedtimestr2hptime.3 ms_timestr2hptime.3"
+LIST="ms_btime3hptime.3 ms_btime2isotimestr.3 ms_btime2mdtimestr.3 ms_btime2seedtimestr.3 ms_hptime2btime.3 ms_hptime2isotimestr.3 ms_hptime2mdtimestr.3 ms_hptime2seedtimestr.3 ms_hptime2seedtimestr_cached.3 ms_time2hptime.3 ms_seedtimestr2hptime.3 ms_timestr2hptime.3"
 for link in $LIST ; do
     ln -s $ORIG $link
 done
@@ -102,8 +102,14 @@ for link in $LIST ; do
     ln -s $ORIG $link
 done
 
+ORIG=mst_convertsamples.3
+LIST="mstl_convertsamples.3 ms_convertsamples.3"
+for link in $LIST ; do
+    ln -s $ORIG $link
+done
+
 ORIG=mst_pack.3
-LIST="mst_packgroup.3"
+LIST="mst_packgroup.3 mst_pack_reserve.3"
 for link in $LIST ; do
     ln -s $ORIG $link
 done
@@ -9,7 +9,7 @@
  *
  * Written by Chad Trabant, IRIS Data Management Center
  *
- * modified 2012.105
+ * modified 2026.291
  ***************************************************************************/
 
 #include <stdio.h>
@@ -37,10 +37,10 @@ static char *encodingstr   = 0;
 static char *netcode       = 0;
 static int   packencoding  = -1;
 static int   byteorder     = -1;
+static int   threads       = 1;
 static char *inputfile     = 0;
 static FILE *outfile       = 0;
 
-static int convertsamples (MSRecord *msr, int packencoding);
 static int parameter_proc (int argcount, char **argvec);
 static void record_handler (char *record, int reclen, void *ptr);
 static void usage (void);
@@ -49,15 +49,8 @@ static void term_handler (int sig);
 int
 main (int argc, char **argv)
 {
-  MSRecord *msr = 0;
-  MSTraceGroup *mstg = 0;
-  MSTrace *mst;
-  int retcode;
-
-  int64_t packedsamples;
+  MSRepackParams params;
   int64_t packedrecords;
-  int lastrecord;
-  int iseqnum = 1;
   
 #ifndef WIN32
   /* Signal handling, use POSIX calls with standardized semantics */
@@ -94,333 +87,32 @@ main (int argc, char **argv)
       MS_UNPACKENCODINGFORMAT (inputencoding);
     }
   
-  /* Init MSTraceGroup */
-  mstg = mst_initgroup (mstg);
+  /* Read, convert and pack records with the libmseed pipeline */
+  memset (&params, 0, sizeof (params));
+  params.reclen       = reclen;
+  params.packreclen   = packreclen;
+  params.packencoding = packencoding;
+  params.byteorder    = byteorder;
+  params.tracepack    = tracepack;
+  params.printdetail  = ppackets;
+  params.threads      = threads;
+  params.verbose      = verbose;
   
-  /* Loop over the input file */
-  while ( (retcode = ms_readmsr (&msr, inputfile, reclen, NULL, &lastrecord,
-				 1, 1, verbose)) == MS_NOERROR )
-    {
-      msr_print (msr, ppackets);
-      
-      /* Convert sample type as needed for packencoding */
-      if ( packencoding >= 0 && packencoding != msr->encoding )
-	{
-	  if ( convertsamples (msr, packencoding) )
-	    {
-	      ms_log (2, "Error converting samples for encoding %d\n", packencoding);
-	      break;
-	    }
-	}
-      
-      if ( packreclen >= 0 )
-	msr->reclen = packreclen;
-      else
-	packreclen = msr->reclen;
-      
-      if ( packencoding >= 0 )
-	msr->encoding = packencoding;
-      else
-	packencoding = msr->encoding;
-      
-      if ( byteorder >= 0 )
-	msr->byteorder = byteorder;
-      else
-	byteorder = msr->byteorder;
-      
-      /* After unpacking the record, the start time in msr->starttime
-	 is a potentially corrected start time, if correction has been
-	 applied make sure the correction bit flag is set as it will
-	 be used as a packing template. */
-      if ( msr->fsdh->time_correct && ! (msr->fsdh->act_flags & 0x02) )
-	{
-	  ms_log (1, "Setting time correction applied flag for %s_%s_%s_%s\n",
-		  msr->network, msr->station, msr->location, msr->channel);
-	  msr->fsdh->act_flags |= 0x02;
-	}
-      
-      /* Replace network code */
-      if ( netcode )
-	strncpy (msr->network, netcode, sizeof(msr->network));
-      
-      /* If no samples in the record just pack the header */
-      if ( outfile && msr->numsamples == 0 )
-	{
-	  msr_pack_header (msr, 1, verbose);
-	  record_handler (msr->record, msr->reclen, NULL);
-	}
-      
-      /* Pack each record individually */
-      else if ( outfile && ! tracepack )
-	{
-	  msr->sequence_number = iseqnum;
-	  
-	  packedrecords = msr_pack (msr, &record_handler, NULL, &packedsamples, 1, verbose);
-	  
-	  if ( packedrecords == -1 )
-	    ms_log (2, "Cannot pack records\n"); 
-	  else
-	    ms_log (1, "Packed %d records\n", packedrecords); 
-	  
-	  iseqnum = msr->sequence_number;
-	}
-      
-      /* Pack records from a MSTraceGroup */
-      else if ( outfile && tracepack )
-	{
-	  mst = mst_addmsrtogroup (mstg, msr, 0, -1.0, -1.0);
-	  
-	  if ( ! mst )
-	    {
-	      ms_log (2, "Error adding MSRecord to MStrace!\n");
-	      break;
-	    }
-	  	  
-	  /* Reset sequence number and free previous template */
-	  if ( mst->prvtptr )
-	    {
-	      MSRecord *tmsr = (MSRecord *) mst->prvtptr;
-	      
-	      /* Retain sequence number from previous template */
-	      msr->sequence_number = tmsr->sequence_number;
-	      
-	      msr_free (&tmsr);
-	    }
-	  else
-	    {
-	      msr->sequence_number = 1;
-	    }
-	  
-	  /* Copy MSRecord and store as template */
-	  mst->prvtptr = msr_duplicate (msr, 0);
-	  
-	  if ( ! mst->prvtptr )
-	    {
-	      ms_log (2, "Error duplicating MSRecord for template!\n");
-	      break;
-	    }
-	  
-	  /* Pack traces based on selected method */
-	  packedrecords = 0;
-	  if ( tracepack == 1 )
-	    {
-	      mst = mstg->traces;
-	      while ( mst )
-		{
-		  packedrecords += mst_pack (mst, &record_handler, NULL, packreclen,
-					     packencoding, byteorder, &packedsamples,
-					     0, verbose, (MSRecord *)mst->prvtptr);
-		  mst = mst->next;
-		}
-	      
-	      ms_log (1, "Packed %d records\n", packedrecords);
-	    }
-	  if ( tracepack == 2 && lastrecord )
-	    {
-	      mst = mstg->traces;
-	      while ( mst )
-		{
-		  packedrecords += mst_pack (mst, &record_handler, NULL, packreclen,
-					     packencoding, byteorder, &packedsamples,
-					     1, verbose, (MSRecord *)mst->prvtptr);
-		  mst = mst->next;
-		}
-	      
-	      ms_log (1, "Packed %d records\n", packedrecords);
-	    }
-	}
-    }
-  
-  /* Make sure buffer of input data is flushed */
-  packedrecords = 0;
-  if ( tracepack )
-    {
-      mst = mstg->traces;
-      while ( mst )
-	{
-	  packedrecords += mst_pack (mst, &record_handler, NULL, packreclen,
-				     packencoding, byteorder, &packedsamples,
-				     1, verbose, (MSRecord *)mst->prvtptr);
-	  mst = mst->next;
-	}
-      
-      if ( packedrecords )
-	ms_log (1, "Packed %d records\n", packedrecords);
-    }
+  if ( netcode )
+    strncpy (params.network, netcode, sizeof(params.network) - 1);
   
-  if ( retcode != MS_ENDOFFILE )
-    ms_log (2, "Error reading %s: %s\n", inputfile, ms_errorstr(retcode));
+  packedrecords = ms_repack (inputfile, &params, &record_handler, NULL);
   
-  /* Make sure everything is cleaned up */
-  ms_readmsr (&msr, NULL, 0, NULL, NULL, 0, 0, 0);
-  mst_freegroup (&mstg);
+  if ( packedrecords >= 0 )
+    ms_log (1, "Packed %lld records\n", (long long int) packedrecords);
   
   if ( outfile )
     fclose (outfile);
   
-  return 0;
+  return (packedrecords >= 0) ? 0 : 1;
 }  /* End of main() */
 
 
-/***************************************************************************
- * convertsamples:
- *
- * Convert samples to type needed for the specified pack encoding.
- *
- * Returns 0 on success, and -1 on failure
- ***************************************************************************/
-static int
-convertsamples (MSRecord *msr, int packencoding)
-{
-  char encodingtype;
-  int32_t *idata;
-  float *fdata;
-  double *ddata;
-  int idx;
-  
-  if ( ! msr )
-    {
-      ms_log (2, "convertsamples: Error, no MSRecord specified!\n");
-      return -1;
-    }
-  
-  /* Determine sample type needed for pack encoding */
-  switch (packencoding)
-    {
-    case DE_ASCII:
-      encodingtype = 'a';
-      break;
-    case DE_INT16:
-    case DE_INT32:
-    case DE_STEIM1:
-    case DE_STEIM2:
-      encodingtype = 'i';
-      break;
-    case DE_FLOAT32:
-      encodingtype = 'f';
-      break;
-    case DE_FLOAT64:
-      encodingtype = 'd';
-      break;
-    default:
-      encodingtype = msr->encoding;
-      break;
-    }
-  
-  idata = (int32_t *) msr->datasamples;
-  fdata = (float *) msr->datasamples;
-  ddata = (double *) msr->datasamples;
-  
-  /* Convert sample type if needed */
-  if ( msr->sampletype != encodingtype )
-    {
-      if ( msr->sampletype == 'a' || encodingtype == 'a' )
-	{
-	  ms_log (2, "Error, cannot convert ASCII samples to/from numeric type\n");
-	  return -1;
-	}
-      
-      /* Convert to integers */
-      else if ( encodingtype == 'i' )
-	{
-	  if ( msr->sampletype == 'f' )      /* Convert floats to integers with simple rounding */
-	    {
-	      for (idx = 0; idx < msr->numsamples; idx++)
-		{
-		  /* Check for loss of sub-integer */
-		  if ( (fdata[idx] - (int32_t)fdata[idx]) > 0.000001 )
-		    {
-		      ms_log (2, "Warning, Loss of precision when converting floats to integers, loss: %g\n",
-			      (fdata[idx] - (int32_t)fdata[idx]));
-		      return -1;
-		    }
-		  
-		  idata[idx] = (int32_t) (fdata[idx] + 0.5);
-		}
-	    }
-	  else if ( msr->sampletype == 'd' ) /* Convert doubles to integers with simple rounding */
-	    {
-	      for (idx = 0; idx < msr->numsamples; idx++)
-		{
-		  /* Check for loss of sub-integer */
-		  if ( (ddata[idx] - (int32_t)ddata[idx]) > 0.000001 )
-		    {
-		      ms_log (2, "Warning, Loss of precision when converting doubles to integers, loss: %g\n",
-			      (ddata[idx] - (int32_t)ddata[idx]));
-		      return -1;
-		    }
-
-		  idata[idx] = (int32_t) (ddata[idx] + 0.5);
-		}
-	      
-	      /* Reallocate buffer for reduced size needed */
-	      if ( ! (msr->datasamples = realloc (msr->datasamples,(size_t)(msr->numsamples * sizeof(int32_t)))) )
-		{
-		  ms_log (2, "Error, cannot re-allocate buffer for sample conversion\n");
-		  return -1;
-		}
-	    }
-	  
-	  msr->sampletype = 'i';
-	}
-      
-      /* Convert to floats */
-      else if ( encodingtype == 'f' )
-	{
-	  if ( msr->sampletype == 'i' )      /* Convert integers to floats */
-	    {
-	      for (idx = 0; idx < msr->numsamples; idx++)
-		fdata[idx] = (float) idata[idx];
-	    }
-	  else if ( msr->sampletype == 'd' ) /* Convert doubles to floats */
-	    {
-	      for (idx = 0; idx < msr->numsamples; idx++)
-		fdata[idx] = (float) ddata[idx];
-	      
-	      /* Reallocate buffer for reduced size needed */
-	      if ( ! (msr->datasamples = realloc (msr->datasamples, (size_t)(msr->numsamples * sizeof(float)))) )
-		{
-		  ms_log (2, "Error, cannot re-allocate buffer for sample conversion\n");
-		  return -1;
-		}
-	    }
-	  
-	  msr->sampletype = 'f';
-	}
-      
-      /* Convert to doubles */
-      else if ( encodingtype == 'd' )
-	{
-	  if ( ! (ddata = (double *) malloc ((size_t)(msr->numsamples * sizeof(double)))) )
-	    {
-	      ms_log (2, "Error, cannot allocate buffer for sample conversion to doubles\n");
-	      return -1;
-	    }
-	  
-	  if ( msr->sampletype == 'i' )      /* Convert integers to doubles */
-	    {
-	      for (idx = 0; idx < msr->numsamples; idx++)
-		ddata[idx] = (double) idata[idx];
-	      
-	      free (idata);
-	    }
-	  else if ( msr->sampletype == 'f' ) /* Convert floats to doubles */
-	    {
-	      for (idx = 0; idx < msr->numsamples; idx++)
-		ddata[idx] = (double) fdata[idx];
-	      
-	      free (fdata);
-	    }
-	  
-	  msr->datasamples = ddata;
-	  msr->sampletype = 'd';
-	}
-    }
-  
-  return 0;
-}  /* End of convertsamples() */
-
-
 /***************************************************************************
  * parameter_proc:
  *
@@ -487,6 +179,10 @@ parameter_proc (int argcount, char **argvec)
 	{
 	  byteorder = strtol (argvec[++optind], NULL, 10);
 	}
+      else if (strcmp (argvec[optind], "-T") == 0)
+	{
+	  threads = strtol (argvec[++optind], NULL, 10);
+	}
       else if (strcmp (argvec[optind], "-N") == 0)
 	{
 	  netcode = argvec[++optind];
@@ -590,6 +286,7 @@ usage (void)
 	   " -E encoding    Specify encoding format for packing\n"
 	   " -b byteorder   Specify byte order for packing, MSBF: 1, LSBF: 0\n"
 	   " -N netcode     Specify network code for output data\n"
+	   " -T threads     Number of threads for packing, 0 for all processors\n"
 	   "\n"
 	   " -o outfile     Specify the output file, required\n"
 	   "\n"
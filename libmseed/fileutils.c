@@ -18,8 +18,156 @@
 
 #include "libmseed.h"
 
+#if !defined(LMP_WIN)
+  #include <pthread.h>
+#endif
+
 static int ms_fread (char *buf, int size, int num, FILE *stream);
 
+/* Seek to the time window of files in time order, see ms_timewin_range() */
+flag timewinseek = 0;
+
+/* Shared state for reading multiple files into trace lists */
+typedef struct ReadFiles_s
+{
+  const char **msfiles;   /* Files to read */
+  int filecount;          /* Number of files */
+  int reclen;
+  double timetol;
+  double sampratetol;
+  Selections *selections;
+  flag dataquality;
+  flag skipnotdata;
+  flag dataflag;
+  flag verbose;
+  MSTraceListSpill *spill; /* Sample file storage settings for lists */
+  MSTraceList **lists;    /* Trace list for each file */
+  int *retcodes;          /* Return code for each file */
+  flag *done;             /* Flag for each file, true when read */
+  int nextfile;           /* Next file to be read */
+  int window;             /* Files before this index may be read */
+  flag stop;              /* Stop reading files */
+#if !defined(LMP_WIN)
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+#endif
+} ReadFiles;
+
+static void ms_readfile_list (ReadFiles *rf, int idx);
+static int ms_readtraces_range (MSTraceGroup **ppmstg, const char *msfile,
+                                int reclen, double timetol, double sampratetol,
+                                Selections *selections, flag dataquality,
+                                flag skipnotdata, flag dataflag,
+                                off_t startoffset, off_t endoffset, flag verbose);
+static int ms_readtracelist_range (MSTraceList **ppmstl, const char *msfile,
+                                   int reclen, double timetol, double sampratetol,
+                                   Selections *selections, flag dataquality,
+                                   flag skipnotdata, flag dataflag,
+                                   off_t startoffset, off_t endoffset, flag verbose);
+static int ms_timewin_range (const char *msfile, int reclen, hptime_t starttime,
+                             hptime_t endtime, off_t *startoffset,
+                             off_t *endoffset, flag verbose);
+static int ms_probe_record (FILE *fp, char *record, int reclen, off_t offset,
+                            char *srcname, hptime_t *starttime, hptime_t *endtime);
+#if !defined(LMP_WIN)
+static void *ms_readfiles_thread (void *arg);
+#endif
+
+/* Buffer of packed records for repacking, reused between records */
+typedef struct RepackBuffer_s
+{
+  char *data;
+  size_t size;            /* Allocated size of data */
+  size_t length;          /* Length of records in data */
+  int reclen;             /* Length of each record */
+  int records;            /* Number of records in data */
+  flag error;             /* Memory could not be allocated */
+} RepackBuffer;
+
+/* An input record to be repacked, jobs are kept in a ring by sequence */
+typedef struct RepackJob_s
+{
+  int64_t seq;            /* Sequence of input record */
+  char srcname[50];       /* Stream of input record, NET_STA_LOC_CHAN */
+  char *record;           /* Copy of input record */
+  int recordsize;         /* Allocated size of record */
+  int reclen;             /* Input record length */
+  int convertencoding;    /* Convert samples for this encoding, -1 for none */
+  int packreclen;
+  int packencoding;
+  int byteorder;
+  flag timecorrect;       /* Set the time correction applied flag */
+  flag renumber;          /* Assign output sequence numbers when written */
+  int retcode;            /* 0 on success, 1 if skipped, -1 on error */
+  flag done;              /* Job is processed and ready to write */
+  RepackBuffer output;    /* Packed records */
+  struct RepackJob_s *next; /* Next job in worker queue */
+} RepackJob;
+
+/* Repacking state of a trace, stored as MSTrace.prvtptr */
+typedef struct RepackTrace_s
+{
+  MSRecord *template;     /* Template for packing */
+  int64_t order;          /* Sequence of the record that created the trace */
+} RepackTrace;
+
+/* Records packed when flushing a trace */
+typedef struct RepackFlush_s
+{
+  int64_t order;          /* Sequence of the record that created the trace */
+  RepackBuffer output;
+} RepackFlush;
+
+/* A worker encoding the records of a subset of streams */
+typedef struct RepackWorker_s
+{
+  struct Repack_s *repack;
+  MSTraceGroup *mstg;     /* Traces of the streams of this worker */
+  MSRecord *msr;          /* Unpacked input record */
+  RepackJob *head;        /* Queue of jobs */
+  RepackJob *tail;
+  flag finish;            /* No more jobs will be queued */
+  RepackFlush *flush;     /* Records packed for each trace when flushing */
+  int flushcount;
+  char (*failed)[50];     /* Streams with a record that could not be unpacked */
+  int failedcount;
+  int retcode;            /* Result of flushing, 0 on success, -1 on error */
+#if !defined(LMP_WIN)
+  pthread_t tid;
+  pthread_cond_t cond;
+#endif
+} RepackWorker;
+
+/* Shared state for ms_repack() */
+typedef struct Repack_s
+{
+  MSRepackParams *params;
+  int packreclen;         /* Output parameters resolved from the first record */
+  int packencoding;
+  int byteorder;
+  RepackWorker *workers;
+  int workercount;
+  flag threaded;          /* Workers are running in threads */
+  flag dataerror;         /* Input could not be read or unpacked completely */
+  RepackJob *jobs;        /* Ring of jobs */
+  int window;             /* Number of jobs in ring */
+#if !defined(LMP_WIN)
+  pthread_mutex_t lock;
+  pthread_cond_t donecond;
+#endif
+} Repack;
+
+static void ms_repack_handler (char *record, int reclen, void *ptr);
+static int ms_repack_record (RepackWorker *worker, RepackJob *job);
+static int ms_repack_flush (RepackWorker *worker);
+static int ms_repack_writejob (Repack *rp, RepackJob *job, int *seqnum,
+                               void (*record_handler) (char *, int, void *),
+                               void *handlerdata);
+static int ms_repack_flushcmp (const void *a, const void *b);
+#if !defined(LMP_WIN)
+static void *ms_repack_thread (void *arg);
+#endif
+
 /* Pack type parameters for the 8 defined types:
  * [type] : [hdrlen] [sizelen] [chksumlen]
  */
@@ -733,6 +881,14 @@ ms_readtraces (MSTraceGroup **ppmstg, const char *msfile, int reclen,
  * This is a wrapper for ms_readtraces_selection() that creates a
  * simple selection for a specified time window.
  *
+ * All records are read and tested unless seeking is enabled with
+ * MS_TIMEWINSEEK(1), then for files of uniform length records from a
+ * single source only the records around the time window are read,
+ * located with a binary search of record start times, see
+ * ms_timewin_range().  The caller must know that the records of such
+ * files are in time order, records outside of the located range are
+ * not tested.
+ *
  * See the comments with ms_readtraces_selection() for return values
  * and further description of arguments.
  *********************************************************************/
@@ -744,6 +900,8 @@ ms_readtraces_timewin (MSTraceGroup **ppmstg, const char *msfile, int reclen,
 {
   Selections selection;
   SelectTime selecttime;
+  off_t startoffset = 0;
+  off_t endoffset   = -1;
 
   selection.srcname[0]  = '*';
   selection.srcname[1]  = '\0';
@@ -754,10 +912,15 @@ ms_readtraces_timewin (MSTraceGroup **ppmstg, const char *msfile, int reclen,
   selecttime.endtime   = endtime;
   selecttime.next      = NULL;
 
-  return ms_readtraces_selection (ppmstg, msfile, reclen,
-                                  timetol, sampratetol, &selection,
-                                  dataquality, skipnotdata,
-                                  dataflag, verbose);
+  /* Limit reading to the records that may be in the window */
+  if (timewinseek)
+    ms_timewin_range (msfile, reclen, starttime, endtime,
+                      &startoffset, &endoffset, verbose);
+
+  return ms_readtraces_range (ppmstg, msfile, reclen,
+                              timetol, sampratetol, &selection,
+                              dataquality, skipnotdata, dataflag,
+                              startoffset, endoffset, verbose);
 } /* End of ms_readtraces_timewin() */
 
 /*********************************************************************
@@ -781,9 +944,33 @@ ms_readtraces_selection (MSTraceGroup **ppmstg, const char *msfile,
                          int reclen, double timetol, double sampratetol,
                          Selections *selections, flag dataquality,
                          flag skipnotdata, flag dataflag, flag verbose)
+{
+  return ms_readtraces_range (ppmstg, msfile, reclen, timetol, sampratetol,
+                              selections, dataquality, skipnotdata, dataflag,
+                              0, -1, verbose);
+} /* End of ms_readtraces_selection() */
+
+/*********************************************************************
+ * ms_readtraces_range:
+ *
+ * Read the Mini-SEED records in a range of a file, starting at the
+ * record at startoffset and ending before the first record at or
+ * after endoffset, and populate a trace group.  If endoffset is
+ * negative records are read until the end of the file.
+ *
+ * Otherwise the same as ms_readtraces_selection().
+ *********************************************************************/
+static int
+ms_readtraces_range (MSTraceGroup **ppmstg, const char *msfile,
+                     int reclen, double timetol, double sampratetol,
+                     Selections *selections, flag dataquality,
+                     flag skipnotdata, flag dataflag,
+                     off_t startoffset, off_t endoffset, flag verbose)
 {
   MSRecord *msr     = 0;
   MSFileParam *msfp = 0;
+  off_t fpos        = -startoffset;
+  flag indexed;
   int retcode;
 
   if (!ppmstg)
@@ -798,10 +985,19 @@ ms_readtraces_selection (MSTraceGroup **ppmstg, const char *msfile,
       return MS_GENERROR;
   }
 
+  /* Index the group while reading unless already indexed by the caller */
+  indexed = ((*ppmstg)->index) ? 1 : 0;
+  if (!indexed)
+    mst_groupindex (*ppmstg, 1);
+
   /* Loop over the input file */
-  while ((retcode = ms_readmsr_main (&msfp, &msr, msfile, reclen, NULL, NULL,
+  while ((retcode = ms_readmsr_main (&msfp, &msr, msfile, reclen, &fpos, NULL,
                                      skipnotdata, dataflag, NULL, verbose)) == MS_NOERROR)
   {
+    /* Done if past the end of the range */
+    if (endoffset >= 0 && fpos >= endoffset)
+      break;
+
     /* Test against selections if supplied */
     if (selections)
     {
@@ -825,10 +1021,16 @@ ms_readtraces_selection (MSTraceGroup **ppmstg, const char *msfile,
   if (retcode == MS_ENDOFFILE)
     retcode = MS_NOERROR;
 
+  /* Release spare sample buffer capacity */
+  mst_groupshrink (*ppmstg);
+
+  if (!indexed)
+    mst_groupindex (*ppmstg, 0);
+
   ms_readmsr_main (&msfp, &msr, NULL, 0, NULL, NULL, 0, 0, NULL, 0);
 
   return retcode;
-} /* End of ms_readtraces_selection() */
+} /* End of ms_readtraces_range() */
 
 /*********************************************************************
  * ms_readtracelist:
@@ -853,10 +1055,13 @@ ms_readtracelist (MSTraceList **ppmstl, const char *msfile, int reclen,
 /*********************************************************************
  * ms_readtracelist_timewin:
  *
- * This is a wrapper for ms_readtraces_selection() that creates a
+ * This is a wrapper for ms_readtracelist_selection() that creates a
  * simple selection for a specified time window.
  *
- * See the comments with ms_readtraces_selection() for return values
+ * All records are read and tested unless seeking is enabled with
+ * MS_TIMEWINSEEK(1), see ms_readtraces_timewin().
+ *
+ * See the comments with ms_readtracelist_selection() for return values
  * and further description of arguments.
  *********************************************************************/
 int
@@ -867,6 +1072,8 @@ ms_readtracelist_timewin (MSTraceList **ppmstl, const char *msfile,
 {
   Selections selection;
   SelectTime selecttime;
+  off_t startoffset = 0;
+  off_t endoffset   = -1;
 
   selection.srcname[0]  = '*';
   selection.srcname[1]  = '\0';
@@ -877,10 +1084,15 @@ ms_readtracelist_timewin (MSTraceList **ppmstl, const char *msfile,
   selecttime.endtime   = endtime;
   selecttime.next      = NULL;
 
-  return ms_readtracelist_selection (ppmstl, msfile, reclen,
-                                     timetol, sampratetol, &selection,
-                                     dataquality, skipnotdata,
-                                     dataflag, verbose);
+  /* Limit reading to the records that may be in the window */
+  if (timewinseek)
+    ms_timewin_range (msfile, reclen, starttime, endtime,
+                      &startoffset, &endoffset, verbose);
+
+  return ms_readtracelist_range (ppmstl, msfile, reclen,
+                                 timetol, sampratetol, &selection,
+                                 dataquality, skipnotdata, dataflag,
+                                 startoffset, endoffset, verbose);
 } /* End of ms_readtracelist_timewin() */
 
 /*********************************************************************
@@ -904,9 +1116,32 @@ ms_readtracelist_selection (MSTraceList **ppmstl, const char *msfile,
                             int reclen, double timetol, double sampratetol,
                             Selections *selections, flag dataquality,
                             flag skipnotdata, flag dataflag, flag verbose)
+{
+  return ms_readtracelist_range (ppmstl, msfile, reclen, timetol, sampratetol,
+                                 selections, dataquality, skipnotdata, dataflag,
+                                 0, -1, verbose);
+} /* End of ms_readtracelist_selection() */
+
+/*********************************************************************
+ * ms_readtracelist_range:
+ *
+ * Read the Mini-SEED records in a range of a file, starting at the
+ * record at startoffset and ending before the first record at or
+ * after endoffset, and populate a trace list.  If endoffset is
+ * negative records are read until the end of the file.
+ *
+ * Otherwise the same as ms_readtracelist_selection().
+ *********************************************************************/
+static int
+ms_readtracelist_range (MSTraceList **ppmstl, const char *msfile,
+                        int reclen, double timetol, double sampratetol,
+                        Selections *selections, flag dataquality,
+                        flag skipnotdata, flag dataflag,
+                        off_t startoffset, off_t endoffset, flag verbose)
 {
   MSRecord *msr     = 0;
   MSFileParam *msfp = 0;
+  off_t fpos        = -startoffset;
   int retcode;
 
   if (!ppmstl)
@@ -922,9 +1157,13 @@ ms_readtracelist_selection (MSTraceList **ppmstl, const char *msfile,
   }
 
   /* Loop over the input file */
-  while ((retcode = ms_readmsr_main (&msfp, &msr, msfile, reclen, NULL, NULL,
+  while ((retcode = ms_readmsr_main (&msfp, &msr, msfile, reclen, &fpos, NULL,
                                      skipnotdata, dataflag, NULL, verbose)) == MS_NOERROR)
   {
+    /* Done if past the end of the range */
+    if (endoffset >= 0 && fpos >= endoffset)
+      break;
+
     /* Test against selections if supplied */
     if (selections)
     {
@@ -948,10 +1187,467 @@ ms_readtracelist_selection (MSTraceList **ppmstl, const char *msfile,
   if (retcode == MS_ENDOFFILE)
     retcode = MS_NOERROR;
 
+  /* Release spare sample buffer capacity */
+  mstl_shrink (*ppmstl);
+
   ms_readmsr_main (&msfp, &msr, NULL, 0, NULL, NULL, 0, 0, NULL, 0);
 
   return retcode;
-} /* End of ms_readtracelist_selection() */
+} /* End of ms_readtracelist_range() */
+
+/*********************************************************************
+ * ms_timewin_range:
+ *
+ * Determine the range of a file containing the records that may
+ * include data in a time window.  The start time and/or end time may
+ * be HPTERROR to leave the window open on that side.
+ *
+ * A range is only determined for files of records with the same
+ * length, either reclen or detected from the first record, that all
+ * contain data from the same source in time order.  The first and
+ * last records of the file and each record examined during a binary
+ * search of record times are checked for these conditions, but time
+ * order of the other records is not verified as that would require
+ * reading every record header, so this is only used when enabled with
+ * MS_TIMEWINSEEK().  One extra record is included at each end of the
+ * range as a margin.
+ *
+ * Returns 0 and sets startoffset and endoffset when a range is
+ * determined, otherwise returns -1 and the offsets are not changed.
+ *********************************************************************/
+static int
+ms_timewin_range (const char *msfile, int reclen, hptime_t starttime,
+                  hptime_t endtime, off_t *startoffset, off_t *endoffset,
+                  flag verbose)
+{
+  FILE *fp = NULL;
+  struct stat sbuf;
+  char *record = NULL;
+  char firstsrc[50];
+  char srcname[50];
+  hptime_t firststart;
+  hptime_t laststart;
+  hptime_t recstart;
+  hptime_t recend;
+  off_t count;
+  off_t low;
+  off_t high;
+  off_t mid;
+  off_t first;
+  off_t last;
+  int retval = -1;
+
+  if (!msfile || !strcmp (msfile, "-"))
+    return -1;
+
+  if (starttime == HPTERROR && endtime == HPTERROR)
+    return -1;
+
+  if ((fp = fopen (msfile, "rb")) == NULL)
+    return -1;
+
+  if (fstat (fileno (fp), &sbuf) || !(record = (char *)malloc (MAXRECLEN)))
+    goto done;
+
+  /* Determine record length from the first record if needed */
+  if (reclen <= 0)
+  {
+    if (ms_fread (record, 1, (sbuf.st_size < MAXRECLEN) ? (int)sbuf.st_size : MAXRECLEN, fp) < 48)
+      goto done;
+
+    if ((reclen = ms_detect (record, (sbuf.st_size < MAXRECLEN) ? (int)sbuf.st_size : MAXRECLEN)) <= 0)
+      goto done;
+  }
+
+  if (reclen < MINRECLEN || reclen > MAXRECLEN || sbuf.st_size % reclen)
+    goto done;
+
+  count = sbuf.st_size / reclen;
+
+  /* Not worth searching small files */
+  if (count < 16)
+    goto done;
+
+  if (ms_probe_record (fp, record, reclen, 0, firstsrc, &firststart, &recend) ||
+      ms_probe_record (fp, record, reclen, (count - 1) * reclen, srcname, &laststart, &recend) ||
+      strcmp (firstsrc, srcname) || laststart < firststart)
+    goto done;
+
+  /* Search for the first record ending at or after the window start */
+  first = 0;
+  if (starttime != HPTERROR)
+  {
+    low  = 0;
+    high = count;
+    while (low < high)
+    {
+      mid = low + (high - low) / 2;
+
+      if (ms_probe_record (fp, record, reclen, mid * reclen, srcname, &recstart, &recend) ||
+          strcmp (firstsrc, srcname) || recstart < firststart || recstart > laststart)
+        goto done;
+
+      if (recend < starttime)
+        low = mid + 1;
+      else
+        high = mid;
+    }
+
+    first = (low > 0) ? low - 1 : 0;
+  }
+
+  /* Search for the first record starting after the window end */
+  last = count;
+  if (endtime != HPTERROR)
+  {
+    low  = first;
+    high = count;
+    while (low < high)
+    {
+      mid = low + (high - low) / 2;
+
+      if (ms_probe_record (fp, record, reclen, mid * reclen, srcname, &recstart, &recend) ||
+          strcmp (firstsrc, srcname) || recstart < firststart || recstart > laststart)
+        goto done;
+
+      if (recstart <= endtime)
+        low = mid + 1;
+      else
+        high = mid;
+    }
+
+    last = (low < count) ? low + 1 : count;
+  }
+
+  if (verbose > 1)
+    ms_log (1, "Reading records %" PRId64 " to %" PRId64 " of %" PRId64 " in %s\n",
+            (int64_t)first, (int64_t)last - 1, (int64_t)count, msfile);
+
+  *startoffset = first * reclen;
+  *endoffset   = last * reclen;
+  retval       = 0;
+
+done:
+  if (record)
+    free (record);
+
+  fclose (fp);
+
+  return retval;
+} /* End of ms_timewin_range() */
+
+/*********************************************************************
+ * ms_probe_record:
+ *
+ * Read and parse the header of the record of length reclen at an
+ * offset in a file, returning the source name, start time and end
+ * time.  The record buffer must be at least reclen bytes.
+ *
+ * Returns 0 on success and -1 if a record of the expected length
+ * could not be read.
+ *********************************************************************/
+static int
+ms_probe_record (FILE *fp, char *record, int reclen, off_t offset,
+                 char *srcname, hptime_t *starttime, hptime_t *endtime)
+{
+  MSRecord *msr = NULL;
+  int detlen;
+
+  if (lmp_fseeko (fp, offset, SEEK_SET))
+    return -1;
+
+  if (ms_fread (record, 1, reclen, fp) != reclen)
+    return -1;
+
+  /* The record must be the same length or not include a length */
+  if ((detlen = ms_detect (record, reclen)) < 0 || (detlen > 0 && detlen != reclen))
+    return -1;
+
+  if (msr_parse (record, reclen, &msr, reclen, 0, 0) != MS_NOERROR)
+  {
+    msr_free (&msr);
+    return -1;
+  }
+
+  msr_srcname (msr, srcname, 1);
+  *starttime = msr->starttime;
+  *endtime   = msr_endtime (msr);
+
+  msr_free (&msr);
+
+  return (*endtime == HPTERROR) ? -1 : 0;
+} /* End of ms_probe_record() */
+
+/*********************************************************************
+ * ms_readtracelist_files:
+ *
+ * Read all Mini-SEED records in a list of files and populate a trace
+ * list, using multiple threads to read and decode files in parallel.
+ *
+ * Each file is read into a separate trace list, as by
+ * ms_readtracelist_selection(), and the lists are merged into the
+ * trace list at *ppmstl in the order of the files using
+ * mstl_merge().  The result does not depend on the number of threads
+ * or the order in which the reading of files completes.  Merging is
+ * done while later files are read, at most a few files per thread
+ * are read ahead of merging to limit memory usage.
+ *
+ * If threads is <= 0 the number of online processors is used, if
+ * threads is 1 (or threads are not supported on the platform) all
+ * files are read by the calling thread.
+ *
+ * If a Selections list is supplied it will be used to limit which
+ * records are added to the trace list.
+ *
+ * Returns MS_NOERROR and populates an MSTraceList struct at *ppmstl
+ * on successful read, otherwise returns the libmseed error code
+ * (listed in libmseed.h) of the first file that could not be read.
+ * Data from files before the failing file, and any read from that
+ * file, are included in the trace list.
+ *********************************************************************/
+int
+ms_readtracelist_files (MSTraceList **ppmstl, const char **msfiles, int filecount,
+                        int reclen, double timetol, double sampratetol,
+                        Selections *selections, flag dataquality,
+                        flag skipnotdata, flag dataflag, int threads,
+                        flag verbose)
+{
+  ReadFiles rf;
+  flag adopt;
+  flag stop = 0;
+  int started = 0;
+  int retcode = MS_NOERROR;
+  int idx;
+#if !defined(LMP_WIN)
+  pthread_t *tids = 0;
+#endif
+
+  if (!ppmstl || !msfiles || filecount < 0)
+    return MS_GENERROR;
+
+  /* The list of the first file is used directly if no list is supplied */
+  adopt = (*ppmstl) ? 0 : 1;
+
+  memset (&rf, 0, sizeof (ReadFiles));
+  rf.msfiles     = msfiles;
+  rf.filecount   = filecount;
+  rf.reclen      = reclen;
+  rf.timetol     = timetol;
+  rf.sampratetol = sampratetol;
+  rf.selections  = selections;
+  rf.dataquality = dataquality;
+  rf.skipnotdata = skipnotdata;
+  rf.dataflag    = dataflag;
+  rf.verbose     = verbose;
+  rf.spill       = (*ppmstl) ? (*ppmstl)->spill : NULL;
+
+  rf.lists    = (MSTraceList **)calloc (filecount + 1, sizeof (MSTraceList *));
+  rf.retcodes = (int *)calloc (filecount + 1, sizeof (int));
+  rf.done     = (flag *)calloc (filecount + 1, sizeof (flag));
+
+  if (!rf.lists || !rf.retcodes || !rf.done)
+  {
+    ms_log (2, "ms_readtracelist_files(): Cannot allocate memory\n");
+    retcode = MS_GENERROR;
+    goto cleanup;
+  }
+
+#if !defined(LMP_WIN)
+  if (threads <= 0)
+    threads = (int)sysconf (_SC_NPROCESSORS_ONLN);
+
+  if (threads > filecount)
+    threads = filecount;
+
+  if (threads > 1)
+  {
+    if (!(tids = (pthread_t *)calloc (threads, sizeof (pthread_t))))
+    {
+      ms_log (2, "ms_readtracelist_files(): Cannot allocate memory\n");
+      retcode = MS_GENERROR;
+      goto cleanup;
+    }
+
+    rf.window = threads * 2;
+
+    pthread_mutex_init (&rf.lock, NULL);
+    pthread_cond_init (&rf.cond, NULL);
+
+    for (started = 0; started < threads; started++)
+    {
+      if (pthread_create (&tids[started], NULL, ms_readfiles_thread, &rf))
+      {
+        ms_log (1, "ms_readtracelist_files(): Cannot start thread, using %d\n", started);
+        break;
+      }
+    }
+  }
+#endif
+
+  /* Merge the list of each file in file order */
+  for (idx = 0; idx < filecount; idx++)
+  {
+    if (!started)
+    {
+      ms_readfile_list (&rf, idx);
+      rf.done[idx] = 1;
+    }
+#if !defined(LMP_WIN)
+    else
+    {
+      pthread_mutex_lock (&rf.lock);
+      while (!rf.done[idx])
+        pthread_cond_wait (&rf.cond, &rf.lock);
+      pthread_mutex_unlock (&rf.lock);
+    }
+#endif
+
+    if (adopt && rf.lists[idx])
+    {
+      *ppmstl       = rf.lists[idx];
+      rf.lists[idx] = 0;
+      adopt         = 0;
+    }
+    else if (rf.lists[idx])
+    {
+      if (mstl_merge (*ppmstl, rf.lists[idx], dataquality, 1, timetol, sampratetol))
+        rf.retcodes[idx] = MS_GENERROR;
+
+      mstl_free (&rf.lists[idx], 0);
+    }
+
+    if (rf.retcodes[idx] != MS_NOERROR)
+    {
+      retcode = rf.retcodes[idx];
+      stop    = 1;
+    }
+
+#if !defined(LMP_WIN)
+    /* Allow reading further ahead or signal threads to stop */
+    if (started)
+    {
+      pthread_mutex_lock (&rf.lock);
+      rf.window = idx + 1 + threads * 2;
+      rf.stop   = stop;
+      pthread_cond_broadcast (&rf.cond);
+      pthread_mutex_unlock (&rf.lock);
+    }
+#endif
+
+    if (stop)
+      break;
+  }
+
+  /* Initialize MSTraceList if no files were read */
+  if (adopt && !*ppmstl)
+  {
+    if (!(*ppmstl = mstl_init (NULL)))
+      retcode = MS_GENERROR;
+  }
+
+  /* Release spare sample buffer capacity from merging */
+  if (*ppmstl)
+    mstl_shrink (*ppmstl);
+
+cleanup:
+#if !defined(LMP_WIN)
+  if (tids)
+  {
+    for (idx = 0; idx < started; idx++)
+      pthread_join (tids[idx], NULL);
+
+    pthread_mutex_destroy (&rf.lock);
+    pthread_cond_destroy (&rf.cond);
+    free (tids);
+  }
+#endif
+
+  if (rf.lists)
+  {
+    for (idx = 0; idx < filecount; idx++)
+      if (rf.lists[idx])
+        mstl_free (&rf.lists[idx], 0);
+
+    free (rf.lists);
+  }
+
+  if (rf.retcodes)
+    free (rf.retcodes);
+
+  if (rf.done)
+    free (rf.done);
+
+  return retcode;
+} /* End of ms_readtracelist_files() */
+
+/*********************************************************************
+ * ms_readfile_list:
+ *
+ * Read a file of a ReadFiles set into the trace list for the file.
+ *********************************************************************/
+static void
+ms_readfile_list (ReadFiles *rf, int idx)
+{
+  if (rf->verbose)
+    ms_log (1, "Reading %s\n", rf->msfiles[idx]);
+
+  /* Store samples of large segments in files as for the result */
+  if (rf->spill)
+  {
+    if (!(rf->lists[idx] = mstl_init (NULL)) ||
+        mstl_spill (rf->lists[idx], rf->spill->directory, rf->spill->threshold))
+    {
+      rf->retcodes[idx] = MS_GENERROR;
+      return;
+    }
+  }
+
+  rf->retcodes[idx] = ms_readtracelist_selection (&rf->lists[idx], rf->msfiles[idx],
+                                                  rf->reclen, rf->timetol, rf->sampratetol,
+                                                  rf->selections, rf->dataquality,
+                                                  rf->skipnotdata, rf->dataflag,
+                                                  (rf->verbose > 1) ? rf->verbose - 1 : 0);
+} /* End of ms_readfile_list() */
+
+#if !defined(LMP_WIN)
+/*********************************************************************
+ * ms_readfiles_thread:
+ *
+ * Thread to read files of a ReadFiles set until all files are read
+ * or reading is stopped.  Files are claimed in order and no further
+ * than the current read ahead window.
+ *********************************************************************/
+static void *
+ms_readfiles_thread (void *arg)
+{
+  ReadFiles *rf = (ReadFiles *)arg;
+  int idx;
+
+  pthread_mutex_lock (&rf->lock);
+
+  for (;;)
+  {
+    while (!rf->stop && rf->nextfile < rf->filecount && rf->nextfile >= rf->window)
+      pthread_cond_wait (&rf->cond, &rf->lock);
+
+    if (rf->stop || rf->nextfile >= rf->filecount)
+      break;
+
+    idx = rf->nextfile++;
+    pthread_mutex_unlock (&rf->lock);
+
+    ms_readfile_list (rf, idx);
+
+    pthread_mutex_lock (&rf->lock);
+    rf->done[idx] = 1;
+    pthread_cond_broadcast (&rf->cond);
+  }
+
+  pthread_mutex_unlock (&rf->lock);
+
+  return NULL;
+} /* End of ms_readfiles_thread() */
+#endif
 
 /*********************************************************************
  * ms_fread:
@@ -1165,3 +1861,797 @@ mst_writemseedgroup (MSTraceGroup *mstg, const char *msfile, flag overwrite,
 
   return packedrecords;
 } /* End of mst_writemseedgroup() */
+
+/***************************************************************************
+ * ms_repack:
+ *
+ * Repack the Mini-SEED records of a file, the pattern of the msrepack
+ * example program as a pipeline.  Records are read by the calling
+ * thread and distributed to worker threads by stream (network,
+ * station, location and channel), each worker unpacks and encodes the
+ * records of its streams in order.  Packed records are passed to
+ * record_handler() by the calling thread in the order they would be
+ * created by packing the records serially, so the output does not
+ * depend on the number of threads.
+ *
+ * The output record length, encoding and byte order are taken from
+ * params, when set to -1 the values of the first input record are
+ * used for all records.  Samples are converted to the type needed by
+ * the output encoding.  Records without samples are passed with a
+ * repacked header only.
+ *
+ * The tracepack parameter selects the packing method:
+ * 0 : Pack each input record individually, sequence numbers are
+ *     assigned over all output records.
+ * 1 : Add records to traces and pack records as soon as enough
+ *     samples are available, remaining samples are packed at the end.
+ * 2 : Add records to traces and pack them after reading all records.
+ *
+ * If threads is <= 0 the number of online processors is used, if
+ * threads is 1 (or threads are not supported on the platform) all
+ * records are packed by the calling thread.
+ *
+ * Reading stops at the first record that cannot be read.  A record
+ * that cannot be unpacked ends its stream, later records of the
+ * stream are skipped while other streams continue, so the output
+ * still does not depend on the number of threads.  The samples
+ * accumulated before such errors are packed and passed to
+ * record_handler() before returning.
+ *
+ * Returns the number of records packed on success and -1 on error,
+ * including input that could not be read or unpacked completely.
+ ***************************************************************************/
+int64_t
+ms_repack (const char *msfile, MSRepackParams *params,
+           void (*record_handler) (char *, int, void *), void *handlerdata)
+{
+  Repack rp;
+  MSFileParam *msfp = NULL;
+  MSRecord *msr     = NULL;
+  RepackWorker *worker;
+  RepackJob *job;
+  RepackFlush *flush = NULL;
+  int64_t packedrecords = 0;
+  int64_t written       = 0;
+  int64_t seq           = 0;
+  uint32_t hash;
+  const char *network;
+  const char *cp;
+  int flushcount = 0;
+  int threads;
+  int seqnum = 1;
+  int retcode;
+  int idx;
+  int fidx;
+  flag error = 0;
+
+  if (!msfile || !params || !record_handler)
+    return -1;
+
+  memset (&rp, 0, sizeof (Repack));
+  rp.params       = params;
+  rp.packreclen   = params->packreclen;
+  rp.packencoding = params->packencoding;
+  rp.byteorder    = params->byteorder;
+
+  threads = params->threads;
+#if !defined(LMP_WIN)
+  if (threads <= 0)
+    threads = (int)sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+  if (threads < 1)
+    threads = 1;
+
+  rp.workercount = threads;
+  rp.window      = (threads > 1) ? threads * 16 : 1;
+
+  rp.workers = (RepackWorker *)calloc (rp.workercount, sizeof (RepackWorker));
+  rp.jobs    = (RepackJob *)calloc (rp.window, sizeof (RepackJob));
+
+  if (!rp.workers || !rp.jobs)
+  {
+    ms_log (2, "ms_repack(): Cannot allocate memory\n");
+    error = 1;
+    goto cleanup;
+  }
+
+  for (idx = 0; idx < rp.workercount; idx++)
+  {
+    rp.workers[idx].repack = &rp;
+
+    if (!(rp.workers[idx].mstg = mst_initgroup (NULL)))
+    {
+      ms_log (2, "ms_repack(): Cannot allocate memory\n");
+      error = 1;
+      goto cleanup;
+    }
+  }
+
+#if !defined(LMP_WIN)
+  if (threads > 1)
+  {
+    pthread_mutex_init (&rp.lock, NULL);
+    pthread_cond_init (&rp.donecond, NULL);
+
+    for (idx = 0; idx < rp.workercount; idx++)
+      pthread_cond_init (&rp.workers[idx].cond, NULL);
+
+    rp.threaded = 1;
+
+    for (idx = 0; idx < rp.workercount; idx++)
+    {
+      if (pthread_create (&rp.workers[idx].tid, NULL, ms_repack_thread, &rp.workers[idx]))
+      {
+        ms_log (1, "ms_repack(): Cannot start thread, using %d\n", idx);
+        break;
+      }
+    }
+
+    /* Route streams only to started threads, falling back to the
+     * calling thread if none could be started */
+    for (fidx = idx; fidx < rp.workercount; fidx++)
+      pthread_cond_destroy (&rp.workers[fidx].cond);
+
+    if (idx == 0)
+    {
+      rp.threaded = 0;
+      pthread_mutex_destroy (&rp.lock);
+      pthread_cond_destroy (&rp.donecond);
+      rp.window = 1;
+    }
+
+    rp.workercount = (idx > 0) ? idx : 1;
+  }
+#endif
+
+  while ((retcode = ms_readmsr_r (&msfp, &msr, msfile, params->reclen, NULL, NULL,
+                                  1, 0, params->verbose)) == MS_NOERROR)
+  {
+    if (params->printdetail >= 0)
+      msr_print (msr, params->printdetail);
+
+    /* Write the oldest job to free its place in the ring */
+    if (seq - written >= rp.window)
+    {
+      job = &rp.jobs[written % rp.window];
+
+      if ((retcode = ms_repack_writejob (&rp, job, &seqnum, record_handler, handlerdata)) < 0)
+      {
+        error = 1;
+        break;
+      }
+
+      packedrecords += retcode;
+      written++;
+    }
+
+    job = &rp.jobs[seq % rp.window];
+
+    /* Copy the input record, with room for the output header */
+    idx = (msr->reclen > rp.packreclen) ? msr->reclen : rp.packreclen;
+    if (job->recordsize < idx)
+    {
+      if (!(cp = (char *)realloc (job->record, idx)))
+      {
+        ms_log (2, "ms_repack(): Cannot allocate memory\n");
+        error = 1;
+        break;
+      }
+
+      job->record     = (char *)cp;
+      job->recordsize = idx;
+    }
+
+    memcpy (job->record, msr->record, msr->reclen);
+    if (job->recordsize > msr->reclen)
+      memset (job->record + msr->reclen, 0, job->recordsize - msr->reclen);
+
+    msr_srcname (msr, job->srcname, 0);
+
+    job->seq             = seq;
+    job->reclen          = msr->reclen;
+    job->convertencoding = rp.packencoding;
+    job->done            = 0;
+    job->next            = NULL;
+
+    /* Use parameters of the first record for those not specified */
+    if (rp.packreclen < 0)
+      rp.packreclen = msr->reclen;
+    if (rp.packencoding < 0)
+      rp.packencoding = msr->encoding;
+    if (rp.byteorder < 0)
+      rp.byteorder = msr->byteorder;
+
+    job->packreclen   = rp.packreclen;
+    job->packencoding = rp.packencoding;
+    job->byteorder    = rp.byteorder;
+
+    /* After unpacking the record, the start time in msr->starttime
+       is a potentially corrected start time, if correction has been
+       applied make sure the correction bit flag is set as it will
+       be used as a packing template. */
+    job->timecorrect = 0;
+    if (msr->fsdh->time_correct && !(msr->fsdh->act_flags & 0x02))
+    {
+      ms_log (1, "Setting time correction applied flag for %s_%s_%s_%s\n",
+              msr->network, msr->station, msr->location, msr->channel);
+      job->timecorrect = 1;
+    }
+
+    /* Route records by stream, as they will be named in the output */
+    network = (params->network[0]) ? params->network : msr->network;
+    hash    = 2166136261U;
+    for (cp = network; *cp; cp++)
+      hash = (hash ^ (uint8_t)*cp) * 16777619U;
+    for (cp = msr->station, hash *= 31; *cp; cp++)
+      hash = (hash ^ (uint8_t)*cp) * 16777619U;
+    for (cp = msr->location, hash *= 31; *cp; cp++)
+      hash = (hash ^ (uint8_t)*cp) * 16777619U;
+    for (cp = msr->channel, hash *= 31; *cp; cp++)
+      hash = (hash ^ (uint8_t)*cp) * 16777619U;
+
+    worker = &rp.workers[hash % rp.workercount];
+
+    if (!rp.threaded)
+    {
+      job->retcode = ms_repack_record (worker, job);
+      job->done    = 1;
+    }
+#if !defined(LMP_WIN)
+    else
+    {
+      pthread_mutex_lock (&rp.lock);
+      if (worker->tail)
+        worker->tail->next = job;
+      else
+        worker->head = job;
+      worker->tail = job;
+      pthread_cond_signal (&worker->cond);
+      pthread_mutex_unlock (&rp.lock);
+    }
+#endif
+
+    seq++;
+
+    /* Write completed jobs in order without waiting */
+    while (written < seq)
+    {
+      job = &rp.jobs[written % rp.window];
+
+#if !defined(LMP_WIN)
+      if (rp.threaded)
+      {
+        pthread_mutex_lock (&rp.lock);
+        idx = job->done;
+        pthread_mutex_unlock (&rp.lock);
+
+        if (!idx)
+          break;
+      }
+#endif
+
+      if ((retcode = ms_repack_writejob (&rp, job, &seqnum, record_handler, handlerdata)) < 0)
+      {
+        error = 1;
+        break;
+      }
+
+      packedrecords += retcode;
+      written++;
+    }
+
+    if (error)
+      break;
+  }
+
+  /* Records read before a read error are still packed */
+  if (!error && retcode != MS_ENDOFFILE)
+  {
+    ms_log (2, "Error reading %s: %s\n", msfile, ms_errorstr (retcode));
+    rp.dataerror = 1;
+  }
+
+  /* Write remaining jobs */
+  while (!error && written < seq)
+  {
+    job = &rp.jobs[written % rp.window];
+
+    if ((retcode = ms_repack_writejob (&rp, job, &seqnum, record_handler, handlerdata)) < 0)
+      error = 1;
+    else
+      packedrecords += retcode;
+
+    written++;
+  }
+
+  /* Finish workers, threads flush their traces before exiting */
+#if !defined(LMP_WIN)
+  if (rp.threaded)
+  {
+    pthread_mutex_lock (&rp.lock);
+    for (idx = 0; idx < rp.workercount; idx++)
+    {
+      rp.workers[idx].finish = 1;
+      pthread_cond_signal (&rp.workers[idx].cond);
+    }
+    pthread_mutex_unlock (&rp.lock);
+
+    for (idx = 0; idx < rp.workercount; idx++)
+      pthread_join (rp.workers[idx].tid, NULL);
+  }
+  else
+#endif
+  {
+    for (idx = 0; idx < rp.workercount; idx++)
+      rp.workers[idx].retcode = ms_repack_flush (&rp.workers[idx]);
+  }
+
+  /* Write records flushed from traces in the order traces were created */
+  if (!error)
+  {
+    for (idx = 0; idx < rp.workercount; idx++)
+    {
+      if (rp.workers[idx].retcode)
+        error = 1;
+      flushcount += rp.workers[idx].flushcount;
+    }
+  }
+
+  if (!error && flushcount > 0)
+  {
+    if (!(flush = (RepackFlush *)malloc (flushcount * sizeof (RepackFlush))))
+    {
+      ms_log (2, "ms_repack(): Cannot allocate memory\n");
+      error = 1;
+    }
+    else
+    {
+      for (idx = 0, fidx = 0; idx < rp.workercount; idx++)
+      {
+        memcpy (flush + fidx, rp.workers[idx].flush,
+                rp.workers[idx].flushcount * sizeof (RepackFlush));
+        fidx += rp.workers[idx].flushcount;
+      }
+
+      qsort (flush, flushcount, sizeof (RepackFlush), ms_repack_flushcmp);
+
+      for (idx = 0; idx < flushcount; idx++)
+      {
+        for (fidx = 0; fidx < flush[idx].output.records; fidx++)
+          record_handler (flush[idx].output.data + fidx * flush[idx].output.reclen,
+                          flush[idx].output.reclen, handlerdata);
+
+        packedrecords += flush[idx].output.records;
+      }
+
+      free (flush);
+    }
+  }
+
+cleanup:
+  /* Make sure everything is cleaned up */
+  ms_readmsr_r (&msfp, &msr, NULL, 0, NULL, NULL, 0, 0, 0);
+
+#if !defined(LMP_WIN)
+  if (rp.threaded)
+  {
+    for (idx = 0; idx < rp.workercount; idx++)
+      pthread_cond_destroy (&rp.workers[idx].cond);
+
+    pthread_mutex_destroy (&rp.lock);
+    pthread_cond_destroy (&rp.donecond);
+  }
+#endif
+
+  if (rp.workers)
+  {
+    for (idx = 0; idx < threads; idx++)
+    {
+      worker = &rp.workers[idx];
+
+      for (fidx = 0; fidx < worker->flushcount; fidx++)
+        if (worker->flush[fidx].output.data)
+          free (worker->flush[fidx].output.data);
+
+      if (worker->flush)
+        free (worker->flush);
+
+      if (worker->failed)
+        free (worker->failed);
+
+      if (worker->mstg)
+        mst_freegroup (&worker->mstg);
+
+      if (worker->msr)
+        msr_free (&worker->msr);
+    }
+
+    free (rp.workers);
+  }
+
+  if (rp.jobs)
+  {
+    for (idx = 0; idx < rp.window; idx++)
+    {
+      if (rp.jobs[idx].record)
+        free (rp.jobs[idx].record);
+      if (rp.jobs[idx].output.data)
+        free (rp.jobs[idx].output.data);
+    }
+
+    free (rp.jobs);
+  }
+
+  return (error || rp.dataerror) ? -1 : packedrecords;
+} /* End of ms_repack() */
+
+/***************************************************************************
+ * ms_repack_handler:
+ *
+ * Record handler for packing, appends records to a RepackBuffer.
+ ***************************************************************************/
+static void
+ms_repack_handler (char *record, int reclen, void *ptr)
+{
+  RepackBuffer *buffer = (RepackBuffer *)ptr;
+  size_t newsize;
+  char *newdata;
+
+  if (buffer->error)
+    return;
+
+  if (buffer->length + reclen > buffer->size)
+  {
+    newsize = (buffer->size) ? buffer->size * 2 : (size_t)reclen * 4;
+    while (newsize < buffer->length + reclen)
+      newsize *= 2;
+
+    if (!(newdata = (char *)realloc (buffer->data, newsize)))
+    {
+      ms_log (2, "ms_repack_handler(): Cannot allocate memory\n");
+      buffer->error = 1;
+      return;
+    }
+
+    buffer->data = newdata;
+    buffer->size = newsize;
+  }
+
+  memcpy (buffer->data + buffer->length, record, reclen);
+  buffer->length += reclen;
+  buffer->reclen = reclen;
+  buffer->records++;
+} /* End of ms_repack_handler() */
+
+/***************************************************************************
+ * ms_repack_record:
+ *
+ * Unpack the record of a job and pack it, individually or by adding
+ * it to the traces of the worker, into the output buffer of the job.
+ *
+ * A record that cannot be unpacked ends its stream, it and all later
+ * records of the stream are skipped.
+ *
+ * Returns 0 on success, 1 if the record was skipped and -1 on error.
+ ***************************************************************************/
+static int
+ms_repack_record (RepackWorker *worker, RepackJob *job)
+{
+  MSRepackParams *params = worker->repack->params;
+  MSRecord *msr;
+  MSTrace *mst;
+  RepackTrace *rt;
+  size_t datasize;
+  char sampletype;
+  char (*failed)[50];
+  int idx;
+  flag verbose = (params->verbose > 1) ? params->verbose - 1 : 0;
+
+  job->output.length  = 0;
+  job->output.records = 0;
+  job->output.error   = 0;
+  job->renumber       = 0;
+
+  for (idx = 0; idx < worker->failedcount; idx++)
+    if (!strcmp (worker->failed[idx], job->srcname))
+      return 1;
+
+  if (msr_unpack (job->record, job->reclen, &worker->msr, 1, verbose) != MS_NOERROR)
+  {
+    ms_log (2, "ms_repack(): Cannot unpack record %" PRId64 ", skipping the rest of %s\n",
+            job->seq, job->srcname);
+
+    if (!(failed = realloc (worker->failed, (worker->failedcount + 1) * sizeof (*failed))))
+    {
+      ms_log (2, "ms_repack(): Cannot allocate memory\n");
+      return -1;
+    }
+
+    worker->failed = failed;
+    memcpy (worker->failed[worker->failedcount++], job->srcname, sizeof (*failed));
+
+    return 1;
+  }
+
+  msr = worker->msr;
+
+  /* Convert sample type as needed for the pack encoding */
+  if (job->convertencoding >= 0 && job->convertencoding != msr->encoding)
+  {
+    switch (job->convertencoding)
+    {
+    case DE_ASCII:
+      sampletype = 'a';
+      break;
+    case DE_INT16:
+    case DE_INT32:
+    case DE_STEIM1:
+    case DE_STEIM2:
+      sampletype = 'i';
+      break;
+    case DE_FLOAT32:
+      sampletype = 'f';
+      break;
+    case DE_FLOAT64:
+      sampletype = 'd';
+      break;
+    default:
+      sampletype = msr->sampletype;
+      break;
+    }
+
+    datasize = (size_t)msr->numsamples * ms_samplesize (msr->sampletype);
+
+    if (msr->numsamples > 0 &&
+        ms_convertsamples (&msr->datasamples, &datasize, msr->numsamples,
+                           &msr->sampletype, sampletype, 0))
+    {
+      ms_log (2, "Error converting samples for encoding %d\n", job->convertencoding);
+      return -1;
+    }
+  }
+
+  msr->reclen    = job->packreclen;
+  msr->encoding  = job->packencoding;
+  msr->byteorder = job->byteorder;
+
+  if (job->timecorrect)
+    msr->fsdh->act_flags |= 0x02;
+
+  /* Replace network code */
+  if (params->network[0])
+    strncpy (msr->network, params->network, sizeof (msr->network));
+
+  /* If no samples in the record just pack the header */
+  if (msr->numsamples == 0)
+  {
+    msr_pack_header (msr, 1, verbose);
+    ms_repack_handler (msr->record, msr->reclen, &job->output);
+  }
+
+  /* Pack each record individually, sequence numbers are assigned when written */
+  else if (params->tracepack == 0)
+  {
+    msr->sequence_number = 1;
+    job->renumber        = 1;
+
+    if (msr_pack (msr, &ms_repack_handler, &job->output, NULL, 1, verbose) < 0)
+      ms_log (2, "Cannot pack records\n");
+  }
+
+  /* Pack records from the traces of this worker */
+  else
+  {
+    if (!(mst = mst_addmsrtogroup (worker->mstg, msr, 0, -1.0, -1.0)))
+    {
+      ms_log (2, "Error adding MSRecord to MStrace!\n");
+      return -1;
+    }
+
+    /* Retain sequence number from previous template */
+    if ((rt = (RepackTrace *)mst->prvtptr))
+    {
+      msr->sequence_number = rt->template->sequence_number;
+      msr_free (&rt->template);
+    }
+    else
+    {
+      if (!(rt = (RepackTrace *)calloc (1, sizeof (RepackTrace))))
+      {
+        ms_log (2, "ms_repack(): Cannot allocate memory\n");
+        return -1;
+      }
+
+      rt->order            = job->seq;
+      mst->prvtptr         = rt;
+      msr->sequence_number = 1;
+    }
+
+    /* Copy MSRecord and store as template */
+    if (!(rt->template = msr_duplicate (msr, 0)))
+    {
+      ms_log (2, "Error duplicating MSRecord for template!\n");
+      return -1;
+    }
+
+    if (params->tracepack == 1)
+      mst_pack_reserve (mst, &ms_repack_handler, &job->output, job->packreclen,
+                        job->packencoding, job->byteorder, NULL, 0, verbose, rt->template);
+  }
+
+  return (job->output.error) ? -1 : 0;
+} /* End of ms_repack_record() */
+
+/***************************************************************************
+ * ms_repack_flush:
+ *
+ * Pack all remaining samples of the traces of a worker, the records
+ * of each trace are collected separately for writing in the order
+ * traces were created.  Trace templates are released.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+ms_repack_flush (RepackWorker *worker)
+{
+  Repack *rp = worker->repack;
+  MSTrace *mst;
+  RepackTrace *rt;
+  RepackFlush *flush;
+  int retcode = 0;
+  flag verbose = (rp->params->verbose > 1) ? rp->params->verbose - 1 : 0;
+
+  if (worker->mstg->numtraces <= 0)
+    return 0;
+
+  if (!(worker->flush = (RepackFlush *)calloc (worker->mstg->numtraces, sizeof (RepackFlush))))
+  {
+    ms_log (2, "ms_repack(): Cannot allocate memory\n");
+    retcode = -1;
+  }
+
+  for (mst = worker->mstg->traces; mst; mst = mst->next)
+  {
+    if (!(rt = (RepackTrace *)mst->prvtptr))
+      continue;
+
+    if (worker->flush)
+    {
+      flush        = &worker->flush[worker->flushcount++];
+      flush->order = rt->order;
+
+      mst_pack (mst, &ms_repack_handler, &flush->output, rp->packreclen,
+                rp->packencoding, rp->byteorder, NULL, 1, verbose, rt->template);
+
+      if (flush->output.error)
+        retcode = -1;
+    }
+
+    msr_free (&rt->template);
+    free (rt);
+    mst->prvtptr = NULL;
+  }
+
+  return retcode;
+} /* End of ms_repack_flush() */
+
+/***************************************************************************
+ * ms_repack_writejob:
+ *
+ * Wait for a job to be processed and pass the packed records to the
+ * record handler, assigning sequence numbers if needed.
+ *
+ * Returns the number of records written on success and -1 on error.
+ ***************************************************************************/
+static int
+ms_repack_writejob (Repack *rp, RepackJob *job, int *seqnum,
+                    void (*record_handler) (char *, int, void *),
+                    void *handlerdata)
+{
+  char seqstr[7];
+  char *record;
+  int idx;
+
+#if !defined(LMP_WIN)
+  if (rp->threaded)
+  {
+    pthread_mutex_lock (&rp->lock);
+    while (!job->done)
+      pthread_cond_wait (&rp->donecond, &rp->lock);
+    pthread_mutex_unlock (&rp->lock);
+  }
+#endif
+
+  job->done = 0;
+
+  if (job->retcode < 0)
+    return -1;
+
+  /* Skipped record of a stream that could not be unpacked */
+  if (job->retcode > 0)
+  {
+    rp->dataerror = 1;
+    return 0;
+  }
+
+  for (idx = 0; idx < job->output.records; idx++)
+  {
+    record = job->output.data + idx * job->output.reclen;
+
+    if (job->renumber)
+    {
+      snprintf (seqstr, sizeof (seqstr), "%06d", *seqnum);
+      memcpy (record, seqstr, 6);
+      *seqnum = (*seqnum >= 999999) ? 1 : *seqnum + 1;
+    }
+
+    record_handler (record, job->output.reclen, handlerdata);
+  }
+
+  if (rp->params->verbose && job->output.records > 0)
+    ms_log (1, "Packed %d records\n", job->output.records);
+
+  return job->output.records;
+} /* End of ms_repack_writejob() */
+
+/***************************************************************************
+ * ms_repack_flushcmp:
+ *
+ * Compare RepackFlush entries by order for qsort().
+ ***************************************************************************/
+static int
+ms_repack_flushcmp (const void *a, const void *b)
+{
+  int64_t oa = ((const RepackFlush *)a)->order;
+  int64_t ob = ((const RepackFlush *)b)->order;
+
+  return (oa > ob) - (oa < ob);
+} /* End of ms_repack_flushcmp() */
+
+#if !defined(LMP_WIN)
+/***************************************************************************
+ * ms_repack_thread:
+ *
+ * Thread to process the queued jobs of a worker in order until the
+ * worker is finished, then flush the traces of the worker.
+ ***************************************************************************/
+static void *
+ms_repack_thread (void *arg)
+{
+  RepackWorker *worker = (RepackWorker *)arg;
+  Repack *rp           = worker->repack;
+  RepackJob *job;
+  int retcode;
+
+  pthread_mutex_lock (&rp->lock);
+
+  for (;;)
+  {
+    while (!worker->head && !worker->finish)
+      pthread_cond_wait (&worker->cond, &rp->lock);
+
+    if (!worker->head)
+      break;
+
+    job          = worker->head;
+    worker->head = job->next;
+    if (!worker->head)
+      worker->tail = NULL;
+
+    pthread_mutex_unlock (&rp->lock);
+
+    retcode = ms_repack_record (worker, job);
+
+    pthread_mutex_lock (&rp->lock);
+    job->retcode = retcode;
+    job->done    = 1;
+    pthread_cond_signal (&rp->donecond);
+  }
+
+  pthread_mutex_unlock (&rp->lock);
+
+  worker->retcode = ms_repack_flush (worker);
+
+  return NULL;
+} /* End of ms_repack_thread() */
+#endif
@@ -19,17 +19,73 @@
 #include "libmseed.h"
 #include "lmplatform.h"
 
+#if !defined(LMP_WIN)
+  #include <pthread.h>
+#endif
+
 static hptime_t ms_time2hptime_int (int year, int day, int hour,
                                     int min, int sec, int usec);
 
 static struct tm *ms_gmtime_r (int64_t *timep, struct tm *result);
 
+static int ms_hptimecmp (const void *a, const void *b);
+
+static int ms_leapsecondcurrent (void);
+
+static int ms_leapsecondbuild (void);
+
+static int ms_convertblock (const void *source, char sourcetype, void *dest,
+                            char desttype, int count, flag truncate);
+
+/* Number of samples converted per block by ms_convertsamples() */
+#define MS_CONVERTBLOCK 512
+
 /* A constant number of seconds between the NTP and Posix/Unix time epoch */
 #define NTPPOSIXEPOCHDELTA 2208988800LL
 
 /* Global variable to hold a leap second list */
 LeapSecond *leapsecondlist = NULL;
 
+/* Sorted leap second times built from leapsecondlist for searching,
+ * the nodes and times of the list when built detect later changes */
+static hptime_t *leapsecondarray = NULL;
+static int leapsecondcount       = 0;
+static struct leapsecondnode_s
+{
+  LeapSecond *node;
+  hptime_t leapsecond;
+} *leapsecondnodes = NULL;
+
+#if !defined(LMP_WIN)
+static pthread_mutex_t leapsecondlock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* Days in each month and cumulative days before each month, for
+ * common (index 0) and leap (index 1) years */
+static const int ms_monthdays[2][12] = {
+    {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31},
+    {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31},
+};
+static const int ms_yeardays[2][13] = {
+    {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365},
+    {0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335, 366},
+};
+
+/* Two digit strings for the values 0-99 */
+static const char ms_digitpairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+#define MS_ISLEAPYEAR(year) ((((year) % 4 == 0) && ((year) % 100 != 0)) || ((year) % 400 == 0))
+
 /***************************************************************************
  * ms_recsrcname:
  *
@@ -333,7 +389,6 @@ ms_doy2md (int year, int jday, int *month, int *mday)
 {
   int idx;
   int leap;
-  int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
 
   /* Sanity check for the supplied year */
   if (year < 1800 || year > 5000)
@@ -343,11 +398,7 @@ ms_doy2md (int year, int jday, int *month, int *mday)
   }
 
   /* Test for leap year */
-  leap = (((year % 4 == 0) && (year % 100 != 0)) || (year % 400 == 0)) ? 1 : 0;
-
-  /* Add a day to February if leap year */
-  if (leap)
-    days[1]++;
+  leap = MS_ISLEAPYEAR (year) ? 1 : 0;
 
   if (jday > 365 + leap || jday <= 0)
   {
@@ -355,17 +406,14 @@ ms_doy2md (int year, int jday, int *month, int *mday)
     return -1;
   }
 
-  for (idx = 0; idx < 12; idx++)
-  {
-    jday -= days[idx];
+  /* No month is longer than 32 days, so the month is at most one after
+   * this estimate */
+  idx = (jday - 1) / 32;
+  if (jday > ms_yeardays[leap][idx + 1])
+    idx++;
 
-    if (jday <= 0)
-    {
-      *month = idx + 1;
-      *mday  = days[idx] + jday;
-      break;
-    }
-  }
+  *month = idx + 1;
+  *mday  = jday - ms_yeardays[leap][idx];
 
   return 0;
 } /* End of ms_doy2md() */
@@ -384,9 +432,7 @@ ms_doy2md (int year, int jday, int *month, int *mday)
 int
 ms_md2doy (int year, int month, int mday, int *jday)
 {
-  int idx;
   int leap;
-  int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
 
   /* Sanity check for the supplied parameters */
   if (year < 1800 || year > 5000)
@@ -406,33 +452,17 @@ ms_md2doy (int year, int month, int mday, int *jday)
   }
 
   /* Test for leap year */
-  leap = (((year % 4 == 0) && (year % 100 != 0)) || (year % 400 == 0)) ? 1 : 0;
-
-  /* Add a day to February if leap year */
-  if (leap)
-    days[1]++;
+  leap = MS_ISLEAPYEAR (year) ? 1 : 0;
 
   /* Check that the day-of-month jives with specified month */
-  if (mday > days[month - 1])
+  if (mday > ms_monthdays[leap][month - 1])
   {
     ms_log (2, "ms_md2doy(): day-of-month (%d) is out of range for month %d\n",
             mday, month);
     return -1;
   }
 
-  *jday = 0;
-  month--;
-
-  for (idx = 0; idx < 12; idx++)
-  {
-    if (idx == month)
-    {
-      *jday += mday;
-      break;
-    }
-
-    *jday += days[idx];
-  }
+  *jday = ms_yeardays[leap][month - 1] + mday;
 
   return 0;
 } /* End of ms_md2doy() */
@@ -830,6 +860,107 @@ ms_hptime2seedtimestr (hptime_t hptime, char *seedtimestr, flag subseconds)
     return seedtimestr;
 } /* End of ms_hptime2seedtimestr() */
 
+/***************************************************************************
+ * ms_hptime2seedtimestr_cached:
+ *
+ * Build a SEED time string from a high precision epoch time in the
+ * same format as ms_hptime2seedtimestr().  The date and time fields
+ * are kept in the supplied cache and only recomputed when the day or
+ * second changes, remaining digits are written from a table.  This
+ * is intended for formatting many times in order, e.g. SYNC output.
+ *
+ * The cache must be initialized to all zeros before the first call
+ * and must not be shared between threads.
+ *
+ * The provided seedtimestr must have enough room for the resulting time
+ * string of 25 characters, i.e. '2001,195,12:38:00.000000' + NULL.
+ *
+ * Returns a pointer to the resulting string or NULL on error.
+ ***************************************************************************/
+char *
+ms_hptime2seedtimestr_cached (hptime_t hptime, char *seedtimestr, flag subseconds,
+                              MSTimeStrCache *cache)
+{
+  struct tm tms;
+  int64_t isec;
+  int64_t day;
+  int ifract;
+  int sod;
+  char *cp;
+
+  if (seedtimestr == NULL)
+    return NULL;
+
+  if (cache == NULL)
+    return ms_hptime2seedtimestr (hptime, seedtimestr, subseconds);
+
+  /* Reduce to Unix/POSIX epoch time and fractional seconds */
+  isec   = MS_HPTIME2EPOCH (hptime);
+  ifract = (int)(hptime - (isec * HPTMODULUS));
+
+  /* Adjust for negative epoch times */
+  if (hptime < 0 && ifract != 0)
+  {
+    isec -= 1;
+    ifract = HPTMODULUS - (-ifract);
+  }
+
+  if (!cache->valid || isec != cache->second)
+  {
+    day = ((isec >= 0) ? isec : isec - 86399) / 86400;
+
+    /* Format the date for a new day */
+    if (!cache->valid || day != cache->day)
+    {
+      cache->valid = 0;
+
+      if (!(ms_gmtime_r (&isec, &tms)))
+        return NULL;
+
+      /* Leave years without 4 digits to the general routine */
+      if (tms.tm_year + 1900 < 1000 || tms.tm_year + 1900 > 9999)
+        return ms_hptime2seedtimestr (hptime, seedtimestr, subseconds);
+
+      snprintf (cache->timestr, sizeof (cache->timestr), "%4d,%03d,",
+                tms.tm_year + 1900, tms.tm_yday + 1);
+
+      cache->day   = day;
+      cache->valid = 1;
+    }
+
+    sod = (int)(isec - day * 86400);
+
+    cp = cache->timestr + 9;
+    memcpy (cp, ms_digitpairs + 2 * (sod / 3600), 2);
+    cp[2] = ':';
+    memcpy (cp + 3, ms_digitpairs + 2 * ((sod / 60) % 60), 2);
+    cp[5] = ':';
+    memcpy (cp + 6, ms_digitpairs + 2 * (sod % 60), 2);
+    cp[8] = '\0';
+
+    cache->second = isec;
+  }
+
+  memcpy (seedtimestr, cache->timestr, 17);
+
+  if (subseconds)
+  {
+    /* Assuming ifract has at least microsecond precision */
+    cp    = seedtimestr + 17;
+    cp[0] = '.';
+    memcpy (cp + 1, ms_digitpairs + 2 * (ifract / 10000), 2);
+    memcpy (cp + 3, ms_digitpairs + 2 * ((ifract / 100) % 100), 2);
+    memcpy (cp + 5, ms_digitpairs + 2 * (ifract % 100), 2);
+    cp[7] = '\0';
+  }
+  else
+  {
+    seedtimestr[17] = '\0';
+  }
+
+  return seedtimestr;
+} /* End of ms_hptime2seedtimestr_cached() */
+
 /***************************************************************************
  * ms_time2hptime_int:
  *
@@ -842,27 +973,15 @@ ms_hptime2seedtimestr (hptime_t hptime, char *seedtimestr, flag subseconds)
 static hptime_t
 ms_time2hptime_int (int year, int day, int hour, int min, int sec, int usec)
 {
-  BTime btime;
   hptime_t hptime;
+  int64_t days;
+  int y;
 
-  memset (&btime, 0, sizeof (BTime));
-  btime.day = 1;
-
-  /* Convert integer seconds using ms_btime2hptime */
-  btime.year  = (int16_t)year;
-  btime.day   = (int16_t)day;
-  btime.hour  = (uint8_t)hour;
-  btime.min   = (uint8_t)min;
-  btime.sec   = (uint8_t)sec;
-  btime.fract = 0;
+  /* Days since the epoch from the leap days before the year */
+  y    = year - 1;
+  days = (int64_t)365 * (year - 1970) + (y / 4 - y / 100 + y / 400) - 477 + (day - 1);
 
-  hptime = ms_btime2hptime (&btime);
-
-  if (hptime == HPTERROR)
-  {
-    ms_log (2, "ms_time2hptime(): Error converting with ms_btime2hptime()\n");
-    return HPTERROR;
-  }
+  hptime = (hptime_t) (60 * (60 * ((hptime_t)24 * days + hour) + min) + sec) * HPTMODULUS;
 
   /* Add the microseconds */
   hptime += (hptime_t)usec * (1000000 / HPTMODULUS);
@@ -1182,6 +1301,7 @@ ms_readleapsecondfile (char *filename)
   int64_t leapsecond;
   int TAIdelta;
   int fields;
+  int retval;
   int count = 0;
 
   if (!filename)
@@ -1248,6 +1368,7 @@ ms_readleapsecondfile (char *filename)
       ls->leapsecond = MS_EPOCH2HPTIME ((leapsecond - NTPPOSIXEPOCHDELTA));
       ls->TAIdelta   = TAIdelta;
       ls->next       = NULL;
+      count++;
 
       /* Add leap second to global list */
       if (!leapsecondlist)
@@ -1274,9 +1395,187 @@ ms_readleapsecondfile (char *filename)
 
   fclose (fp);
 
+  /* Build the sorted array of leap second times for searching */
+#if !defined(LMP_WIN)
+  pthread_mutex_lock (&leapsecondlock);
+#endif
+  retval = ms_leapsecondbuild ();
+#if !defined(LMP_WIN)
+  pthread_mutex_unlock (&leapsecondlock);
+#endif
+
+  if (retval)
+    return -1;
+
   return count;
 } /* End of ms_readleapsecondfile() */
 
+/***************************************************************************
+ * ms_leapsecondbuild:
+ *
+ * Build the sorted array of leap second times from the global
+ * leapsecondlist and record the nodes of the list with their times.
+ * The caller must hold leapsecondlock.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+ms_leapsecondbuild (void)
+{
+  LeapSecond *ls;
+  int count = 0;
+
+  if (leapsecondarray)
+    free (leapsecondarray);
+  if (leapsecondnodes)
+    free (leapsecondnodes);
+  leapsecondarray = NULL;
+  leapsecondnodes = NULL;
+  leapsecondcount = 0;
+
+  for (ls = leapsecondlist; ls; ls = ls->next)
+    count++;
+
+  if (count == 0)
+    return 0;
+
+  leapsecondarray = malloc (count * sizeof (hptime_t));
+  leapsecondnodes = malloc (count * sizeof (struct leapsecondnode_s));
+
+  if (!leapsecondarray || !leapsecondnodes)
+  {
+    ms_log (2, "Cannot allocate leap second array, out of memory?\n");
+    if (leapsecondarray)
+      free (leapsecondarray);
+    if (leapsecondnodes)
+      free (leapsecondnodes);
+    leapsecondarray = NULL;
+    leapsecondnodes = NULL;
+    return -1;
+  }
+
+  for (ls = leapsecondlist; ls; ls = ls->next)
+  {
+    leapsecondnodes[leapsecondcount].node       = ls;
+    leapsecondnodes[leapsecondcount].leapsecond = ls->leapsecond;
+    leapsecondarray[leapsecondcount]            = ls->leapsecond;
+    leapsecondcount++;
+  }
+
+  qsort (leapsecondarray, leapsecondcount, sizeof (hptime_t), ms_hptimecmp);
+
+  return 0;
+} /* End of ms_leapsecondbuild() */
+
+/***************************************************************************
+ * ms_leapsecondcurrent:
+ *
+ * Determine if the sorted leap second array matches the global
+ * leapsecondlist, i.e. the list has the same nodes in the same order
+ * with the same times as when the array was built.  The caller must
+ * hold leapsecondlock.
+ *
+ * Returns 1 if the array is current and 0 if not.
+ ***************************************************************************/
+static int
+ms_leapsecondcurrent (void)
+{
+  LeapSecond *ls;
+  int idx = 0;
+
+  if (!leapsecondnodes)
+    return 0;
+
+  for (ls = leapsecondlist; ls; ls = ls->next, idx++)
+  {
+    if (idx >= leapsecondcount ||
+        leapsecondnodes[idx].node != ls ||
+        leapsecondnodes[idx].leapsecond != ls->leapsecond)
+      return 0;
+  }
+
+  return (idx == leapsecondcount) ? 1 : 0;
+} /* End of ms_leapsecondcurrent() */
+
+/***************************************************************************
+ * ms_leapsecondinrange:
+ *
+ * Determine if a leap second in the global leapsecondlist occurs
+ * after starttime and before endtime.  The times are located with a
+ * binary search of a sorted array, rebuilt whenever the list is read
+ * with ms_readleapsecondfile() or nodes of the list are added,
+ * removed or changed by the caller.  If the array cannot be built the
+ * list is searched directly.
+ *
+ * Returns 1 if a leap second occurs in the range, 0 if not and -1 if
+ * no leap second list is available.
+ ***************************************************************************/
+int
+ms_leapsecondinrange (hptime_t starttime, hptime_t endtime)
+{
+  LeapSecond *lslist;
+  int retval = 0;
+  int low;
+  int high;
+  int mid;
+
+  if (!leapsecondlist)
+    return -1;
+
+#if !defined(LMP_WIN)
+  pthread_mutex_lock (&leapsecondlock);
+#endif
+
+  if (ms_leapsecondcurrent () || !ms_leapsecondbuild ())
+  {
+    /* Find the first leap second after the start time */
+    low  = 0;
+    high = leapsecondcount;
+    while (low < high)
+    {
+      mid = low + (high - low) / 2;
+
+      if (leapsecondarray[mid] > starttime)
+        high = mid;
+      else
+        low = mid + 1;
+    }
+
+    retval = (low < leapsecondcount && leapsecondarray[low] < endtime) ? 1 : 0;
+  }
+  else
+  {
+    for (lslist = leapsecondlist; lslist; lslist = lslist->next)
+    {
+      if (lslist->leapsecond > starttime && lslist->leapsecond < endtime)
+      {
+        retval = 1;
+        break;
+      }
+    }
+  }
+
+#if !defined(LMP_WIN)
+  pthread_mutex_unlock (&leapsecondlock);
+#endif
+
+  return retval;
+} /* End of ms_leapsecondinrange() */
+
+/***************************************************************************
+ * ms_hptimecmp:
+ *
+ * Compare two high precision times for qsort().
+ ***************************************************************************/
+static int
+ms_hptimecmp (const void *a, const void *b)
+{
+  hptime_t ta = *(const hptime_t *)a;
+  hptime_t tb = *(const hptime_t *)b;
+
+  return (ta > tb) - (ta < tb);
+} /* End of ms_hptimecmp() */
+
 /***************************************************************************
  * ms_reduce_rate:
  *
@@ -1582,6 +1881,227 @@ ms_rsqrt64 (double val)
   return y;
 } /* End of ms_rsqrt64() */
 
+/***************************************************************************
+ * ms_convertsamples:
+ *
+ * Convert a buffer of numsamples data samples of sampletype to
+ * another sample type, updating the buffer, its allocated size at
+ * datasize and the sample type.  Integer ('i'), float ('f') and
+ * double ('d') sample types may be converted, ASCII samples cannot.
+ *
+ * Conversion is done in place, converting to doubles only grows the
+ * buffer if its allocated size is too small.  Converting to a smaller
+ * sample type reduces the buffer to the size needed.  If datasize is
+ * NULL the buffer is never reallocated and must be large enough for
+ * the samples of the new type.  Samples are
+ * converted in blocks into a separate array so that the conversion
+ * and precision check loops have no aliasing and may be vectorized
+ * by the compiler.
+ *
+ * When converting float & double sample types to integer type a
+ * simple rounding is applied by adding 0.5 to the sample value before
+ * converting (truncating) to integer.
+ *
+ * If the truncate flag is true data samples will be truncated to
+ * integers even if loss of sample precision is detected.  If the
+ * truncate flag is false (0) and loss of precision is detected an
+ * error is returned.
+ *
+ * Returns 0 on success, and -1 on failure.
+ ***************************************************************************/
+int
+ms_convertsamples (void **datasamples, size_t *datasize, int64_t numsamples,
+                   char *sampletype, char type, flag truncate)
+{
+  void *newdatasamples;
+  uint8_t samplesize;
+  uint8_t newsamplesize;
+  int64_t block;
+  int count;
+
+  if (!datasamples || !sampletype)
+    return -1;
+
+  /* No conversion necessary, report success */
+  if (*sampletype == type)
+    return 0;
+
+  if (*sampletype == 'a' || type == 'a')
+  {
+    ms_log (2, "ms_convertsamples: cannot convert ASCII samples to/from numeric type\n");
+    return -1;
+  }
+
+  if ((*sampletype != 'i' && *sampletype != 'f' && *sampletype != 'd') ||
+      (type != 'i' && type != 'f' && type != 'd'))
+  {
+    ms_log (2, "ms_convertsamples: unrecognized sample type conversion, %c to %c\n",
+            *sampletype, type);
+    return -1;
+  }
+
+  if (!*datasamples || numsamples <= 0)
+  {
+    *sampletype = type;
+    return 0;
+  }
+
+  samplesize    = ms_samplesize (*sampletype);
+  newsamplesize = ms_samplesize (type);
+
+  /* Convert to a larger sample type, growing the buffer if needed and
+   * converting from the last block to the first so that samples are
+   * read before they are overwritten. */
+  if (newsamplesize > samplesize)
+  {
+    if (datasize && *datasize < (size_t) (numsamples * newsamplesize))
+    {
+      if (!(newdatasamples = realloc (*datasamples, (size_t) (numsamples * newsamplesize))))
+      {
+        ms_log (2, "ms_convertsamples: cannot allocate buffer for sample conversion\n");
+        return -1;
+      }
+
+      *datasamples = newdatasamples;
+      *datasize    = (size_t) (numsamples * newsamplesize);
+    }
+
+    for (block = ((numsamples - 1) / MS_CONVERTBLOCK) * MS_CONVERTBLOCK; block >= 0; block -= MS_CONVERTBLOCK)
+    {
+      count = (numsamples - block < MS_CONVERTBLOCK) ? (int)(numsamples - block) : MS_CONVERTBLOCK;
+
+      ms_convertblock ((char *)*datasamples + block * samplesize, *sampletype,
+                       (char *)*datasamples + block * newsamplesize, type,
+                       count, 1);
+    }
+  }
+  /* Convert to a same size or smaller sample type from the first block */
+  else
+  {
+    for (block = 0; block < numsamples; block += MS_CONVERTBLOCK)
+    {
+      count = (numsamples - block < MS_CONVERTBLOCK) ? (int)(numsamples - block) : MS_CONVERTBLOCK;
+
+      if (ms_convertblock ((char *)*datasamples + block * samplesize, *sampletype,
+                           (char *)*datasamples + block * newsamplesize, type,
+                           count, truncate))
+        return -1;
+    }
+
+    /* Reallocate buffer for reduced size needed */
+    if (datasize && newsamplesize < samplesize)
+    {
+      if (!(newdatasamples = realloc (*datasamples, (size_t) (numsamples * newsamplesize))))
+      {
+        ms_log (2, "ms_convertsamples: cannot re-allocate buffer after sample conversion\n");
+        return -1;
+      }
+
+      *datasamples = newdatasamples;
+      *datasize    = (size_t) (numsamples * newsamplesize);
+    }
+  }
+
+  *sampletype = type;
+
+  return 0;
+} /* End of ms_convertsamples() */
+
+/***************************************************************************
+ * ms_convertblock:
+ *
+ * Convert a block of up to MS_CONVERTBLOCK samples from source to
+ * dest, which may overlap.  Samples are converted into a local array
+ * that is copied to dest after all samples are read.
+ *
+ * If the truncate flag is false (0) and loss of precision is detected
+ * when converting to integers an error is returned and dest is not
+ * changed.
+ *
+ * Returns 0 on success, and -1 on failure.
+ ***************************************************************************/
+static int
+ms_convertblock (const void *source, char sourcetype, void *dest,
+                 char desttype, int count, flag truncate)
+{
+  const int32_t *idata = (const int32_t *)source;
+  const float *fdata   = (const float *)source;
+  const double *ddata  = (const double *)source;
+  int32_t ibuf[MS_CONVERTBLOCK];
+  float fbuf[MS_CONVERTBLOCK];
+  double dbuf[MS_CONVERTBLOCK];
+  int lossy = 0;
+  int idx;
+
+  if (desttype == 'i')
+  {
+    /* Check for loss of sub-integer */
+    if (!truncate)
+    {
+      if (sourcetype == 'f')
+        for (idx = 0; idx < count; idx++)
+          lossy |= ((fdata[idx] - (int32_t)fdata[idx]) > 0.000001);
+      else
+        for (idx = 0; idx < count; idx++)
+          lossy |= ((ddata[idx] - (int32_t)ddata[idx]) > 0.000001);
+
+      if (lossy)
+      {
+        for (idx = 0; idx < count; idx++)
+        {
+          if (sourcetype == 'f' && (fdata[idx] - (int32_t)fdata[idx]) > 0.000001)
+          {
+            ms_log (1, "ms_convertsamples: Warning, loss of precision when converting floats to integers, loss: %g\n",
+                    (fdata[idx] - (int32_t)fdata[idx]));
+            break;
+          }
+          else if (sourcetype == 'd' && (ddata[idx] - (int32_t)ddata[idx]) > 0.000001)
+          {
+            ms_log (1, "ms_convertsamples: Warning, loss of precision when converting doubles to integers, loss: %g\n",
+                    (ddata[idx] - (int32_t)ddata[idx]));
+            break;
+          }
+        }
+
+        return -1;
+      }
+    }
+
+    if (sourcetype == 'f')
+      for (idx = 0; idx < count; idx++)
+        ibuf[idx] = (int32_t) (fdata[idx] + 0.5);
+    else
+      for (idx = 0; idx < count; idx++)
+        ibuf[idx] = (int32_t) (ddata[idx] + 0.5);
+
+    memcpy (dest, ibuf, count * sizeof (int32_t));
+  }
+  else if (desttype == 'f')
+  {
+    if (sourcetype == 'i')
+      for (idx = 0; idx < count; idx++)
+        fbuf[idx] = (float)idata[idx];
+    else
+      for (idx = 0; idx < count; idx++)
+        fbuf[idx] = (float)ddata[idx];
+
+    memcpy (dest, fbuf, count * sizeof (float));
+  }
+  else
+  {
+    if (sourcetype == 'i')
+      for (idx = 0; idx < count; idx++)
+        dbuf[idx] = (double)idata[idx];
+    else
+      for (idx = 0; idx < count; idx++)
+        dbuf[idx] = (double)fdata[idx];
+
+    memcpy (dest, dbuf, count * sizeof (double));
+  }
+
+  return 0;
+} /* End of ms_convertblock() */
+
 /***************************************************************************
  * ms_gmtime_r:
  *
@@ -1637,14 +2157,6 @@ const char pivotal_gmtime_r_stamp_lm[] =
     "pivotal_gmtime_r. Copyright (C) 2009  Paul Sheer. Terms and "
     "conditions apply. Visit http://2038bug.com/ for more info.";
 
-static const int tm_days[4][13] = {
-    {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31},
-    {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31},
-    {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365},
-    {0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335, 366},
-};
-
-#define TM_LEAP_CHECK(n) ((!(((n) + 1900) % 400) || (!(((n) + 1900) % 4) && (((n) + 1900) % 100))) != 0)
 #define TM_WRAP(a, b, m) ((a) = ((a) < 0) ? ((b)--, (a) + (m)) : (a))
 
 static struct tm *
@@ -1652,7 +2164,7 @@ ms_gmtime_r (int64_t *timep, struct tm *result)
 {
   int v_tm_sec, v_tm_min, v_tm_hour, v_tm_mon, v_tm_wday, v_tm_tday;
   int leap;
-  long m;
+  int64_t era, doe, yoe, doy, year;
   int64_t tv;
 
   if (!timep || !result)
@@ -1675,53 +2187,28 @@ ms_gmtime_r (int64_t *timep, struct tm *result)
   if ((v_tm_wday = (v_tm_tday + 4) % 7) < 0)
     v_tm_wday += 7;
 
-  m = (long)v_tm_tday;
-
-  if (m >= 0)
-  {
-    result->tm_year = 70;
-    leap            = TM_LEAP_CHECK (result->tm_year);
+  /* Split the days into 400 year eras of years starting in March, placing
+   * the leap day at the end of each year, the year and day-of-year then
+   * follow directly instead of stepping through the years. */
+  tv   = (int64_t)v_tm_tday + 719468;
+  era  = ((tv >= 0) ? tv : tv - 146096) / 146097;
+  doe  = tv - era * 146097;
+  yoe  = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  doy  = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  year = yoe + era * 400 + (doy >= 306);
 
-    while (m >= (long)tm_days[leap + 2][12])
-    {
-      m -= (long)tm_days[leap + 2][12];
-      result->tm_year++;
-      leap = TM_LEAP_CHECK (result->tm_year);
-    }
+  leap = MS_ISLEAPYEAR (year) ? 1 : 0;
 
-    v_tm_mon = 0;
-
-    while (m >= (long)tm_days[leap][v_tm_mon])
-    {
-      m -= (long)tm_days[leap][v_tm_mon];
-      v_tm_mon++;
-    }
-  }
-  else
-  {
-    result->tm_year = 69;
-    leap            = TM_LEAP_CHECK (result->tm_year);
+  /* Day-of-year from January 1st */
+  doy = (doy >= 306) ? doy - 306 : doy + 59 + leap;
 
-    while (m < (long)-tm_days[leap + 2][12])
-    {
-      m += (long)tm_days[leap + 2][12];
-      result->tm_year--;
-      leap = TM_LEAP_CHECK (result->tm_year);
-    }
-
-    v_tm_mon = 11;
-
-    while (m < (long)-tm_days[leap][v_tm_mon])
-    {
-      m += (long)tm_days[leap][v_tm_mon];
-      v_tm_mon--;
-    }
-
-    m += (long)tm_days[leap][v_tm_mon];
-  }
+  v_tm_mon = (int)(doy / 32);
+  if (doy >= ms_yeardays[leap][v_tm_mon + 1])
+    v_tm_mon++;
 
-  result->tm_mday = (int)m + 1;
-  result->tm_yday = tm_days[leap + 2][v_tm_mon] + m;
+  result->tm_year = (int)(year - 1900);
+  result->tm_mday = (int)(doy - ms_yeardays[leap][v_tm_mon]) + 1;
+  result->tm_yday = (int)doy;
   result->tm_sec  = v_tm_sec;
   result->tm_min  = v_tm_min;
   result->tm_hour = v_tm_hour;
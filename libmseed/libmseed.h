@@ -32,8 +32,8 @@ extern "C" {
 
 #include "lmplatform.h"
 
-#define LIBMSEED_VERSION "2.18"
-#define LIBMSEED_RELEASE "2016.286"
+#define LIBMSEED_VERSION "2.19"
+#define LIBMSEED_RELEASE "2026.291"
 
 #define MINRECLEN   128      /* Minimum Mini-SEED record length, 2^7 bytes */
                              /* Note: the SEED specification minimum is 256 */
@@ -433,6 +433,7 @@ typedef struct MSTrace_s {
   void           *prvtptr;           /* Private pointer for general use, unused by libmseed */
   StreamState    *ststate;           /* Stream processing state information */
   struct MSTrace_s *next;            /* Pointer to next trace */
+  size_t          datasize;          /* Size of datasamples buffer in bytes */
 }
 MSTrace;
 
@@ -440,6 +441,7 @@ MSTrace;
 typedef struct MSTraceGroup_s {
   int32_t           numtraces;       /* Number of MSTraces in the trace chain */
   struct MSTrace_s *traces;          /* Root of the trace chain */
+  struct MSTraceGroupIndex_s *index; /* Optional trace index, see mst_groupindex() */
 }
 MSTraceGroup;
 
@@ -455,6 +457,8 @@ typedef struct MSTraceSeg_s {
   void           *prvtptr;           /* Private pointer for general use, unused by libmseed */
   struct MSTraceSeg_s *prev;         /* Pointer to previous segment */
   struct MSTraceSeg_s *next;         /* Pointer to next segment */
+  size_t          datasize;          /* Size of datasamples buffer in bytes */
+  struct MSTraceSegSpill_s *spill;   /* Sample file storage, see mstl_spill() */
 }
 MSTraceSeg;
 
@@ -477,11 +481,19 @@ typedef struct MSTraceID_s {
 }
 MSTraceID;
 
+/* Settings for storing segment samples in files, see mstl_spill() */
+typedef struct MSTraceListSpill_s {
+  char            directory[512];    /* Directory for sample files */
+  size_t          threshold;         /* Sample buffer size in bytes moved to a file */
+}
+MSTraceListSpill;
+
 /* Container for a continuous trace segment, linkable */
 typedef struct MSTraceList_s {
   int32_t             numtraces;     /* Number of traces in list */
   struct MSTraceID_s *traces;        /* Pointer to list of traces */
   struct MSTraceID_s *last;          /* Pointer to last used trace in list */
+  struct MSTraceListSpill_s *spill;  /* Sample file storage settings, see mstl_spill() */
 }
 MSTraceList;
 
@@ -579,6 +591,8 @@ extern MSTrace*      mst_addmsrtogroup (MSTraceGroup *mstg, MSRecord *msr, flag
 extern MSTrace*      mst_addtracetogroup (MSTraceGroup *mstg, MSTrace *mst);
 extern int           mst_groupheal (MSTraceGroup *mstg, double timetol, double sampratetol);
 extern int           mst_groupsort (MSTraceGroup *mstg, flag quality);
+extern int           mst_groupshrink (MSTraceGroup *mstg);
+extern int           mst_groupindex (MSTraceGroup *mstg, flag index);
 extern int           mst_convertsamples (MSTrace *mst, char type, flag truncate);
 extern char *        mst_srcname (MSTrace *mst, char *srcname, flag quality);
 extern void          mst_printtracelist (MSTraceGroup *mstg, flag timeformat,
@@ -590,6 +604,10 @@ extern int           mst_pack (MSTrace *mst, void (*record_handler) (char *, int
 			       void *handlerdata, int reclen, flag encoding, flag byteorder,
 			       int64_t *packedsamples, flag flush, flag verbose,
 			       MSRecord *mstemplate);
+extern int           mst_pack_reserve (MSTrace *mst, void (*record_handler) (char *, int, void *),
+				       void *handlerdata, int reclen, flag encoding, flag byteorder,
+				       int64_t *packedsamples, flag flush, flag verbose,
+				       MSRecord *mstemplate);
 extern int           mst_packgroup (MSTraceGroup *mstg, void (*record_handler) (char *, int, void *),
 				    void *handlerdata, int reclen, flag encoding, flag byteorder,
 				    int64_t *packedsamples, flag flush, flag verbose,
@@ -601,6 +619,10 @@ extern void          mstl_free ( MSTraceList **ppmstl, flag freeprvtptr );
 extern MSTraceSeg *  mstl_addmsr ( MSTraceList *mstl, MSRecord *msr, flag dataquality,
 				   flag autoheal, double timetol, double sampratetol );
 extern int           mstl_convertsamples ( MSTraceSeg *seg, char type, flag truncate );
+extern int           mstl_shrink ( MSTraceList *mstl );
+extern int           mstl_spill ( MSTraceList *mstl, const char *directory, size_t threshold );
+extern int           mstl_merge ( MSTraceList *mstl, MSTraceList *source, flag dataquality,
+				  flag autoheal, double timetol, double sampratetol );
 extern void          mstl_printtracelist ( MSTraceList *mstl, flag timeformat,
 					   flag details, flag gaps );
 extern void          mstl_printsynclist ( MSTraceList *mstl, char *dccid, flag subsecond );
@@ -622,6 +644,10 @@ typedef struct MSFileParam_s
   int   recordcount;
 } MSFileParam;
 
+/* Global flag to seek to time windows in files of records in time order */
+extern flag timewinseek;
+#define MS_TIMEWINSEEK(X) (timewinseek = X);
+
 extern int      ms_readmsr (MSRecord **ppmsr, const char *msfile, int reclen, off_t *fpos, int *last,
 			    flag skipnotdata, flag dataflag, flag verbose);
 extern int      ms_readmsr_r (MSFileParam **ppmsfp, MSRecord **ppmsr, const char *msfile, int reclen,
@@ -640,6 +666,26 @@ extern int      ms_readtracelist_timewin (MSTraceList **ppmstl, const char *msfi
 					  hptime_t starttime, hptime_t endtime, flag dataquality, flag skipnotdata, flag dataflag, flag verbose);
 extern int      ms_readtracelist_selection (MSTraceList **ppmstl, const char *msfile, int reclen, double timetol, double sampratetol,
 					    Selections *selections, flag dataquality, flag skipnotdata, flag dataflag, flag verbose);
+extern int      ms_readtracelist_files (MSTraceList **ppmstl, const char **msfiles, int filecount, int reclen,
+					double timetol, double sampratetol, Selections *selections, flag dataquality,
+					flag skipnotdata, flag dataflag, int threads, flag verbose);
+
+/* Parameters for ms_repack() */
+typedef struct MSRepackParams_s {
+  int             reclen;            /* Input record length, as for ms_readmsr() */
+  int             packreclen;        /* Output record length, -1 for that of first record */
+  int             packencoding;      /* Output encoding, -1 for that of first record */
+  int             byteorder;         /* Output byte order, -1 for that of first record */
+  char            network[11];       /* Output network code, empty to retain input */
+  flag            tracepack;         /* Packing method, see ms_repack() */
+  flag            printdetail;       /* Detail level of input record printing, -1 for none */
+  int             threads;           /* Encoding threads, <= 0 for online processors */
+  flag            verbose;
+}
+MSRepackParams;
+
+extern int64_t  ms_repack (const char *msfile, MSRepackParams *params,
+			   void (*record_handler) (char *, int, void *), void *handlerdata);
 
 extern int      msr_writemseed ( MSRecord *msr, const char *msfile, flag overwrite, int reclen,
 				 flag encoding, flag byteorder, flag verbose );
@@ -648,6 +694,15 @@ extern int      mst_writemseed ( MSTrace *mst, const char *msfile, flag overwrit
 extern int      mst_writemseedgroup ( MSTraceGroup *mstg, const char *msfile, flag overwrite,
 				      int reclen, flag encoding, flag byteorder, flag verbose );
 
+/* Calendar fields cached between ms_hptime2seedtimestr_cached() calls */
+typedef struct MSTimeStrCache_s {
+  flag            valid;             /* Cache is populated, initialize to 0 */
+  int64_t         day;               /* Epoch day of the cached date */
+  int64_t         second;            /* Epoch second of the cached time */
+  char            timestr[18];       /* Cached "YYYY,DDD,HH:MM:SS" */
+}
+MSTimeStrCache;
+
 /* General use functions */
 extern char*    ms_recsrcname (char *record, char *srcname, flag quality);
 extern int      ms_splitsrcname (char *srcname, char *net, char *sta, char *loc, char *chan, char *qual);
@@ -665,6 +720,8 @@ extern int      ms_hptime2btime (hptime_t hptime, BTime *btime);
 extern char*    ms_hptime2isotimestr (hptime_t hptime, char *isotimestr, flag subsecond);
 extern char*    ms_hptime2mdtimestr (hptime_t hptime, char *mdtimestr, flag subsecond);
 extern char*    ms_hptime2seedtimestr (hptime_t hptime, char *seedtimestr, flag subsecond);
+extern char*    ms_hptime2seedtimestr_cached (hptime_t hptime, char *seedtimestr, flag subsecond,
+					      MSTimeStrCache *cache);
 extern hptime_t ms_time2hptime (int year, int day, int hour, int min, int sec, int usec);
 extern hptime_t ms_seedtimestr2hptime (char *seedtimestr);
 extern hptime_t ms_timestr2hptime (char *timestr);
@@ -674,6 +731,8 @@ extern int      ms_ratapprox (double real, int *num, int *den, int maxval, doubl
 extern int      ms_bigendianhost (void);
 extern double   ms_dabs (double val);
 extern double   ms_rsqrt64 (double val);
+extern int      ms_convertsamples (void **datasamples, size_t *datasize, int64_t numsamples,
+				   char *sampletype, char type, flag truncate);
 
 
 /* Lookup functions */
@@ -726,6 +785,7 @@ typedef struct LeapSecond_s
 extern LeapSecond *leapsecondlist;
 extern int ms_readleapseconds (char *envvarname);
 extern int ms_readleapsecondfile (char *filename);
+extern int ms_leapsecondinrange (hptime_t starttime, hptime_t endtime);
 
 /* Generic byte swapping routines */
 extern void     ms_gswap2 ( void *data2 );
@@ -577,8 +577,8 @@ msr_starttime_uc (MSRecord *msr)
 hptime_t
 msr_endtime (MSRecord *msr)
 {
-  hptime_t span      = 0;
-  LeapSecond *lslist = leapsecondlist;
+  hptime_t span = 0;
+  int lsflag;
 
   if (!msr)
     return HPTERROR;
@@ -587,19 +587,10 @@ msr_endtime (MSRecord *msr)
     span = (hptime_t) (((double)(msr->samplecnt - 1) / msr->samprate * HPTMODULUS) + 0.5);
 
   /* Check if the record contains a leap second, if list is available */
-  if (lslist)
+  if ((lsflag = ms_leapsecondinrange (msr->starttime, msr->starttime + span)) >= 0)
   {
-    while (lslist)
-    {
-      if (lslist->leapsecond > msr->starttime &&
-          lslist->leapsecond < (msr->starttime + span))
-      {
-        span -= HPTMODULUS;
-        break;
-      }
-
-      lslist = lslist->next;
-    }
+    if (lsflag)
+      span -= HPTMODULUS;
   }
   else
   {
@@ -23,15 +23,26 @@ static flag verbose    = 0;
 static flag ppackets   = 0;
 static flag basicsum   = 0;
 static flag tracegap   = 0;
+static flag traceheal  = 0;
+static flag traceindex = 0;
 static int printraw    = 0;
 static int printdata   = 0;
 static int reclen      = -1;
+static int readthreads = 0;
+static size_t spillsize = 0;
+static char *convtypes  = 0;
+static hptime_t winstart = HPTERROR;
+static hptime_t winend   = HPTERROR;
 static char *inputfile = 0;
+static const char *inputfiles[20];
+static int inputcount  = 0;
 
 static double timetol     = -1.0; /* Time tolerance for continuous traces */
 static double sampratetol = -1.0; /* Sample rate tolerance for continuous traces */
 
 static int parameter_proc (int argcount, char **argvec);
+static void convert_tracelist (MSTraceList *mstl);
+static void print_samples (void *datasamples, int64_t numsamples, char sampletype);
 static void print_stderr (char *message);
 static void usage (void);
 
@@ -44,6 +55,7 @@ int
 main (int argc, char **argv)
 {
   MSTraceList *mstl = 0;
+  MSTraceGroup *mstg = 0;
   MSRecord *msr     = 0;
 
   int64_t totalrecs  = 0;
@@ -57,9 +69,55 @@ main (int argc, char **argv)
   if (parameter_proc (argc, argv) < 0)
     return -1;
 
-  if (tracegap)
+  if (tracegap || spillsize)
     mstl = mstl_init (NULL);
 
+  /* Store large segments in files in the current directory */
+  if (spillsize && mstl_spill (mstl, ".", spillsize))
+    return -1;
+
+  /* Read all input files into a trace list with multiple threads or a time window */
+  if (readthreads || winstart != HPTERROR || winend != HPTERROR)
+  {
+    if (readthreads)
+      retcode = ms_readtracelist_files (&mstl, inputfiles, inputcount, reclen,
+                                        timetol, sampratetol, NULL, 0, 1,
+                                        printdata, readthreads, verbose);
+    else
+      retcode = ms_readtracelist_timewin (&mstl, inputfile, reclen, timetol,
+                                          sampratetol, winstart, winend, 0, 1,
+                                          printdata, verbose);
+
+    if (retcode != MS_NOERROR)
+      ms_log (2, "Cannot read files: %s\n", ms_errorstr (retcode));
+
+    convert_tracelist (mstl);
+    mstl_printtracelist (mstl, 0, 1, 1);
+
+    if (printdata)
+    {
+      MSTraceID *id;
+      MSTraceSeg *seg;
+
+      for (id = mstl->traces; id; id = id->next)
+        for (seg = id->first; seg; seg = seg->next)
+          if (seg->numsamples > 0)
+            print_samples (seg->datasamples, seg->numsamples, seg->sampletype);
+    }
+
+    mstl_free (&mstl, 0);
+
+    return 0;
+  }
+
+  if (traceheal)
+  {
+    mstg = mst_initgroup (NULL);
+
+    if (traceindex)
+      mst_groupindex (mstg, 1);
+  }
+
   /* Loop over the input file */
   while ((retcode = ms_readmsr (&msr, inputfile, reclen, NULL, NULL, 1,
                                 printdata, verbose)) == MS_NOERROR)
@@ -71,6 +129,10 @@ main (int argc, char **argv)
     {
       mstl_addmsr (mstl, msr, 0, 1, timetol, sampratetol);
     }
+    else if (traceheal)
+    {
+      mst_addmsrtogroup (mstg, msr, 0, timetol, sampratetol);
+    }
     else
     {
       if ( printraw )
@@ -79,68 +141,7 @@ main (int argc, char **argv)
         msr_print (msr, ppackets);
 
       if (printdata && msr->numsamples > 0)
-      {
-        int line, col, cnt, samplesize;
-        int lines = (msr->numsamples / 6) + 1;
-        void *sptr;
-
-        if ((samplesize = ms_samplesize (msr->sampletype)) == 0)
-        {
-          ms_log (2, "Unrecognized sample type: '%c'\n", msr->sampletype);
-        }
-        if (msr->sampletype == 'a')
-        {
-          char *ascii = (char *)msr->datasamples;
-          int length  = msr->numsamples;
-
-          ms_log (0, "ASCII Data:\n");
-
-          /* Print maximum log message segments */
-          while (length > (MAX_LOG_MSG_LENGTH - 1))
-          {
-            ms_log (0, "%.*s", (MAX_LOG_MSG_LENGTH - 1), ascii);
-            ascii += MAX_LOG_MSG_LENGTH - 1;
-            length -= MAX_LOG_MSG_LENGTH - 1;
-          }
-
-          /* Print any remaining ASCII and add a newline */
-          if (length > 0)
-          {
-            ms_log (0, "%.*s\n", length, ascii);
-          }
-          else
-          {
-            ms_log (0, "\n");
-          }
-        }
-        else
-          for (cnt = 0, line = 0; line < lines; line++)
-          {
-            for (col = 0; col < 6; col++)
-            {
-              if (cnt < msr->numsamples)
-              {
-                sptr = (char *)msr->datasamples + (cnt * samplesize);
-
-                if (msr->sampletype == 'i')
-                  ms_log (0, "%10d  ", *(int32_t *)sptr);
-
-                else if (msr->sampletype == 'f')
-                  ms_log (0, "%10.8g  ", *(float *)sptr);
-
-                else if (msr->sampletype == 'd')
-                  ms_log (0, "%10.10g  ", *(double *)sptr);
-
-                cnt++;
-              }
-            }
-            ms_log (0, "\n");
-
-            /* If only printing the first 6 samples break out here */
-            if (printdata == 1)
-              break;
-          }
-      }
+        print_samples (msr->datasamples, msr->numsamples, msr->sampletype);
     }
   }
 
@@ -148,14 +149,46 @@ main (int argc, char **argv)
     ms_log (2, "Cannot read %s: %s\n", inputfile, ms_errorstr (retcode));
 
   if (tracegap)
+  {
+    convert_tracelist (mstl);
     mstl_printtracelist (mstl, 0, 1, 1);
 
+    /* Print samples of each assembled segment */
+    if (printdata)
+    {
+      MSTraceID *id;
+      MSTraceSeg *seg;
+
+      for (id = mstl->traces; id; id = id->next)
+        for (seg = id->first; seg; seg = seg->next)
+          if (seg->numsamples > 0)
+            print_samples (seg->datasamples, seg->numsamples, seg->sampletype);
+    }
+  }
+
+  if (traceheal)
+  {
+    MSTrace *mst;
+
+    ms_log (0, "Mergings: %d\n", mst_groupheal (mstg, timetol, sampratetol));
+    mst_printtracelist (mstg, 0, 1, 1);
+
+    /* Print samples of each healed trace */
+    if (printdata)
+      for (mst = mstg->traces; mst; mst = mst->next)
+        if (mst->numsamples > 0)
+          print_samples (mst->datasamples, mst->numsamples, mst->sampletype);
+  }
+
   /* Make sure everything is cleaned up */
   ms_readmsr (&msr, NULL, 0, NULL, NULL, 0, 0, 0);
 
   if (mstl)
     mstl_free (&mstl, 0);
 
+  if (mstg)
+    mst_freegroup (&mstg);
+
   if (basicsum)
     ms_log (1, "Records: %" PRId64 ", Samples: %" PRId64 "\n",
             totalrecs, totalsamps);
@@ -163,6 +196,100 @@ main (int argc, char **argv)
   return 0;
 } /* End of main() */
 
+/***************************************************************************
+ * convert_tracelist():
+ * Convert the samples of each trace list segment to each of the sample
+ * types in convtypes in turn.
+ ***************************************************************************/
+static void
+convert_tracelist (MSTraceList *mstl)
+{
+  MSTraceID *id;
+  MSTraceSeg *seg;
+  char *type;
+
+  if (!mstl || !convtypes)
+    return;
+
+  for (id = mstl->traces; id; id = id->next)
+    for (seg = id->first; seg; seg = seg->next)
+      for (type = convtypes; *type; type++)
+        if (mstl_convertsamples (seg, *type, 1))
+        {
+          ms_log (2, "Cannot convert samples of %s to '%c'\n", id->srcname, *type);
+          break;
+        }
+} /* End of convert_tracelist() */
+
+/***************************************************************************
+ * print_samples():
+ * Print data samples, only the first 6 values if printdata is 1.
+ ***************************************************************************/
+static void
+print_samples (void *datasamples, int64_t numsamples, char sampletype)
+{
+  int line, col, cnt, samplesize;
+  int lines = (numsamples / 6) + 1;
+  void *sptr;
+
+  if ((samplesize = ms_samplesize (sampletype)) == 0)
+  {
+    ms_log (2, "Unrecognized sample type: '%c'\n", sampletype);
+  }
+  if (sampletype == 'a')
+  {
+    char *ascii = (char *)datasamples;
+    int length  = numsamples;
+
+    ms_log (0, "ASCII Data:\n");
+
+    /* Print maximum log message segments */
+    while (length > (MAX_LOG_MSG_LENGTH - 1))
+    {
+      ms_log (0, "%.*s", (MAX_LOG_MSG_LENGTH - 1), ascii);
+      ascii += MAX_LOG_MSG_LENGTH - 1;
+      length -= MAX_LOG_MSG_LENGTH - 1;
+    }
+
+    /* Print any remaining ASCII and add a newline */
+    if (length > 0)
+    {
+      ms_log (0, "%.*s\n", length, ascii);
+    }
+    else
+    {
+      ms_log (0, "\n");
+    }
+  }
+  else
+    for (cnt = 0, line = 0; line < lines; line++)
+    {
+      for (col = 0; col < 6; col++)
+      {
+        if (cnt < numsamples)
+        {
+          sptr = (char *)datasamples + (cnt * samplesize);
+
+          if (sampletype == 'i')
+            ms_log (0, "%10d  ", *(int32_t *)sptr);
+
+          else if (sampletype == 'f')
+            ms_log (0, "%10.8g  ", *(float *)sptr);
+
+          else if (sampletype == 'd')
+            ms_log (0, "%10.10g  ", *(double *)sptr);
+
+          cnt++;
+        }
+      }
+      ms_log (0, "\n");
+
+      /* If only printing the first 6 samples break out here */
+      if (printdata == 1)
+        break;
+    }
+} /* End of print_samples() */
+
 /***************************************************************************
  * parameter_proc():
  * Process the command line parameters.
@@ -207,6 +334,38 @@ parameter_proc (int argcount, char **argvec)
     {
       printdata = 2;
     }
+    else if (strncmp (argvec[optind], "-th", 3) == 0)
+    {
+      traceheal = 1;
+    }
+    else if (strcmp (argvec[optind], "-tm") == 0)
+    {
+      readthreads = atoi (argvec[++optind]);
+    }
+    else if (strcmp (argvec[optind], "-ts") == 0)
+    {
+      winstart = ms_seedtimestr2hptime (argvec[++optind]);
+    }
+    else if (strcmp (argvec[optind], "-te") == 0)
+    {
+      winend = ms_seedtimestr2hptime (argvec[++optind]);
+    }
+    else if (strcmp (argvec[optind], "-tw") == 0)
+    {
+      MS_TIMEWINSEEK (1);
+    }
+    else if (strcmp (argvec[optind], "-tc") == 0)
+    {
+      convtypes = argvec[++optind];
+    }
+    else if (strcmp (argvec[optind], "-tp") == 0)
+    {
+      spillsize = strtoul (argvec[++optind], NULL, 10);
+    }
+    else if (strncmp (argvec[optind], "-ti", 3) == 0)
+    {
+      traceindex = 1;
+    }
     else if (strncmp (argvec[optind], "-tg", 3) == 0)
     {
       tracegap = 1;
@@ -227,7 +386,12 @@ parameter_proc (int argcount, char **argvec)
     }
     else if (inputfile == 0)
     {
-      inputfile = argvec[optind];
+      inputfile                = argvec[optind];
+      inputfiles[inputcount++] = argvec[optind];
+    }
+    else if (readthreads && inputcount < 20)
+    {
+      inputfiles[inputcount++] = argvec[optind];
     }
     else
     {
@@ -281,9 +445,17 @@ usage (void)
            " -d             Print first 6 sample values\n"
            " -D             Print all sample values\n"
            " -tg            Print trace listing with gap information\n"
+           " -th            Print trace group listing after healing\n"
+           " -ti            Index the trace group while reading, use with -th\n"
+           " -tm threads    Read all files into a trace list with threads\n"
+           " -ts time       Read trace list from time window starting at time\n"
+           " -te time       Read trace list from time window ending at time\n"
+           " -tw            Seek to the time window in files in time order\n"
+           " -tc types      Convert trace list samples to each type in turn, e.g. fdi\n"
+           " -tp bytes      Store trace list segments over bytes in files in .\n"
            " -s             Print a basic summary after processing a file\n"
            " -r bytes       Specify record length in bytes, required if no Blockette 1000\n"
            "\n"
-           " file           File of Mini-SEED records\n"
+           " file           File of Mini-SEED records, multiple files with -tm\n"
            "\n");
 } /* End of usage() */
@@ -0,0 +1,410 @@
+/***************************************************************************
+ * lmtesttimestr.c
+ *
+ * A program for libmseed time string formatting tests and benchmarks.
+ *
+ * Each time is formatted with both ms_hptime2seedtimestr() and
+ * ms_hptime2seedtimestr_cached() and the results are compared, the
+ * number of differences is reported.  With -b the time used by each
+ * routine is also reported.
+ *
+ * With -r a fixed set of times, including times before 1900 and 1970,
+ * leap days and leap seconds, is converted with the time conversion
+ * routines and printed for comparison with a reference.  A leap second
+ * file may be read with -l to test end times of records containing
+ * leap seconds.
+ *
+ * modified 2026.291
+ ***************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libmseed.h>
+
+#define VERSION "[libmseed " LIBMSEED_VERSION " example]"
+#define PACKAGE "lmtesttimestr"
+
+static flag verbose         = 0;
+static flag benchmark       = 0;
+static flag reference       = 0;
+static char *leapsecondfile = NULL;
+static long count           = 1000000;
+
+/* Times for reference conversions as year, day, hour, min, sec, usec */
+static const int reftimes[][6] = {
+  {1800, 1, 0, 0, 0, 0},
+  {1850, 60, 12, 30, 15, 250000},
+  {1899, 365, 23, 59, 59, 999999},
+  {1900, 1, 0, 0, 0, 0},
+  {1900, 59, 23, 59, 59, 0},      /* 28 Feb, 1900 is not a leap year */
+  {1900, 60, 0, 0, 0, 0},
+  {1904, 60, 6, 0, 0, 0},         /* 29 Feb */
+  {1960, 366, 23, 59, 59, 500000},
+  {1969, 365, 23, 59, 59, 999999},
+  {1970, 1, 0, 0, 0, 0},
+  {1972, 182, 23, 59, 60, 0},     /* Leap second */
+  {1999, 365, 23, 59, 59, 999999},
+  {2000, 60, 0, 0, 0, 0},         /* 29 Feb, 2000 is a leap year */
+  {2000, 366, 12, 0, 0, 1},
+  {2016, 366, 23, 59, 60, 0},     /* Leap second */
+  {2017, 1, 0, 0, 0, 0},
+  {2100, 59, 0, 0, 0, 0},
+  {2100, 60, 0, 0, 0, 0},         /* 1 Mar, 2100 is not a leap year */
+  {2400, 366, 0, 0, 0, 0},
+  {5000, 365, 23, 59, 59, 999999},
+};
+
+/* High precision times around the epoch for reference conversions */
+static const hptime_t refhptimes[] = {
+  -1, -999999, -1000000, -1000001, -86400000001LL, -2208988800000000LL,
+};
+
+/* Record start times and sample counts at 1 Hz for end time references */
+static const struct
+{
+  const char *starttime;
+  int64_t samplecnt;
+} refrecords[] = {
+  {"1969,365,23:59:00", 120},
+  {"1972,182,23:59:30", 60},     /* Contains the leap second of 30 Jun */
+  {"1972,183,00:00:00", 60},     /* Starts after the leap second */
+  {"2016,366,23:59:00", 60},     /* Ends at the leap second */
+  {"2016,366,23:59:00", 62},     /* Contains the leap second */
+  {"2017,001,00:00:00", 3600},
+};
+
+static int print_reference (void);
+static void print_hptime (hptime_t hptime);
+static int parameter_proc (int argcount, char **argvec);
+static void print_stderr (char *message);
+static void usage (void);
+
+int
+main (int argc, char **argv)
+{
+  MSTimeStrCache cache;
+  hptime_t *times;
+  hptime_t htime;
+  char timestr[30];
+  char cachedstr[30];
+  clock_t start;
+  double plainsecs;
+  double cachedsecs;
+  long differences = 0;
+  long idx;
+  int subseconds;
+
+  /* Redirect libmseed logging facility to stderr for consistency */
+  ms_loginit (print_stderr, NULL, print_stderr, NULL);
+
+  /* Process command line arguments */
+  if (parameter_proc (argc, argv) < 0)
+    return -1;
+
+  /* Print reference conversions instead of comparing */
+  if (reference)
+    return print_reference ();
+
+  if ((times = (hptime_t *)malloc (count * sizeof (hptime_t))) == NULL)
+  {
+    ms_log (2, "Cannot allocate memory for %ld times\n", count);
+    return 1;
+  }
+
+  /* Generate runs of increasing times, as for the segments of a
+   * channel, with steps from sub-second sample intervals to days and
+   * starting between 1965 and 2025 */
+  srand (1);
+  htime = 0;
+  for (idx = 0; idx < count; idx++)
+  {
+    if ((idx % 1000) == 0)
+    {
+      htime = MS_EPOCH2HPTIME ((int64_t) (rand () % 21915 - 1826) * 86400);
+      htime += (hptime_t) (rand () % 86400) * HPTMODULUS + rand () % HPTMODULUS;
+    }
+
+    switch (rand () % 4)
+    {
+    case 0:
+      htime += (hptime_t) (rand () % 100000);
+      break;
+    case 1:
+      htime += (hptime_t) (rand () % 1000) * HPTMODULUS;
+      break;
+    case 2:
+      htime += (hptime_t) (rand () % 3600) * HPTMODULUS + rand () % HPTMODULUS;
+      break;
+    default:
+      htime += (hptime_t) (rand () % 86400) * HPTMODULUS + rand () % HPTMODULUS;
+      break;
+    }
+
+    times[idx] = htime;
+  }
+
+  /* Compare the output of the plain and cached routines */
+  memset (&cache, 0, sizeof (cache));
+  for (idx = 0; idx < count; idx++)
+  {
+    subseconds = idx & 1;
+
+    ms_hptime2seedtimestr (times[idx], timestr, subseconds);
+    ms_hptime2seedtimestr_cached (times[idx], cachedstr, subseconds, &cache);
+
+    if (strcmp (timestr, cachedstr))
+    {
+      if (verbose)
+        ms_log (1, "Difference for %lld: '%s' vs '%s'\n",
+                (long long int)times[idx], timestr, cachedstr);
+      differences++;
+    }
+  }
+
+  ms_log (0, "Compared %ld time strings, %ld differences\n", count, differences);
+
+  if (benchmark)
+  {
+    start = clock ();
+    for (idx = 0; idx < count; idx++)
+      ms_hptime2seedtimestr (times[idx], timestr, 1);
+    plainsecs = (double)(clock () - start) / CLOCKS_PER_SEC;
+
+    memset (&cache, 0, sizeof (cache));
+    start = clock ();
+    for (idx = 0; idx < count; idx++)
+      ms_hptime2seedtimestr_cached (times[idx], timestr, 1, &cache);
+    cachedsecs = (double)(clock () - start) / CLOCKS_PER_SEC;
+
+    ms_log (0, "ms_hptime2seedtimestr:        %.3f seconds, %.1f ns/call\n",
+            plainsecs, plainsecs * 1e9 / count);
+    ms_log (0, "ms_hptime2seedtimestr_cached: %.3f seconds, %.1f ns/call\n",
+            cachedsecs, cachedsecs * 1e9 / count);
+  }
+
+  free (times);
+
+  return (differences) ? 1 : 0;
+} /* End of main() */
+
+/***************************************************************************
+ * print_reference():
+ * Print the conversions of the reference times and the end times of
+ * the reference records, after reading a leap second file if
+ * specified.
+ *
+ * Returns 0 on success, and 1 on failure
+ ***************************************************************************/
+static int
+print_reference (void)
+{
+  MSRecord *msr = NULL;
+  LeapSecond *ls;
+  hptime_t endtime;
+  char timestr[30];
+  char lstimestr[30];
+  int nrefrecords = (int)(sizeof (refrecords) / sizeof (refrecords[0]));
+  int idx;
+
+  for (idx = 0; idx < (int)(sizeof (reftimes) / sizeof (reftimes[0])); idx++)
+    print_hptime (ms_time2hptime (reftimes[idx][0], reftimes[idx][1], reftimes[idx][2],
+                                  reftimes[idx][3], reftimes[idx][4], reftimes[idx][5]));
+
+  for (idx = 0; idx < (int)(sizeof (refhptimes) / sizeof (refhptimes[0])); idx++)
+    print_hptime (refhptimes[idx]);
+
+  if (leapsecondfile && ms_readleapsecondfile (leapsecondfile) < 0)
+    return 1;
+
+  if ((msr = msr_init (NULL)) == NULL)
+    return 1;
+
+  for (idx = 0; idx < nrefrecords; idx++)
+  {
+    msr->starttime = ms_seedtimestr2hptime ((char *)refrecords[idx].starttime);
+    msr->samprate  = 1.0;
+    msr->samplecnt = refrecords[idx].samplecnt;
+
+    endtime = msr_endtime (msr);
+
+    ms_log (0, "%s + %lld samples at 1 Hz ends at %s\n", refrecords[idx].starttime,
+            (long long int)msr->samplecnt, ms_hptime2seedtimestr (endtime, timestr, 1));
+  }
+
+  /* Add a leap second to the list and then move it, the end time of
+   * the last record must follow both changes to the list */
+  if (leapsecondlist)
+  {
+    for (ls = leapsecondlist; ls->next; ls = ls->next)
+      ;
+
+    if ((ls->next = (LeapSecond *)calloc (1, sizeof (LeapSecond))) == NULL)
+      return 1;
+
+    ls             = ls->next;
+    ls->leapsecond = ms_seedtimestr2hptime ("2017,001,00:30:00");
+
+    for (idx = 0; idx < 2; idx++)
+    {
+      msr->starttime = ms_seedtimestr2hptime ((char *)refrecords[nrefrecords - 1].starttime);
+      msr->samprate  = 1.0;
+      msr->samplecnt = refrecords[nrefrecords - 1].samplecnt;
+
+      endtime = msr_endtime (msr);
+
+      ms_log (0, "With %s leap second at %s: ends at %s\n", (idx) ? "moved" : "added",
+              ms_hptime2seedtimestr (ls->leapsecond, lstimestr, 0),
+              ms_hptime2seedtimestr (endtime, timestr, 1));
+
+      ls->leapsecond = ms_seedtimestr2hptime ("2018,001,00:00:00");
+    }
+  }
+
+  msr_free (&msr);
+
+  return 0;
+} /* End of print_reference() */
+
+/***************************************************************************
+ * print_hptime():
+ * Print a high precision time converted to strings, a BTime and month
+ * and day and the times parsed back from the strings and BTime.
+ ***************************************************************************/
+static void
+print_hptime (hptime_t hptime)
+{
+  BTime btime;
+  char seedstr[30];
+  char isostr[30];
+  char mdstr[30];
+  int month = 0;
+  int mday  = 0;
+  int doy   = 0;
+
+  ms_hptime2seedtimestr (hptime, seedstr, 1);
+  ms_hptime2isotimestr (hptime, isostr, 1);
+  ms_hptime2mdtimestr (hptime, mdstr, 1);
+
+  ms_log (0, "%lld: %s %s %s\n", (long long int)hptime, seedstr, isostr, mdstr);
+
+  memset (&btime, 0, sizeof (btime));
+  if (ms_hptime2btime (hptime, &btime))
+  {
+    ms_log (0, "  Cannot convert to BTime\n");
+    return;
+  }
+
+  ms_doy2md (btime.year, btime.day, &month, &mday);
+  ms_md2doy (btime.year, month, mday, &doy);
+
+  ms_log (0, "  BTime %d,%03d,%02d:%02d:%02d.%04d, month %02d day %02d, day of year %03d\n",
+          btime.year, btime.day, btime.hour, btime.min, btime.sec, btime.fract,
+          month, mday, doy);
+  ms_log (0, "  Parsed %lld %lld %lld %lld\n",
+          (long long int)ms_seedtimestr2hptime (seedstr),
+          (long long int)ms_timestr2hptime (isostr),
+          (long long int)ms_timestr2hptime (mdstr),
+          (long long int)ms_btime2hptime (&btime));
+} /* End of print_hptime() */
+
+/***************************************************************************
+ * parameter_proc():
+ * Process the command line arguments.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+parameter_proc (int argcount, char **argvec)
+{
+  int optind;
+
+  /* Process all command line arguments */
+  for (optind = 1; optind < argcount; optind++)
+  {
+    if (strcmp (argvec[optind], "-V") == 0)
+    {
+      ms_log (1, "%s version: %s\n", PACKAGE, VERSION);
+      exit (0);
+    }
+    else if (strcmp (argvec[optind], "-h") == 0)
+    {
+      usage ();
+      exit (0);
+    }
+    else if (strncmp (argvec[optind], "-v", 2) == 0)
+    {
+      verbose += strspn (&argvec[optind][1], "v");
+    }
+    else if (strcmp (argvec[optind], "-b") == 0)
+    {
+      benchmark = 1;
+    }
+    else if (strcmp (argvec[optind], "-n") == 0)
+    {
+      count = strtol (argvec[++optind], NULL, 10);
+    }
+    else if (strcmp (argvec[optind], "-r") == 0)
+    {
+      reference = 1;
+    }
+    else if (strcmp (argvec[optind], "-l") == 0)
+    {
+      leapsecondfile = argvec[++optind];
+    }
+    else
+    {
+      ms_log (2, "Unknown option: %s\n", argvec[optind]);
+      exit (1);
+    }
+  }
+
+  if (count <= 0)
+  {
+    ms_log (2, "Count of times must be positive\n");
+    exit (1);
+  }
+
+  /* Report the program version */
+  if (verbose)
+    ms_log (1, "%s version: %s\n", PACKAGE, VERSION);
+
+  return 0;
+} /* End of parameter_proc() */
+
+/***************************************************************************
+ * print_stderr():
+ * Print messsage to stderr.
+ ***************************************************************************/
+static void
+print_stderr (char *message)
+{
+  fprintf (stderr, "%s", message);
+} /* End of print_stderr() */
+
+/***************************************************************************
+ * usage:
+ * Print the usage message and exit.
+ ***************************************************************************/
+static void
+usage (void)
+{
+  fprintf (stderr, "%s version: %s\n\n", PACKAGE, VERSION);
+  fprintf (stderr, "Usage: %s [options]\n\n", PACKAGE);
+  fprintf (stderr,
+           " ## Options ##\n"
+           " -V             Report program version\n"
+           " -h             Show this usage message\n"
+           " -v             Be more verbose, multiple flags can be used\n"
+           " -n count       Number of times to format, default 1000000\n"
+           " -b             Benchmark the formatting routines\n"
+           " -r             Print conversions of reference times instead\n"
+           " -l file        Read leap seconds from file for -r\n"
+           "\n"
+           "This program compares SEED time strings created by the plain and\n"
+           "cached formatting routines and optionally benchmarks them\n"
+           "\n");
+} /* End of usage() */
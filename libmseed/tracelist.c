@@ -8,6 +8,7 @@
  * modified: 2015.108
  ***************************************************************************/
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,9 +16,26 @@
 
 #include "libmseed.h"
 
-MSTraceSeg *mstl_msr2seg (MSRecord *msr, hptime_t endtime);
-MSTraceSeg *mstl_addmsrtoseg (MSTraceSeg *seg, MSRecord *msr, hptime_t endtime, flag whence);
-MSTraceSeg *mstl_addsegtoseg (MSTraceSeg *seg1, MSTraceSeg *seg2);
+#if !defined(LMP_WIN)
+  #include <sys/mman.h>
+#endif
+
+/* File storage of segment samples */
+struct MSTraceSegSpill_s
+{
+  int fd;                 /* Descriptor of unlinked file mapped at datasamples */
+};
+
+MSTraceSeg *mstl_msr2seg (MSRecord *msr, hptime_t endtime, struct MSTraceListSpill_s *spill);
+MSTraceSeg *mstl_addmsrtoseg (MSTraceSeg *seg, MSRecord *msr, hptime_t endtime, flag whence,
+                              struct MSTraceListSpill_s *spill);
+MSTraceSeg *mstl_addsegtoseg (MSTraceSeg *seg1, MSTraceSeg *seg2, struct MSTraceListSpill_s *spill);
+static MSTraceSeg *mstl_addmsr_int (MSTraceList *mstl, MSRecord *msr, hptime_t endtime,
+                                    flag dataquality, flag autoheal,
+                                    double timetol, double sampratetol);
+static int mstl_growdata (MSTraceSeg *seg, size_t size, struct MSTraceListSpill_s *spill);
+static int mstl_spillmap (MSTraceSeg *seg, size_t size, struct MSTraceListSpill_s *spill);
+static void mstl_freedata (MSTraceSeg *seg);
 
 /***************************************************************************
  * mstl_init:
@@ -88,8 +106,7 @@ mstl_free (MSTraceList **ppmstl, flag freeprvtptr)
           free (seg->prvtptr);
 
         /* Free data array if allocated */
-        if (seg->datasamples)
-          free (seg->datasamples);
+        mstl_freedata (seg);
 
         free (seg);
         seg = nextseg;
@@ -103,6 +120,9 @@ mstl_free (MSTraceList **ppmstl, flag freeprvtptr)
       id = nextid;
     }
 
+    if ((*ppmstl)->spill)
+      free ((*ppmstl)->spill);
+
     free (*ppmstl);
 
     *ppmstl = NULL;
@@ -135,6 +155,36 @@ mstl_free (MSTraceList **ppmstl, flag freeprvtptr)
 MSTraceSeg *
 mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
              flag autoheal, double timetol, double sampratetol)
+{
+  hptime_t endtime;
+
+  if (!mstl || !msr)
+    return 0;
+
+  /* Calculate end time for MSRecord */
+  if ((endtime = msr_endtime (msr)) == HPTERROR)
+  {
+    ms_log (2, "mstl_addmsr(): Error calculating record end time\n");
+    return 0;
+  }
+
+  return mstl_addmsr_int (mstl, msr, endtime, dataquality, autoheal,
+                          timetol, sampratetol);
+} /* End of mstl_addmsr() */
+
+/***************************************************************************
+ * mstl_addmsr_int:
+ *
+ * Internal version of mstl_addmsr() that uses the specified end time
+ * for the MSRecord coverage.  Used by mstl_merge() to add segment
+ * coverage with the end time of the segment.
+ *
+ * Return a pointer to the MSTraceSeg updated or 0 on error.
+ ***************************************************************************/
+static MSTraceSeg *
+mstl_addmsr_int (MSTraceList *mstl, MSRecord *msr, hptime_t endtime,
+                 flag dataquality, flag autoheal, double timetol,
+                 double sampratetol)
 {
   MSTraceID *id       = 0;
   MSTraceID *searchid = 0;
@@ -146,7 +196,6 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
   MSTraceSeg *segafter  = 0;
   MSTraceSeg *followseg = 0;
 
-  hptime_t endtime;
   hptime_t pregap;
   hptime_t postgap;
   hptime_t lastgap;
@@ -165,16 +214,6 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
   int ltmag;
   int ltcmp;
 
-  if (!mstl || !msr)
-    return 0;
-
-  /* Calculate end time for MSRecord */
-  if ((endtime = msr_endtime (msr)) == HPTERROR)
-  {
-    ms_log (2, "mstl_addmsr(): Error calculating record end time\n");
-    return 0;
-  }
-
   /* Generate source name string */
   if (!msr_srcname (msr, srcname, dataquality))
   {
@@ -273,7 +312,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
     id->latest      = endtime;
     id->numsegments = 1;
 
-    if (!(seg = mstl_msr2seg (msr, endtime)))
+    if (!(seg = mstl_msr2seg (msr, endtime, mstl->spill)))
     {
       return 0;
     }
@@ -340,7 +379,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
     /* Record coverage fits at end of last segment */
     if (lastgap <= hptimetol && lastgap >= nhptimetol && lastratecheck)
     {
-      if (!mstl_addmsrtoseg (id->last, msr, endtime, 1))
+      if (!mstl_addmsrtoseg (id->last, msr, endtime, 1, mstl->spill))
         return 0;
 
       seg = id->last;
@@ -351,7 +390,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
     /* Record coverage is after all other coverage */
     else if ((msr->starttime - hpdelta - hptimetol) > id->latest)
     {
-      if (!(seg = mstl_msr2seg (msr, endtime)))
+      if (!(seg = mstl_msr2seg (msr, endtime, mstl->spill)))
         return 0;
 
       /* Add to end of list */
@@ -366,7 +405,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
     /* Record coverage is before all other coverage */
     else if ((endtime + hpdelta + hptimetol) < id->earliest)
     {
-      if (!(seg = mstl_msr2seg (msr, endtime)))
+      if (!(seg = mstl_msr2seg (msr, endtime, mstl->spill)))
         return 0;
 
       /* Add to beginning of list */
@@ -381,7 +420,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
     /* Record coverage fits at beginning of first segment */
     else if (firstgap <= hptimetol && firstgap >= nhptimetol && firstratecheck)
     {
-      if (!mstl_addmsrtoseg (id->first, msr, endtime, 2))
+      if (!mstl_addmsrtoseg (id->first, msr, endtime, 2, mstl->spill))
         return 0;
 
       seg = id->first;
@@ -453,7 +492,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
       /* Add MSRecord coverage to end of segment before */
       if (segbefore)
       {
-        if (!mstl_addmsrtoseg (segbefore, msr, endtime, 1))
+        if (!mstl_addmsrtoseg (segbefore, msr, endtime, 1, mstl->spill))
         {
           return 0;
         }
@@ -462,7 +501,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
         if (autoheal && segafter && segbefore != segafter)
         {
           /* Add segafter coverage to segbefore */
-          if (!mstl_addsegtoseg (segbefore, segafter))
+          if (!mstl_addsegtoseg (segbefore, segafter, mstl->spill))
           {
             return 0;
           }
@@ -478,8 +517,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
             segafter->next->prev = segafter->prev;
 
           /* Free data samples, private data and segment structure */
-          if (segafter->datasamples)
-            free (segafter->datasamples);
+          mstl_freedata (segafter);
 
           if (segafter->prvtptr)
             free (segafter->prvtptr);
@@ -492,7 +530,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
       /* Add MSRecord coverage to beginning of segment after */
       else if (segafter)
       {
-        if (!mstl_addmsrtoseg (segafter, msr, endtime, 2))
+        if (!mstl_addmsrtoseg (segafter, msr, endtime, 2, mstl->spill))
         {
           return 0;
         }
@@ -503,7 +541,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
       else
       {
         /* Create new segment */
-        if (!(seg = mstl_msr2seg (msr, endtime)))
+        if (!(seg = mstl_msr2seg (msr, endtime, mstl->spill)))
         {
           return 0;
         }
@@ -596,7 +634,65 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
   mstl->last = id;
 
   return seg;
-} /* End of mstl_addmsr() */
+} /* End of mstl_addmsr_int() */
+
+/***************************************************************************
+ * mstl_merge:
+ *
+ * Add the data coverage of all segments in the source MSTraceList to
+ * the destination MSTraceList.  Each segment is added as if it were a
+ * single record using the same logic as mstl_addmsr(), the dataquality,
+ * autoheal, timetol and sampratetol arguments have the same meaning.
+ *
+ * Segments are added in the order of the source list, so merging
+ * lists of separately read files in file order gives the same result
+ * as reading the files in that order into a single list.  The source
+ * list is not modified.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+int
+mstl_merge (MSTraceList *mstl, MSTraceList *source, flag dataquality,
+            flag autoheal, double timetol, double sampratetol)
+{
+  MSTraceID *id;
+  MSTraceSeg *seg;
+  MSRecord msr;
+
+  if (!mstl || !source)
+    return -1;
+
+  memset (&msr, 0, sizeof (MSRecord));
+
+  for (id = source->traces; id; id = id->next)
+  {
+    strcpy (msr.network, id->network);
+    strcpy (msr.station, id->station);
+    strcpy (msr.location, id->location);
+    strcpy (msr.channel, id->channel);
+    msr.dataquality = id->dataquality;
+
+    for (seg = id->first; seg; seg = seg->next)
+    {
+      /* Describe segment coverage as a record */
+      msr.starttime   = seg->starttime;
+      msr.samprate    = seg->samprate;
+      msr.samplecnt   = seg->samplecnt;
+      msr.datasamples = seg->datasamples;
+      msr.numsamples  = seg->numsamples;
+      msr.sampletype  = seg->sampletype;
+
+      if (!mstl_addmsr_int (mstl, &msr, seg->endtime, dataquality, autoheal,
+                            timetol, sampratetol))
+      {
+        ms_log (2, "mstl_merge(): Cannot add segment of %s\n", id->srcname);
+        return -1;
+      }
+    }
+  }
+
+  return 0;
+} /* End of mstl_merge() */
 
 /***************************************************************************
  * mstl_msr2seg:
@@ -606,7 +702,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
  * Return a pointer to a MSTraceSeg otherwise 0 on error.
  ***************************************************************************/
 MSTraceSeg *
-mstl_msr2seg (MSRecord *msr, hptime_t endtime)
+mstl_msr2seg (MSRecord *msr, hptime_t endtime, struct MSTraceListSpill_s *spill)
 {
   MSTraceSeg *seg = 0;
   int samplesize;
@@ -630,7 +726,7 @@ mstl_msr2seg (MSRecord *msr, hptime_t endtime)
   {
     samplesize = ms_samplesize (msr->sampletype);
 
-    if (!(seg->datasamples = malloc ((size_t) (samplesize * msr->numsamples))))
+    if (mstl_growdata (seg, (size_t) (samplesize * msr->numsamples), spill))
     {
       ms_log (2, "mstl_msr2seg(): Error allocating memory\n");
       return 0;
@@ -656,10 +752,10 @@ mstl_msr2seg (MSRecord *msr, hptime_t endtime)
  * Return a pointer to a MSTraceSeg otherwise 0 on error.
  ***************************************************************************/
 MSTraceSeg *
-mstl_addmsrtoseg (MSTraceSeg *seg, MSRecord *msr, hptime_t endtime, flag whence)
+mstl_addmsrtoseg (MSTraceSeg *seg, MSRecord *msr, hptime_t endtime, flag whence,
+                  struct MSTraceListSpill_s *spill)
 {
   int samplesize = 0;
-  void *newdatasamples;
 
   if (!seg || !msr)
     return 0;
@@ -680,13 +776,11 @@ mstl_addmsrtoseg (MSTraceSeg *seg, MSRecord *msr, hptime_t endtime, flag whence)
       return 0;
     }
 
-    if (!(newdatasamples = realloc (seg->datasamples, (size_t) ((seg->numsamples + msr->numsamples) * samplesize))))
+    if (mstl_growdata (seg, (size_t) ((seg->numsamples + msr->numsamples) * samplesize), spill))
     {
       ms_log (2, "mstl_addmsrtoseg(): Error allocating memory\n");
       return 0;
     }
-
-    seg->datasamples = newdatasamples;
   }
 
   /* Add coverage to end of segment */
@@ -740,10 +834,9 @@ mstl_addmsrtoseg (MSTraceSeg *seg, MSRecord *msr, hptime_t endtime, flag whence)
  * Return a pointer to a seg1 otherwise 0 on error.
  ***************************************************************************/
 MSTraceSeg *
-mstl_addsegtoseg (MSTraceSeg *seg1, MSTraceSeg *seg2)
+mstl_addsegtoseg (MSTraceSeg *seg1, MSTraceSeg *seg2, struct MSTraceListSpill_s *spill)
 {
   int samplesize = 0;
-  void *newdatasamples;
 
   if (!seg1 || !seg2)
     return 0;
@@ -764,13 +857,11 @@ mstl_addsegtoseg (MSTraceSeg *seg1, MSTraceSeg *seg2)
       return 0;
     }
 
-    if (!(newdatasamples = realloc (seg1->datasamples, (size_t) ((seg1->numsamples + seg2->numsamples) * samplesize))))
+    if (mstl_growdata (seg1, (size_t) ((seg1->numsamples + seg2->numsamples) * samplesize), spill))
     {
       ms_log (2, "mstl_addsegtoseg(): Error allocating memory\n");
       return 0;
     }
-
-    seg1->datasamples = newdatasamples;
   }
 
   /* Add seg2 coverage to end of seg1 */
@@ -790,145 +881,329 @@ mstl_addsegtoseg (MSTraceSeg *seg1, MSTraceSeg *seg2)
 } /* End of mstl_addsegtoseg() */
 
 /***************************************************************************
- * mstl_convertsamples:
+ * mstl_growdata:
  *
- * Convert the data samples associated with an MSTraceSeg to another
- * data type.  ASCII data samples cannot be converted, if supplied or
- * requested an error will be returned.
+ * Make sure the data sample buffer of a MSTraceSeg is at least size
+ * bytes.  The buffer capacity is doubled when it is too small so that
+ * adding many records to a segment is done in linear time instead of
+ * reallocating and copying the buffer for every record.
  *
- * When converting float & double sample types to integer type a
- * simple rounding is applied by adding 0.5 to the sample value before
- * converting (truncating) to integer.
+ * A buffer with a datasize of 0 was not allocated by libmseed, for
+ * example set directly by the caller, and its capacity is unknown.
+ * Such a buffer is reallocated to exactly the size requested.
  *
- * If the truncate flag is true data samples will be truncated to
- * integers even if loss of sample precision is detected.  If the
- * truncate flag is false (0) and loss of precision is detected an
- * error is returned.
+ * If spill settings are supplied and the buffer reaches the threshold
+ * size, or the samples are already stored in a file, the buffer is a
+ * file mapping managed by mstl_spillmap().
  *
- * Returns 0 on success, and -1 on failure.
+ * Return 0 on success and -1 on error.
  ***************************************************************************/
-int
-mstl_convertsamples (MSTraceSeg *seg, char type, flag truncate)
+static int
+mstl_growdata (MSTraceSeg *seg, size_t size, struct MSTraceListSpill_s *spill)
 {
-  int32_t *idata;
-  float *fdata;
-  double *ddata;
-  int64_t idx;
+  void *newdatasamples;
+  size_t newsize;
 
-  if (!seg)
+  if (seg->datasamples && seg->datasize && size <= seg->datasize)
+    return 0;
+
+  newsize = (seg->datasamples) ? seg->datasize * 2 : 0;
+
+  if (newsize < size)
+    newsize = size;
+
+  if (seg->spill || (spill && newsize >= spill->threshold))
+    return mstl_spillmap (seg, newsize, spill);
+
+  if (!(newdatasamples = realloc (seg->datasamples, newsize)))
     return -1;
 
-  /* No conversion necessary, report success */
-  if (seg->sampletype == type)
+  seg->datasamples = newdatasamples;
+  seg->datasize    = newsize;
+
+  return 0;
+} /* End of mstl_growdata() */
+
+/***************************************************************************
+ * mstl_spill:
+ *
+ * Store the data samples of large segments of a MSTraceList in files
+ * instead of memory.  When the sample buffer of a segment reaches
+ * threshold bytes while adding data its samples are moved to a
+ * temporary file in the specified directory that is mapped into
+ * memory.  The file is removed from the directory immediately and
+ * released when the segment is freed.
+ *
+ * The datasamples pointer of a segment remains a view of all of its
+ * samples, but the operating system keeps only recently used parts of
+ * a mapped file in memory and writes modified parts back to the file
+ * instead of swap.  Segments may be larger than available memory,
+ * limited by the space in the directory and the address space.
+ *
+ * Segment sample buffers must not be reallocated or freed by the
+ * caller when samples are stored in a file, use mstl_convertsamples()
+ * to change the sample type.
+ *
+ * A NULL directory disables moving more segments to files.  Not
+ * supported on Windows.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+int
+mstl_spill (MSTraceList *mstl, const char *directory, size_t threshold)
+{
+  if (!mstl)
+    return -1;
+
+  if (!directory)
+  {
+    if (mstl->spill)
+      free (mstl->spill);
+
+    mstl->spill = 0;
     return 0;
+  }
 
-  if (seg->sampletype == 'a' || type == 'a')
+#if defined(LMP_WIN)
+  ms_log (2, "mstl_spill(): Storing samples in files is not supported on this platform\n");
+  return -1;
+#else
+  if (strlen (directory) > sizeof (mstl->spill->directory) - 20)
   {
-    ms_log (2, "mstl_convertsamples: cannot convert ASCII samples to/from numeric type\n");
+    ms_log (2, "mstl_spill(): Directory name is too long: %s\n", directory);
     return -1;
   }
 
-  idata = (int32_t *)seg->datasamples;
-  fdata = (float *)seg->datasamples;
-  ddata = (double *)seg->datasamples;
-
-  /* Convert to 32-bit integers */
-  if (type == 'i')
+  if (!mstl->spill)
   {
-    if (seg->sampletype == 'f') /* Convert floats to integers with simple rounding */
+    if (!(mstl->spill = (struct MSTraceListSpill_s *)calloc (1, sizeof (struct MSTraceListSpill_s))))
     {
-      for (idx = 0; idx < seg->numsamples; idx++)
-      {
-        /* Check for loss of sub-integer */
-        if (!truncate && (fdata[idx] - (int32_t)fdata[idx]) > 0.000001)
-        {
-          ms_log (1, "mstl_convertsamples: Warning, loss of precision when converting floats to integers, loss: %g\n",
-                  (fdata[idx] - (int32_t)fdata[idx]));
-          return -1;
-        }
-
-        idata[idx] = (int32_t) (fdata[idx] + 0.5);
-      }
+      ms_log (2, "mstl_spill(): Cannot allocate memory\n");
+      return -1;
     }
-    else if (seg->sampletype == 'd') /* Convert doubles to integers with simple rounding */
+  }
+
+  strcpy (mstl->spill->directory, directory);
+  mstl->spill->threshold = threshold;
+
+  return 0;
+#endif
+} /* End of mstl_spill() */
+
+/***************************************************************************
+ * mstl_spillmap:
+ *
+ * Make the sample buffer of a MSTraceSeg a mapping of a file with a
+ * size of at least size bytes.  If the samples are in memory a new
+ * file is created in the spill directory and the samples are copied
+ * to it, otherwise the existing file is extended and mapped again.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mstl_spillmap (MSTraceSeg *seg, size_t size, struct MSTraceListSpill_s *spill)
+{
+#if defined(LMP_WIN)
+  return -1;
+#else
+  struct MSTraceSegSpill_s *segspill = seg->spill;
+  char path[540];
+  void *map;
+  int fd;
+
+  /* Create an unlinked file for the samples */
+  if (!segspill)
+  {
+    if (!spill)
+      return -1;
+
+    snprintf (path, sizeof (path), "%s/mstlspill.XXXXXX", spill->directory);
+
+    if ((fd = mkstemp (path)) < 0)
     {
-      for (idx = 0; idx < seg->numsamples; idx++)
-      {
-        /* Check for loss of sub-integer */
-        if (!truncate && (ddata[idx] - (int32_t)ddata[idx]) > 0.000001)
-        {
-          ms_log (1, "mstl_convertsamples: Warning, loss of precision when converting doubles to integers, loss: %g\n",
-                  (ddata[idx] - (int32_t)ddata[idx]));
-          return -1;
-        }
+      ms_log (2, "mstl_spillmap(): Cannot create sample file in %s: %s\n",
+              spill->directory, strerror (errno));
+      return -1;
+    }
 
-        idata[idx] = (int32_t) (ddata[idx] + 0.5);
-      }
+    unlink (path);
 
-      /* Reallocate buffer for reduced size needed */
-      if (!(seg->datasamples = realloc (seg->datasamples, (size_t) (seg->numsamples * sizeof (int32_t)))))
-      {
-        ms_log (2, "mstl_convertsamples: cannot re-allocate buffer for sample conversion\n");
-        return -1;
-      }
+    if (!(segspill = (struct MSTraceSegSpill_s *)malloc (sizeof (struct MSTraceSegSpill_s))))
+    {
+      close (fd);
+      return -1;
     }
 
-    seg->sampletype = 'i';
-  } /* Done converting to 32-bit integers */
+    segspill->fd = fd;
+  }
 
-  /* Convert to 32-bit floats */
-  else if (type == 'f')
+  if (ftruncate (segspill->fd, (off_t)size))
   {
-    if (seg->sampletype == 'i') /* Convert integers to floats */
+    ms_log (2, "mstl_spillmap(): Cannot extend sample file: %s\n", strerror (errno));
+    goto failed;
+  }
+
+  map = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, segspill->fd, 0);
+
+  if (map == MAP_FAILED)
+  {
+    ms_log (2, "mstl_spillmap(): Cannot map sample file: %s\n", strerror (errno));
+    goto failed;
+  }
+
+  /* Move samples from memory or release the previous mapping */
+  if (seg->datasamples)
+  {
+    if (seg->spill)
     {
-      for (idx     = 0; idx < seg->numsamples; idx++)
-        fdata[idx] = (float)idata[idx];
+      munmap (seg->datasamples, seg->datasize);
     }
-    else if (seg->sampletype == 'd') /* Convert doubles to floats */
+    else
     {
-      for (idx     = 0; idx < seg->numsamples; idx++)
-        fdata[idx] = (float)ddata[idx];
+      memcpy (map, seg->datasamples,
+              (size_t) (seg->numsamples * ms_samplesize (seg->sampletype)));
+      free (seg->datasamples);
+    }
+  }
+
+  seg->datasamples = map;
+  seg->datasize    = size;
+  seg->spill       = segspill;
+
+  return 0;
+
+failed:
+  if (!seg->spill)
+  {
+    close (segspill->fd);
+    free (segspill);
+  }
 
-      /* Reallocate buffer for reduced size needed */
-      if (!(seg->datasamples = realloc (seg->datasamples, (size_t) (seg->numsamples * sizeof (float)))))
+  return -1;
+#endif
+} /* End of mstl_spillmap() */
+
+/***************************************************************************
+ * mstl_freedata:
+ *
+ * Free the sample buffer of a MSTraceSeg, releasing the file if the
+ * samples are stored in a file.
+ ***************************************************************************/
+static void
+mstl_freedata (MSTraceSeg *seg)
+{
+#if !defined(LMP_WIN)
+  if (seg->spill)
+  {
+    if (seg->datasamples)
+      munmap (seg->datasamples, seg->datasize);
+
+    close (seg->spill->fd);
+    free (seg->spill);
+    seg->spill = 0;
+  }
+  else
+#endif
+  if (seg->datasamples)
+  {
+    free (seg->datasamples);
+  }
+
+  seg->datasamples = 0;
+  seg->datasize    = 0;
+} /* End of mstl_freedata() */
+
+/***************************************************************************
+ * mstl_shrink:
+ *
+ * Reduce the data sample buffers of all segments in a MSTraceList to
+ * the size needed for the samples they contain, releasing the spare
+ * capacity reserved when adding samples.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+int
+mstl_shrink (MSTraceList *mstl)
+{
+  MSTraceID *id;
+  MSTraceSeg *seg;
+  void *newdatasamples;
+  size_t size;
+
+  if (!mstl)
+    return -1;
+
+  for (id = mstl->traces; id; id = id->next)
+  {
+    for (seg = id->first; seg; seg = seg->next)
+    {
+      if (!seg->datasamples || seg->numsamples <= 0 || seg->spill)
+        continue;
+
+      size = (size_t) (seg->numsamples * ms_samplesize (seg->sampletype));
+
+      if (size == 0 || size >= seg->datasize)
+        continue;
+
+      if (!(newdatasamples = realloc (seg->datasamples, size)))
       {
-        ms_log (2, "mstl_convertsamples: cannot re-allocate buffer after sample conversion\n");
+        ms_log (2, "mstl_shrink(): Cannot reallocate memory\n");
         return -1;
       }
+
+      seg->datasamples = newdatasamples;
+      seg->datasize    = size;
     }
+  }
 
-    seg->sampletype = 'f';
-  } /* Done converting to 32-bit floats */
+  return 0;
+} /* End of mstl_shrink() */
 
-  /* Convert to 64-bit doubles */
-  else if (type == 'd')
-  {
-    if (!(ddata = (double *)malloc ((size_t) (seg->numsamples * sizeof (double)))))
-    {
-      ms_log (2, "mstl_convertsamples: cannot allocate buffer for sample conversion to doubles\n");
-      return -1;
-    }
+/***************************************************************************
+ * mstl_convertsamples:
+ *
+ * Convert the data samples associated with an MSTraceSeg to another
+ * data type.  ASCII data samples cannot be converted, if supplied or
+ * requested an error will be returned.
+ *
+ * When converting float & double sample types to integer type a
+ * simple rounding is applied by adding 0.5 to the sample value before
+ * converting (truncating) to integer.
+ *
+ * If the truncate flag is true data samples will be truncated to
+ * integers even if loss of sample precision is detected.  If the
+ * truncate flag is false (0) and loss of precision is detected an
+ * error is returned.
+ *
+ * See ms_convertsamples() for details of the conversion.
+ *
+ * Returns 0 on success, and -1 on failure.
+ ***************************************************************************/
+int
+mstl_convertsamples (MSTraceSeg *seg, char type, flag truncate)
+{
+  size_t size;
 
-    if (seg->sampletype == 'i') /* Convert integers to doubles */
-    {
-      for (idx     = 0; idx < seg->numsamples; idx++)
-        ddata[idx] = (double)idata[idx];
+  if (!seg)
+    return -1;
 
-      free (idata);
-    }
-    else if (seg->sampletype == 'f') /* Convert floats to doubles */
-    {
-      for (idx     = 0; idx < seg->numsamples; idx++)
-        ddata[idx] = (double)fdata[idx];
+  /* Samples stored in a file are converted in the mapping, extended if needed */
+  if (seg->spill && seg->sampletype != type)
+  {
+    size = (size_t) (seg->numsamples * ms_samplesize (type));
 
-      free (fdata);
+    if (size > seg->datasize && mstl_spillmap (seg, size, NULL))
+    {
+      ms_log (2, "mstl_convertsamples: cannot extend sample file for conversion\n");
+      return -1;
     }
 
-    seg->datasamples = ddata;
-    seg->sampletype  = 'd';
-  } /* Done converting to 64-bit doubles */
+    return ms_convertsamples (&seg->datasamples, NULL, seg->numsamples,
+                              &seg->sampletype, type, truncate);
+  }
 
-  return 0;
+  return ms_convertsamples (&seg->datasamples, &seg->datasize, seg->numsamples,
+                            &seg->sampletype, type, truncate);
 } /* End of mstl_convertsamples() */
 
 /***************************************************************************
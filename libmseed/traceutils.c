@@ -15,7 +15,60 @@
 
 #include "libmseed.h"
 
+/* Index entry for a trace, time is the start or end time the entries
+ * are sorted by and seq is the position of the trace in the chain */
+typedef struct MSTraceIndexEntry_s
+{
+  MSTrace *mst;
+  hptime_t time;
+  int64_t seq;
+} MSTraceIndexEntry;
+
+/* Index of the traces for a source name */
+typedef struct MSTraceIndexID_s
+{
+  struct MSTraceIndexID_s *next; /* Next ID in hash chain */
+  uint32_t hash;
+  char network[11];
+  char station[11];
+  char location[11];
+  char channel[11];
+  int count;                  /* Number of traces */
+  int max;                    /* Allocated number of entries */
+  MSTraceIndexEntry *byend;   /* Entries sorted by end time */
+  MSTraceIndexEntry *bystart; /* Entries sorted by start time */
+} MSTraceIndexID;
+
+/* Index of the traces in a MSTraceGroup */
+struct MSTraceGroupIndex_s
+{
+  MSTraceIndexID **ids; /* Hash table of IDs */
+  int idslots;          /* Number of hash table slots */
+  int idcount;          /* Number of IDs */
+  int64_t seq;          /* Sequence number of next trace */
+  MSTrace *last;        /* Last trace in chain */
+};
+
 static int mst_groupsort_cmp (MSTrace *mst1, MSTrace *mst2, flag quality);
+static int mst_growdata (MSTrace *mst, size_t size);
+static int mst_pack_int (MSTrace *mst, void (*record_handler) (char *, int, void *),
+                         void *handlerdata, int reclen, flag encoding, flag byteorder,
+                         int64_t *packedsamples, flag flush, flag verbose,
+                         MSRecord *mstemplate, flag reserve);
+static void mst_indexfree (MSTraceGroup *mstg);
+static MSTraceIndexID *mst_indexid (struct MSTraceGroupIndex_s *index, char *network,
+                                    char *station, char *location, char *channel,
+                                    flag create);
+static int mst_indexadd (struct MSTraceGroupIndex_s *index, MSTrace *mst);
+static int mst_indexupdate (struct MSTraceGroupIndex_s *index, MSTrace *mst,
+                            hptime_t oldstart, hptime_t oldend);
+static int mst_indexbound (MSTraceIndexEntry *entries, int count, hptime_t time);
+static MSTrace *mst_indexfindadjacent (struct MSTraceGroupIndex_s *index, flag *whence,
+                                       char dataquality, char *network, char *station,
+                                       char *location, char *channel, double samprate,
+                                       double sampratetol, hptime_t starttime,
+                                       hptime_t endtime, hptime_t hpdelta,
+                                       hptime_t hptimetol, hptime_t nhptimetol);
 
 /***************************************************************************
  * mst_init:
@@ -110,6 +163,8 @@ mst_initgroup (MSTraceGroup *mstg)
       mst_free (&mst);
       mst = next;
     }
+
+    mst_indexfree (mstg);
   }
   else
   {
@@ -150,6 +205,8 @@ mst_freegroup (MSTraceGroup **ppmstg)
       mst = next;
     }
 
+    mst_indexfree (*ppmstg);
+
     free (*ppmstg);
 
     *ppmstg = 0;
@@ -295,6 +352,13 @@ mst_findadjacent (MSTraceGroup *mstg, flag *whence, char dataquality,
 
   nhptimetol = (hptimetol) ? -hptimetol : 0;
 
+  /* Use the trace index if present and checking time tolerance */
+  if (mstg->index && timetol != -2.0)
+    return mst_indexfindadjacent (mstg->index, whence, dataquality,
+                                  network, station, location, channel,
+                                  samprate, sampratetol, starttime, endtime,
+                                  hpdelta, hptimetol, nhptimetol);
+
   mst = mstg->traces;
 
   while (mst)
@@ -465,10 +529,7 @@ mst_addmsr (MSTrace *mst, MSRecord *msr, flag whence)
       return -1;
     }
 
-    mst->datasamples = realloc (mst->datasamples,
-                                (size_t) (mst->numsamples * samplesize + msr->numsamples * samplesize));
-
-    if (mst->datasamples == NULL)
+    if (mst_growdata (mst, (size_t) (mst->numsamples * samplesize + msr->numsamples * samplesize)))
     {
       ms_log (2, "mst_addmsr(): Cannot allocate memory\n");
       return -1;
@@ -568,10 +629,7 @@ mst_addspan (MSTrace *mst, hptime_t starttime, hptime_t endtime,
       return -1;
     }
 
-    mst->datasamples = realloc (mst->datasamples,
-                                (size_t) (mst->numsamples * samplesize + numsamples * samplesize));
-
-    if (mst->datasamples == NULL)
+    if (mst_growdata (mst, (size_t) (mst->numsamples * samplesize + numsamples * samplesize)))
     {
       ms_log (2, "mst_addspan(): Cannot allocate memory\n");
       return -1;
@@ -632,7 +690,8 @@ mst_addspan (MSTrace *mst, hptime_t starttime, hptime_t endtime,
  *
  * Matching traces are found using the mst_findadjacent() routine.  If
  * the dataquality flag is true the data quality bytes must also match
- * otherwise they are ignored.
+ * otherwise they are ignored.  If the group is indexed the index is
+ * updated, see mst_groupindex().
  *
  * Return a pointer to the MSTrace updated or 0 on error.
  ***************************************************************************/
@@ -642,6 +701,8 @@ mst_addmsrtogroup (MSTraceGroup *mstg, MSRecord *msr, flag dataquality,
 {
   MSTrace *mst = 0;
   hptime_t endtime;
+  hptime_t oldstart;
+  hptime_t oldend;
   flag whence;
   char dq;
 
@@ -672,10 +733,19 @@ mst_addmsrtogroup (MSTraceGroup *mstg, MSRecord *msr, flag dataquality,
     if (msr->samplecnt <= 0 || msr->samprate <= 0.0)
       return mst;
 
+    oldstart = mst->starttime;
+    oldend   = mst->endtime;
+
     if (mst_addmsr (mst, msr, whence))
     {
       return 0;
     }
+
+    /* Continue without the index if it cannot be updated */
+    if (mstg->index && mst_indexupdate (mstg->index, mst, oldstart, oldend))
+    {
+      mst_indexfree (mstg);
+    }
   }
   else
   {
@@ -699,21 +769,10 @@ mst_addmsrtogroup (MSTraceGroup *mstg, MSRecord *msr, flag dataquality,
     }
 
     /* Link new MSTrace into the end of the chain */
-    if (!mstg->traces)
+    if (!mst_addtracetogroup (mstg, mst))
     {
-      mstg->traces = mst;
-    }
-    else
-    {
-      MSTrace *lasttrace = mstg->traces;
-
-      while (lasttrace->next)
-        lasttrace = lasttrace->next;
-
-      lasttrace->next = mst;
+      return 0;
     }
-
-    mstg->numtraces++;
   }
 
   return mst;
@@ -740,7 +799,8 @@ mst_addtracetogroup (MSTraceGroup *mstg, MSTrace *mst)
   }
   else
   {
-    lasttrace = mstg->traces;
+    /* The last trace is tracked by the index */
+    lasttrace = (mstg->index) ? mstg->index->last : mstg->traces;
 
     while (lasttrace->next)
       lasttrace = lasttrace->next;
@@ -752,6 +812,10 @@ mst_addtracetogroup (MSTraceGroup *mstg, MSTrace *mst)
 
   mstg->numtraces++;
 
+  /* Continue without the index if it cannot be updated */
+  if (mstg->index && mst_indexadd (mstg->index, mst))
+    mst_indexfree (mstg);
+
   return mst;
 } /* End of mst_addtracetogroup() */
 
@@ -763,7 +827,7 @@ mst_addtracetogroup (MSTraceGroup *mstg, MSTrace *mst)
  * if the trace group was assembled from segments out of time order
  * (e.g. a file of Mini-SEED records not in time order) but forming
  * contiguous time coverage.  The MSTraceGroup will be sorted using
- * mst_groupsort() before healing.
+ * mst_groupsort() and healed in a single pass over the sorted traces.
  *
  * The time tolerance and sample rate tolerance are used to determine
  * if the traces are indeed the same.  If timetol is -1.0 the default
@@ -776,141 +840,159 @@ mst_addtracetogroup (MSTraceGroup *mstg, MSTrace *mst)
 int
 mst_groupheal (MSTraceGroup *mstg, double timetol, double sampratetol)
 {
-  int mergings         = 0;
-  MSTrace *curtrace    = 0;
-  MSTrace *nexttrace   = 0;
-  MSTrace *searchtrace = 0;
-  MSTrace *prevtrace   = 0;
-  int8_t merged        = 0;
-  double postgap, pregap, delta;
+  int mergings       = 0;
+  MSTrace *curtrace  = 0;
+  MSTrace *prevtrace = 0;
+  MSTrace *runtrace  = 0;
+  MSTrace **open     = 0;
+  MSTrace **newopen;
+  int openmax        = 0;
+  int opencount      = 0;
+  int idx, keep;
+  int8_t merged;
+  flag indexed;
+  double postgap, pregap, delta, tolerance;
 
   if (!mstg)
     return -1;
 
-  /* Sort MSTraceGroup before any healing */
-  if (mst_groupsort (mstg, 1))
+  /* Drop any index while traces are merged, rebuilt when done */
+  indexed = (mstg->index) ? 1 : 0;
+  mst_indexfree (mstg);
+
+  /* Sort MSTraceGroup by source name without quality and time, all
+   * candidates for merging are then adjacent in the trace chain. */
+  if (mst_groupsort (mstg, 0))
     return -1;
 
+  /* Sweep through the sorted traces, keeping a list of open traces of
+   * the current source name that later traces may be merged with.
+   * Traces are removed from the open list when they end before the
+   * start of the current trace by more than the tolerance, as no later
+   * trace can be merged with them. */
   curtrace = mstg->traces;
 
   while (curtrace)
   {
-    nexttrace = mstg->traces;
-    prevtrace = mstg->traces;
-
-    while (nexttrace)
+    /* Start a new list of open traces for each source name */
+    if (!runtrace ||
+        strcmp (curtrace->network, runtrace->network) ||
+        strcmp (curtrace->station, runtrace->station) ||
+        strcmp (curtrace->location, runtrace->location) ||
+        strcmp (curtrace->channel, runtrace->channel))
     {
-      searchtrace = nexttrace;
-      nexttrace   = searchtrace->next;
-
-      /* Do not process the same MSTrace we are trying to match */
-      if (searchtrace == curtrace)
-      {
-        prevtrace = searchtrace;
-        continue;
-      }
+      runtrace  = curtrace;
+      opencount = 0;
+    }
 
-      /* Check if this trace matches the curtrace */
-      if (strcmp (searchtrace->network, curtrace->network) ||
-          strcmp (searchtrace->station, curtrace->station) ||
-          strcmp (searchtrace->location, curtrace->location) ||
-          strcmp (searchtrace->channel, curtrace->channel))
-      {
-        prevtrace = searchtrace;
-        continue;
-      }
+    merged = 0;
+    keep   = 0;
 
+    for (idx = 0; idx < opencount; idx++)
+    {
       /* Perform default samprate tolerance check if requested */
       if (sampratetol == -1.0)
       {
-        if (!MS_ISRATETOLERABLE (searchtrace->samprate, curtrace->samprate))
+        if (!MS_ISRATETOLERABLE (open[idx]->samprate, curtrace->samprate))
         {
-          prevtrace = searchtrace;
+          open[keep++] = open[idx];
           continue;
         }
       }
       /* Otherwise check against the specified sample rates tolerance */
-      else if (ms_dabs (searchtrace->samprate - curtrace->samprate) > sampratetol)
+      else if (ms_dabs (open[idx]->samprate - curtrace->samprate) > sampratetol)
       {
-        prevtrace = searchtrace;
+        open[keep++] = open[idx];
         continue;
       }
 
-      merged = 0;
+      /* post/pregap are negative when curtrace overlaps the open
+         trace and positive when there is a time gap. */
+      delta = (open[idx]->samprate) ? (1.0 / open[idx]->samprate) : 0.0;
 
-      /* post/pregap are negative when searchtrace overlaps curtrace
-         segment and positive when there is a time gap. */
-      delta = (curtrace->samprate) ? (1.0 / curtrace->samprate) : 0.0;
+      postgap = ((double)(curtrace->starttime - open[idx]->endtime) / HPTMODULUS) - delta;
 
-      postgap = ((double)(searchtrace->starttime - curtrace->endtime) / HPTMODULUS) - delta;
-
-      pregap = ((double)(curtrace->starttime - searchtrace->endtime) / HPTMODULUS) - delta;
+      pregap = ((double)(open[idx]->starttime - curtrace->endtime) / HPTMODULUS) - delta;
 
       /* Calculate default time tolerance (1/2 sample period) if needed */
-      if (timetol == -1.0)
-        timetol = 0.5 * delta;
+      tolerance = (timetol == -1.0) ? 0.5 * delta : timetol;
 
-      /* Fits right at the end of curtrace */
-      if (ms_dabs (postgap) <= timetol)
+      /* Merge with the first open trace that curtrace fits at the end
+       * or beginning of, as long as curtrace has not been merged */
+      if (!merged && (ms_dabs (postgap) <= tolerance || ms_dabs (pregap) <= tolerance))
       {
-        /* Merge searchtrace with curtrace */
-        mst_addspan (curtrace, searchtrace->starttime, searchtrace->endtime,
-                     searchtrace->datasamples, searchtrace->numsamples,
-                     searchtrace->sampletype, 1);
+        mst_addspan (open[idx], curtrace->starttime, curtrace->endtime,
+                     curtrace->datasamples, curtrace->numsamples,
+                     curtrace->sampletype, (ms_dabs (postgap) <= tolerance) ? 1 : 2);
 
         /* If no data is present, make sure sample count is updated */
-        if (searchtrace->numsamples <= 0)
-          curtrace->samplecnt += searchtrace->samplecnt;
+        if (curtrace->numsamples <= 0)
+          open[idx]->samplecnt += curtrace->samplecnt;
 
         /* If qualities do not match reset the indicator */
-        if (curtrace->dataquality != searchtrace->dataquality)
-          curtrace->dataquality = 0;
+        if (open[idx]->dataquality != curtrace->dataquality)
+          open[idx]->dataquality = 0;
 
         merged = 1;
       }
-
-      /* Fits right at the beginning of curtrace */
-      else if (ms_dabs (pregap) <= timetol)
+      /* Close traces that end before curtrace by more than the tolerance */
+      else if (postgap > tolerance)
       {
-        /* Merge searchtrace with curtrace */
-        mst_addspan (curtrace, searchtrace->starttime, searchtrace->endtime,
-                     searchtrace->datasamples, searchtrace->numsamples,
-                     searchtrace->sampletype, 2);
+        continue;
+      }
 
-        /* If no data is present, make sure sample count is updated */
-        if (searchtrace->numsamples <= 0)
-          curtrace->samplecnt += searchtrace->samplecnt;
+      open[keep++] = open[idx];
+    }
 
-        /* If qualities do not match reset the indicator */
-        if (curtrace->dataquality != searchtrace->dataquality)
-          curtrace->dataquality = 0;
+    opencount = keep;
 
-        merged = 1;
-      }
+    /* Remove a merged curtrace from the chain, otherwise add it to the open list */
+    if (merged)
+    {
+      if (prevtrace)
+        prevtrace->next = curtrace->next;
+      else
+        mstg->traces = curtrace->next;
 
-      /* If searchtrace was merged with curtrace remove it from the chain */
-      if (merged)
-      {
-        /* Re-link trace chain and free searchtrace */
-        if (searchtrace == mstg->traces)
-          mstg->traces = nexttrace;
-        else
-          prevtrace->next = nexttrace;
+      mst_free (&curtrace);
+      curtrace = (prevtrace) ? prevtrace->next : mstg->traces;
+
+      mstg->numtraces--;
+      mergings++;
+      continue;
+    }
 
-        mst_free (&searchtrace);
+    if (opencount >= openmax)
+    {
+      openmax = (openmax) ? openmax * 2 : 16;
 
-        mstg->numtraces--;
-        mergings++;
-      }
-      else
+      if (!(newopen = (MSTrace **)realloc (open, openmax * sizeof (MSTrace *))))
       {
-        prevtrace = searchtrace;
+        ms_log (2, "mst_groupheal(): Cannot allocate memory\n");
+        if (open)
+          free (open);
+        return -1;
       }
+
+      open = newopen;
     }
 
-    curtrace = curtrace->next;
+    open[opencount++] = curtrace;
+
+    prevtrace = curtrace;
+    curtrace  = curtrace->next;
   }
 
+  if (open)
+    free (open);
+
+  /* Sort MSTraceGroup including quality as the final order */
+  if (mst_groupsort (mstg, 1))
+    return -1;
+
+  if (indexed && mst_groupindex (mstg, 1))
+    return -1;
+
   return mergings;
 } /* End of mst_groupheal() */
 
@@ -1016,6 +1098,10 @@ mst_groupsort (MSTraceGroup *mstg, flag quality)
     {
       mstg->traces = top;
 
+      /* Rebuild index for the new trace order */
+      if (mstg->index)
+        return mst_groupindex (mstg, 1);
+
       return 0;
     }
 
@@ -1084,145 +1170,509 @@ mst_groupsort_cmp (MSTrace *mst1, MSTrace *mst2, flag quality)
 } /* End of mst_groupsort_cmp() */
 
 /***************************************************************************
- * mst_convertsamples:
+ * mst_groupshrink:
  *
- * Convert the data samples associated with an MSTrace to another data
- * type.  ASCII data samples cannot be converted, if supplied or
- * requested an error will be returned.
+ * Reduce the data sample buffers of all MSTraces in a MSTraceGroup to
+ * the size needed for the samples they contain, releasing the spare
+ * capacity reserved when adding samples.
  *
- * When converting float & double sample types to integer type a
- * simple rounding is applied by adding 0.5 to the sample value before
- * converting (truncating) to integer.
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+int
+mst_groupshrink (MSTraceGroup *mstg)
+{
+  MSTrace *mst;
+  void *newdatasamples;
+  size_t size;
+
+  if (!mstg)
+    return -1;
+
+  for (mst = mstg->traces; mst; mst = mst->next)
+  {
+    if (!mst->datasamples || mst->numsamples <= 0)
+      continue;
+
+    size = (size_t) (mst->numsamples * ms_samplesize (mst->sampletype));
+
+    if (size == 0 || size >= mst->datasize)
+      continue;
+
+    if (!(newdatasamples = realloc (mst->datasamples, size)))
+    {
+      ms_log (2, "mst_groupshrink(): Cannot reallocate memory\n");
+      return -1;
+    }
+
+    mst->datasamples = newdatasamples;
+    mst->datasize    = size;
+  }
+
+  return 0;
+} /* End of mst_groupshrink() */
+
+/***************************************************************************
+ * mst_growdata:
  *
- * If the truncate flag is true data samples will be truncated to
- * integers even if loss of sample precision is detected.  If the
- * truncate flag is false (0) and loss of precision is detected an
- * error is returned.
+ * Make sure the data sample buffer of a MSTrace is at least size
+ * bytes.  The buffer capacity is doubled when it is too small so that
+ * adding many records to a trace is done in linear time instead of
+ * reallocating and copying the buffer for every record.
  *
- * Returns 0 on success, and -1 on failure.
+ * A buffer with a datasize of 0 was not allocated by libmseed, for
+ * example set directly by the caller, and its capacity is unknown.
+ * Such a buffer is reallocated to exactly the size requested.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mst_growdata (MSTrace *mst, size_t size)
+{
+  void *newdatasamples;
+  size_t newsize;
+
+  if (mst->datasamples && mst->datasize && size <= mst->datasize)
+    return 0;
+
+  newsize = (mst->datasamples) ? mst->datasize * 2 : 0;
+
+  if (newsize < size)
+    newsize = size;
+
+  if (!(newdatasamples = realloc (mst->datasamples, newsize)))
+    return -1;
+
+  mst->datasamples = newdatasamples;
+  mst->datasize    = newsize;
+
+  return 0;
+} /* End of mst_growdata() */
+
+/***************************************************************************
+ * mst_groupindex:
+ *
+ * Build (or rebuild) an index of the traces in a MSTraceGroup if the
+ * index flag is true, otherwise free any existing index.
+ *
+ * The index contains a hash table of source names and, for each
+ * source name, the traces sorted by start and end times.  When a
+ * group is indexed mst_findadjacent() searches the index and
+ * mst_addmsrtogroup() and mst_addtracetogroup() keep it updated, so
+ * the time needed to add a record does not grow with the number of
+ * traces.  The index is rebuilt by mst_groupsort(), mst_groupheal()
+ * and mst_packgroup().
+ *
+ * The index must be rebuilt, or freed, if traces are otherwise added,
+ * removed or changed in the group.
+ *
+ * Return 0 on success and -1 on error.
  ***************************************************************************/
 int
-mst_convertsamples (MSTrace *mst, char type, flag truncate)
+mst_groupindex (MSTraceGroup *mstg, flag index)
 {
-  int32_t *idata;
-  float *fdata;
-  double *ddata;
-  int64_t idx;
+  MSTrace *mst;
 
-  if (!mst)
+  if (!mstg)
     return -1;
 
-  /* No conversion necessary, report success */
-  if (mst->sampletype == type)
+  mst_indexfree (mstg);
+
+  if (!index)
     return 0;
 
-  if (mst->sampletype == 'a' || type == 'a')
+  if (!(mstg->index = (struct MSTraceGroupIndex_s *)calloc (1, sizeof (struct MSTraceGroupIndex_s))))
   {
-    ms_log (2, "mst_convertsamples: cannot convert ASCII samples to/from numeric type\n");
+    ms_log (2, "mst_groupindex(): Cannot allocate memory\n");
     return -1;
   }
 
-  idata = (int32_t *)mst->datasamples;
-  fdata = (float *)mst->datasamples;
-  ddata = (double *)mst->datasamples;
-
-  /* Convert to 32-bit integers */
-  if (type == 'i')
+  for (mst = mstg->traces; mst; mst = mst->next)
   {
-    if (mst->sampletype == 'f') /* Convert floats to integers with simple rounding */
+    if (mst_indexadd (mstg->index, mst))
     {
-      for (idx = 0; idx < mst->numsamples; idx++)
-      {
-        /* Check for loss of sub-integer */
-        if (!truncate && (fdata[idx] - (int32_t)fdata[idx]) > 0.000001)
-        {
-          ms_log (1, "mst_convertsamples: Warning, loss of precision when converting floats to integers, loss: %g\n",
-                  (fdata[idx] - (int32_t)fdata[idx]));
-          return -1;
-        }
-
-        idata[idx] = (int32_t) (fdata[idx] + 0.5);
-      }
+      ms_log (2, "mst_groupindex(): Cannot add trace to index\n");
+      mst_indexfree (mstg);
+      return -1;
     }
-    else if (mst->sampletype == 'd') /* Convert doubles to integers with simple rounding */
+  }
+
+  return 0;
+} /* End of mst_groupindex() */
+
+/***************************************************************************
+ * mst_indexfree:
+ *
+ * Free the index of a MSTraceGroup if present.
+ ***************************************************************************/
+static void
+mst_indexfree (MSTraceGroup *mstg)
+{
+  MSTraceIndexID *id;
+  MSTraceIndexID *next;
+  int slot;
+
+  if (!mstg || !mstg->index)
+    return;
+
+  for (slot = 0; slot < mstg->index->idslots; slot++)
+  {
+    for (id = mstg->index->ids[slot]; id; id = next)
     {
-      for (idx = 0; idx < mst->numsamples; idx++)
-      {
-        /* Check for loss of sub-integer */
-        if (!truncate && (ddata[idx] - (int32_t)ddata[idx]) > 0.000001)
-        {
-          ms_log (1, "mst_convertsamples: Warning, loss of precision when converting doubles to integers, loss: %g\n",
-                  (ddata[idx] - (int32_t)ddata[idx]));
-          return -1;
-        }
+      next = id->next;
 
-        idata[idx] = (int32_t) (ddata[idx] + 0.5);
-      }
+      if (id->byend)
+        free (id->byend);
+      if (id->bystart)
+        free (id->bystart);
 
-      /* Reallocate buffer for reduced size needed */
-      if (!(mst->datasamples = realloc (mst->datasamples, (size_t) (mst->numsamples * sizeof (int32_t)))))
-      {
-        ms_log (2, "mst_convertsamples: cannot re-allocate buffer for sample conversion\n");
-        return -1;
-      }
+      free (id);
     }
+  }
+
+  if (mstg->index->ids)
+    free (mstg->index->ids);
+
+  free (mstg->index);
+  mstg->index = 0;
+} /* End of mst_indexfree() */
+
+/***************************************************************************
+ * mst_indexid:
+ *
+ * Find the index for a source name, if not found and create is true
+ * a new entry is added.  The hash table is doubled in size when the
+ * number of IDs reaches the number of slots.
+ *
+ * Return a pointer to the MSTraceIndexID or 0 if not found or on error.
+ ***************************************************************************/
+static MSTraceIndexID *
+mst_indexid (struct MSTraceGroupIndex_s *index, char *network, char *station,
+             char *location, char *channel, flag create)
+{
+  MSTraceIndexID **newids;
+  MSTraceIndexID *id;
+  MSTraceIndexID *next;
+  char *fields[4];
+  char *cp;
+  uint32_t hash = 2166136261U;
+  int newslots;
+  int slot;
+  int idx;
 
-    mst->sampletype = 'i';
-  } /* Done converting to 32-bit integers */
+  /* FNV-1a hash of source name fields, separated by 0 bytes */
+  fields[0] = network;
+  fields[1] = station;
+  fields[2] = location;
+  fields[3] = channel;
 
-  /* Convert to 32-bit floats */
-  else if (type == 'f')
+  for (idx = 0; idx < 4; idx++)
   {
-    if (mst->sampletype == 'i') /* Convert integers to floats */
+    for (cp = fields[idx]; *cp; cp++)
     {
-      for (idx     = 0; idx < mst->numsamples; idx++)
-        fdata[idx] = (float)idata[idx];
+      hash ^= (uint8_t)*cp;
+      hash *= 16777619U;
     }
-    else if (mst->sampletype == 'd') /* Convert doubles to floats */
+
+    hash *= 16777619U;
+  }
+
+  if (index->idslots)
+  {
+    for (id = index->ids[hash % index->idslots]; id; id = id->next)
     {
-      for (idx     = 0; idx < mst->numsamples; idx++)
-        fdata[idx] = (float)ddata[idx];
+      if (id->hash == hash &&
+          !strcmp (id->network, network) &&
+          !strcmp (id->station, station) &&
+          !strcmp (id->location, location) &&
+          !strcmp (id->channel, channel))
+        return id;
+    }
+  }
+
+  if (!create)
+    return 0;
+
+  /* Grow the hash table, moving all IDs to new slots */
+  if (index->idcount >= index->idslots)
+  {
+    newslots = (index->idslots) ? index->idslots * 2 : 64;
+
+    if (!(newids = (MSTraceIndexID **)calloc (newslots, sizeof (MSTraceIndexID *))))
+      return 0;
 
-      /* Reallocate buffer for reduced size needed */
-      if (!(mst->datasamples = realloc (mst->datasamples, (size_t) (mst->numsamples * sizeof (float)))))
+    for (slot = 0; slot < index->idslots; slot++)
+    {
+      for (id = index->ids[slot]; id; id = next)
       {
-        ms_log (2, "mst_convertsamples: cannot re-allocate buffer after sample conversion\n");
-        return -1;
+        next                       = id->next;
+        id->next                   = newids[id->hash % newslots];
+        newids[id->hash % newslots] = id;
       }
     }
 
-    mst->sampletype = 'f';
-  } /* Done converting to 32-bit floats */
+    if (index->ids)
+      free (index->ids);
 
-  /* Convert to 64-bit doubles */
-  else if (type == 'd')
+    index->ids     = newids;
+    index->idslots = newslots;
+  }
+
+  if (!(id = (MSTraceIndexID *)calloc (1, sizeof (MSTraceIndexID))))
+    return 0;
+
+  id->hash = hash;
+  strncpy (id->network, network, sizeof (id->network) - 1);
+  strncpy (id->station, station, sizeof (id->station) - 1);
+  strncpy (id->location, location, sizeof (id->location) - 1);
+  strncpy (id->channel, channel, sizeof (id->channel) - 1);
+
+  slot              = hash % index->idslots;
+  id->next          = index->ids[slot];
+  index->ids[slot]  = id;
+  index->idcount++;
+
+  return id;
+} /* End of mst_indexid() */
+
+/***************************************************************************
+ * mst_indexbound:
+ *
+ * Find the first of the sorted index entries with a time greater than
+ * or equal to the specified time.
+ *
+ * Return the position of the entry, count if all entries are earlier.
+ ***************************************************************************/
+static int
+mst_indexbound (MSTraceIndexEntry *entries, int count, hptime_t time)
+{
+  int low  = 0;
+  int high = count;
+  int mid;
+
+  while (low < high)
   {
-    if (!(ddata = (double *)malloc ((size_t) (mst->numsamples * sizeof (double)))))
-    {
-      ms_log (2, "mst_convertsamples: cannot allocate buffer for sample conversion to doubles\n");
+    mid = low + (high - low) / 2;
+
+    if (entries[mid].time < time)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  return low;
+} /* End of mst_indexbound() */
+
+/***************************************************************************
+ * mst_indexadd:
+ *
+ * Add a trace to the index as the last trace in the chain.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mst_indexadd (struct MSTraceGroupIndex_s *index, MSTrace *mst)
+{
+  MSTraceIndexEntry *newentries;
+  MSTraceIndexID *id;
+  int newmax;
+  int pos;
+
+  if (!(id = mst_indexid (index, mst->network, mst->station,
+                          mst->location, mst->channel, 1)))
+    return -1;
+
+  if (id->count >= id->max)
+  {
+    newmax = (id->max) ? id->max * 2 : 4;
+
+    if (!(newentries = (MSTraceIndexEntry *)realloc (id->byend, newmax * sizeof (MSTraceIndexEntry))))
       return -1;
-    }
+    id->byend = newentries;
 
-    if (mst->sampletype == 'i') /* Convert integers to doubles */
-    {
-      for (idx     = 0; idx < mst->numsamples; idx++)
-        ddata[idx] = (double)idata[idx];
+    if (!(newentries = (MSTraceIndexEntry *)realloc (id->bystart, newmax * sizeof (MSTraceIndexEntry))))
+      return -1;
+    id->bystart = newentries;
 
-      free (idata);
-    }
-    else if (mst->sampletype == 'f') /* Convert floats to doubles */
+    id->max = newmax;
+  }
+
+  /* Insert after any entries with the same time */
+  pos = mst_indexbound (id->byend, id->count, mst->endtime + 1);
+  memmove (&id->byend[pos + 1], &id->byend[pos], (id->count - pos) * sizeof (MSTraceIndexEntry));
+  id->byend[pos].mst  = mst;
+  id->byend[pos].time = mst->endtime;
+  id->byend[pos].seq  = index->seq;
+
+  pos = mst_indexbound (id->bystart, id->count, mst->starttime + 1);
+  memmove (&id->bystart[pos + 1], &id->bystart[pos], (id->count - pos) * sizeof (MSTraceIndexEntry));
+  id->bystart[pos].mst  = mst;
+  id->bystart[pos].time = mst->starttime;
+  id->bystart[pos].seq  = index->seq;
+
+  id->count++;
+  index->seq++;
+  index->last = mst;
+
+  return 0;
+} /* End of mst_indexadd() */
+
+/***************************************************************************
+ * mst_indexupdate:
+ *
+ * Update the position of a trace in the index after the start or end
+ * time has changed from the specified old times.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mst_indexupdate (struct MSTraceGroupIndex_s *index, MSTrace *mst,
+                 hptime_t oldstart, hptime_t oldend)
+{
+  MSTraceIndexEntry *entries;
+  MSTraceIndexEntry entry;
+  MSTraceIndexID *id;
+  hptime_t oldtime;
+  hptime_t newtime;
+  int sorted;
+  int pos;
+  int newpos;
+
+  if (!(id = mst_indexid (index, mst->network, mst->station,
+                          mst->location, mst->channel, 0)))
+    return -1;
+
+  for (sorted = 0; sorted < 2; sorted++)
+  {
+    entries = (sorted) ? id->bystart : id->byend;
+    oldtime = (sorted) ? oldstart : oldend;
+    newtime = (sorted) ? mst->starttime : mst->endtime;
+
+    if (oldtime == newtime)
+      continue;
+
+    /* Find current entry for the trace */
+    pos = mst_indexbound (entries, id->count, oldtime);
+    while (pos < id->count && entries[pos].mst != mst)
+      pos++;
+
+    if (pos >= id->count)
+      return -1;
+
+    entry      = entries[pos];
+    entry.time = newtime;
+
+    /* Move entry to the new position */
+    memmove (&entries[pos], &entries[pos + 1], (id->count - pos - 1) * sizeof (MSTraceIndexEntry));
+    newpos = mst_indexbound (entries, id->count - 1, newtime + 1);
+    memmove (&entries[newpos + 1], &entries[newpos], (id->count - 1 - newpos) * sizeof (MSTraceIndexEntry));
+    entries[newpos] = entry;
+  }
+
+  return 0;
+} /* End of mst_indexupdate() */
+
+/***************************************************************************
+ * mst_indexfindadjacent:
+ *
+ * Find a trace adjacent to a time span using the index, otherwise the
+ * same as mst_findadjacent() and called from it with the sample
+ * period and time tolerances calculated.
+ *
+ * Traces with end times in the tolerance window before the start of
+ * the span and traces with start times in the tolerance window after
+ * the end of the span are candidates.  Of matching candidates the
+ * trace first in the chain is returned to match the search order of
+ * the unindexed search, preferring the end of a trace.
+ *
+ * Return a pointer a matching MSTrace and set the 'whence' flag
+ * otherwise 0 if no match found.
+ ***************************************************************************/
+static MSTrace *
+mst_indexfindadjacent (struct MSTraceGroupIndex_s *index, flag *whence,
+                       char dataquality, char *network, char *station,
+                       char *location, char *channel, double samprate,
+                       double sampratetol, hptime_t starttime,
+                       hptime_t endtime, hptime_t hpdelta,
+                       hptime_t hptimetol, hptime_t nhptimetol)
+{
+  MSTraceIndexEntry *entries;
+  MSTraceIndexEntry *match = 0;
+  MSTraceIndexID *id;
+  hptime_t target;
+  int sorted;
+  int pos;
+
+  if (!(id = mst_indexid (index, network, station, location, channel, 0)))
+    return 0;
+
+  for (sorted = 0; sorted < 2; sorted++)
+  {
+    /* End times where the span fits after, or start times where it fits before */
+    entries = (sorted) ? id->bystart : id->byend;
+    target  = (sorted) ? endtime + hpdelta : starttime - hpdelta;
+
+    for (pos = mst_indexbound (entries, id->count, target + nhptimetol);
+         pos < id->count && entries[pos].time <= target + hptimetol;
+         pos++)
     {
-      for (idx     = 0; idx < mst->numsamples; idx++)
-        ddata[idx] = (double)fdata[idx];
+      /* Only an earlier trace in the chain can be a better match */
+      if (match && entries[pos].seq >= match->seq)
+        continue;
+
+      /* Perform samprate tolerance check if requested */
+      if (sampratetol != -2.0)
+      {
+        /* Perform default samprate tolerance check if requested */
+        if (sampratetol == -1.0)
+        {
+          if (!MS_ISRATETOLERABLE (samprate, entries[pos].mst->samprate))
+            continue;
+        }
+        /* Otherwise check against the specified sample rate tolerance */
+        else if (ms_dabs (samprate - entries[pos].mst->samprate) > sampratetol)
+          continue;
+      }
+
+      /* Compare data qualities */
+      if (dataquality && dataquality != entries[pos].mst->dataquality)
+        continue;
 
-      free (fdata);
+      match   = &entries[pos];
+      *whence = (sorted) ? 2 : 1;
     }
+  }
 
-    mst->datasamples = ddata;
-    mst->sampletype  = 'd';
-  } /* Done converting to 64-bit doubles */
+  return (match) ? match->mst : 0;
+} /* End of mst_indexfindadjacent() */
 
-  return 0;
+/***************************************************************************
+ * mst_convertsamples:
+ *
+ * Convert the data samples associated with an MSTrace to another data
+ * type.  ASCII data samples cannot be converted, if supplied or
+ * requested an error will be returned.
+ *
+ * When converting float & double sample types to integer type a
+ * simple rounding is applied by adding 0.5 to the sample value before
+ * converting (truncating) to integer.
+ *
+ * If the truncate flag is true data samples will be truncated to
+ * integers even if loss of sample precision is detected.  If the
+ * truncate flag is false (0) and loss of precision is detected an
+ * error is returned.
+ *
+ * See ms_convertsamples() for details of the conversion.
+ *
+ * Returns 0 on success, and -1 on failure.
+ ***************************************************************************/
+int
+mst_convertsamples (MSTrace *mst, char type, flag truncate)
+{
+  if (!mst)
+    return -1;
+
+  return ms_convertsamples (&mst->datasamples, &mst->datasize, mst->numsamples,
+                            &mst->sampletype, type, truncate);
 } /* End of mst_convertsamples() */
 
 /***************************************************************************
@@ -1646,6 +2096,9 @@ mst_printgaplist (MSTraceGroup *mstg, flag timeformat,
  * rate, datasamples, numsamples and sampletype values from the
  * template will be preserved.
  *
+ * The data sample buffer is reduced to the size of the samples that
+ * remain unpacked.
+ *
  * Returns the number of records created on success and -1 on error.
  ***************************************************************************/
 int
@@ -1654,6 +2107,47 @@ mst_pack (MSTrace *mst, void (*record_handler) (char *, int, void *),
           int64_t *packedsamples, flag flush, flag verbose,
           MSRecord *mstemplate)
 {
+  return mst_pack_int (mst, record_handler, handlerdata, reclen, encoding,
+                       byteorder, packedsamples, flush, verbose, mstemplate, 0);
+} /* End of mst_pack() */
+
+/***************************************************************************
+ * mst_pack_reserve:
+ *
+ * Identical to mst_pack() except that the capacity of the data sample
+ * buffer is kept after packing for samples added to the trace later.
+ * Intended for traces that are repeatedly extended and packed, the
+ * spare capacity can be released with mst_groupshrink().
+ *
+ * Returns the number of records created on success and -1 on error.
+ ***************************************************************************/
+int
+mst_pack_reserve (MSTrace *mst, void (*record_handler) (char *, int, void *),
+                  void *handlerdata, int reclen, flag encoding, flag byteorder,
+                  int64_t *packedsamples, flag flush, flag verbose,
+                  MSRecord *mstemplate)
+{
+  return mst_pack_int (mst, record_handler, handlerdata, reclen, encoding,
+                       byteorder, packedsamples, flush, verbose, mstemplate, 1);
+} /* End of mst_pack_reserve() */
+
+/***************************************************************************
+ * mst_pack_int:
+ *
+ * Pack MSTrace data into Mini-SEED records as described for
+ * mst_pack().  If reserve is true the capacity of the data sample
+ * buffer is kept, otherwise the buffer is reduced to the size of the
+ * remaining samples.
+ *
+ * Returns the number of records created on success and -1 on error.
+ ***************************************************************************/
+static int
+mst_pack_int (MSTrace *mst, void (*record_handler) (char *, int, void *),
+              void *handlerdata, int reclen, flag encoding, flag byteorder,
+              int64_t *packedsamples, flag flush, flag verbose,
+              MSRecord *mstemplate, flag reserve)
+{
+  void *newdatasamples;
   MSRecord *msr;
   char srcname[50];
   int trpackedrecords     = 0;
@@ -1753,12 +2247,17 @@ mst_pack (MSTrace *mst, void (*record_handler) (char *, int, void *),
                (char *)mst->datasamples + (trpackedsamples * samplesize),
                (size_t)bufsize);
 
-      mst->datasamples = realloc (mst->datasamples, (size_t)bufsize);
-
-      if (mst->datasamples == NULL)
+      /* Keep the buffer capacity for samples added after packing if requested */
+      if (!reserve)
       {
-        ms_log (2, "mst_pack(): Cannot (re)allocate datasamples buffer\n");
-        return -1;
+        if (!(newdatasamples = realloc (mst->datasamples, (size_t)bufsize)))
+        {
+          ms_log (2, "mst_pack(): Cannot (re)allocate datasamples buffer\n");
+          return -1;
+        }
+
+        mst->datasamples = newdatasamples;
+        mst->datasize    = (size_t)bufsize;
       }
     }
     else
@@ -1766,6 +2265,7 @@ mst_pack (MSTrace *mst, void (*record_handler) (char *, int, void *),
       if (mst->datasamples)
         free (mst->datasamples);
       mst->datasamples = 0;
+      mst->datasize    = 0;
     }
 
     mst->samplecnt -= trpackedsamples;
@@ -1793,7 +2293,7 @@ mst_pack (MSTrace *mst, void (*record_handler) (char *, int, void *),
     *packedsamples = trpackedsamples;
 
   return trpackedrecords;
-} /* End of mst_pack() */
+} /* End of mst_pack_int() */
 
 /***************************************************************************
  * mst_packgroup:
@@ -1850,5 +2350,9 @@ mst_packgroup (MSTraceGroup *mstg, void (*record_handler) (char *, int, void *),
     mst = mst->next;
   }
 
+  /* Packing moves trace start times, rebuild any index */
+  if (mstg->index)
+    mst_groupindex (mstg, 1);
+
   return trpackedrecords;
 } /* End of mst_packgroup() */
@@ -0,0 +1,423 @@
+/***************************************************************************
+ * control.c
+ *
+ * Local control socket routines.  A Unix domain stream socket is
+ * used to accept commands at runtime, each client connection carries
+ * a single line command and receives a text reply before the
+ * connection is closed by the server side.  Client I/O is buffered
+ * and non-blocking so clients never stall the transfer.
+ *
+ * A command session from a shell looks like:
+ *   echo status | nc -U <path>
+ *
+ * modified: 2026.291
+ ***************************************************************************/
+
+#include "control.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Maximum number of clients connected at the same time */
+#define CTL_MAXCLIENTS 8
+
+/* Size of command and reply buffers for each client */
+#define CTL_INSIZE 256
+#define CTL_OUTSIZE 8192
+
+/* Clients not sending a command or reading the reply within this
+ * many seconds are disconnected */
+#define CTL_CLIENT_TIMEOUT 10
+
+/* States of a client connection */
+#define CTL_FREE 0    /* Slot not in use */
+#define CTL_READING 1 /* Reading command */
+#define CTL_READY 2   /* Command complete, not yet returned */
+#define CTL_BUSY 3    /* Command returned, replies being added */
+#define CTL_DONE 4    /* Sending replies before closing */
+
+/* Buffered non-blocking client connection */
+typedef struct CtlClient_s
+{
+  int fd;
+  int state;
+  time_t start;          /* Time of connection */
+  int inlen;             /* Length of command read */
+  char in[CTL_INSIZE];   /* Command buffer */
+  int outlen;            /* Length of replies */
+  int outsent;           /* Length of replies sent */
+  char out[CTL_OUTSIZE]; /* Reply buffer */
+} CtlClient;
+
+static CtlClient clients[CTL_MAXCLIENTS];
+
+static void ctl_drop (CtlClient *client);
+static int ctl_flush (CtlClient *client);
+static void ctl_read (CtlClient *client);
+
+/***************************************************************************
+ * ctl_open:
+ *
+ * Create a non-blocking listening socket at the specified path, any
+ * existing socket file at the path is removed first.
+ *
+ * Return socket descriptor on success and -1 on error.
+ ***************************************************************************/
+int
+ctl_open (const char *path)
+{
+  struct sockaddr_un addr;
+  int ctlfd;
+
+  if (!path || strlen (path) >= sizeof (addr.sun_path))
+  {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  if ((ctlfd = socket (AF_UNIX, SOCK_STREAM, 0)) < 0)
+    return -1;
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, path);
+
+  /* Remove stale socket from a previous execution */
+  unlink (path);
+
+  if (bind (ctlfd, (struct sockaddr *)&addr, sizeof (addr)) ||
+      listen (ctlfd, 5) ||
+      fcntl (ctlfd, F_SETFL, fcntl (ctlfd, F_GETFL, 0) | O_NONBLOCK) == -1)
+  {
+    close (ctlfd);
+    return -1;
+  }
+
+  return ctlfd;
+} /* End of ctl_open() */
+
+/***************************************************************************
+ * ctl_poll:
+ *
+ * Wait up to timeout milliseconds for control socket activity, accept
+ * new clients, read their commands and send pending replies.  All
+ * client I/O is non-blocking and buffered so a slow or stalled client
+ * never blocks the caller.  When a complete command line is available
+ * it is placed into the supplied buffer with trailing white space
+ * removed.  A timeout of 0 polls the sockets without waiting.
+ *
+ * Return a client ID on success, 0 when no command is available and
+ * -1 on error.  The caller replies with ctl_reply() and must finish
+ * the client with ctl_done().
+ ***************************************************************************/
+int
+ctl_poll (int ctlfd, char *command, int commandlen, int timeout)
+{
+  struct pollfd pfd[CTL_MAXCLIENTS + 1];
+  CtlClient *client;
+  time_t now;
+  int nfds = 0;
+  int freeslot = 0;
+  int clientfd;
+  int idx;
+
+  if (ctlfd < 0 || !command || commandlen <= 0)
+    return -1;
+
+  /* Return a command already read without waiting */
+  for (idx = 0; idx < CTL_MAXCLIENTS; idx++)
+    if (clients[idx].state == CTL_READY)
+      timeout = 0;
+
+  for (idx = 0; idx < CTL_MAXCLIENTS; idx++)
+  {
+    client = &clients[idx];
+
+    if (client->state == CTL_FREE)
+    {
+      freeslot = 1;
+    }
+    else if (client->state == CTL_READING || client->state == CTL_DONE)
+    {
+      pfd[nfds].fd = client->fd;
+      pfd[nfds].events = (client->state == CTL_READING) ? POLLIN : POLLOUT;
+      nfds++;
+    }
+  }
+
+  /* Only accept new clients when there is room for them */
+  if (freeslot)
+  {
+    pfd[nfds].fd = ctlfd;
+    pfd[nfds].events = POLLIN;
+    nfds++;
+  }
+
+  if (nfds && poll (pfd, nfds, timeout) < 0 && errno != EINTR)
+    return -1;
+
+  now = time (NULL);
+
+  /* Accept new clients */
+  for (idx = 0; idx < CTL_MAXCLIENTS; idx++)
+  {
+    client = &clients[idx];
+
+    if (client->state != CTL_FREE)
+      continue;
+
+    if ((clientfd = accept (ctlfd, NULL, NULL)) < 0)
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ||
+          errno == ECONNABORTED)
+        break;
+
+      return -1;
+    }
+
+    if (fcntl (clientfd, F_SETFL, fcntl (clientfd, F_GETFL, 0) | O_NONBLOCK) == -1)
+    {
+      close (clientfd);
+      continue;
+    }
+
+    client->fd = clientfd;
+    client->state = CTL_READING;
+    client->start = now;
+    client->inlen = 0;
+    client->outlen = 0;
+    client->outsent = 0;
+  }
+
+  /* Read commands, send replies and drop stalled clients */
+  for (idx = 0; idx < CTL_MAXCLIENTS; idx++)
+  {
+    client = &clients[idx];
+
+    if (client->state == CTL_READING)
+      ctl_read (client);
+    else if (client->state == CTL_DONE && ctl_flush (client))
+      ctl_drop (client);
+
+    if ((client->state == CTL_READING || client->state == CTL_DONE) &&
+        now - client->start > CTL_CLIENT_TIMEOUT)
+      ctl_drop (client);
+  }
+
+  /* Return the first complete command */
+  for (idx = 0; idx < CTL_MAXCLIENTS; idx++)
+  {
+    client = &clients[idx];
+
+    if (client->state != CTL_READY)
+      continue;
+
+    if (client->inlen >= commandlen)
+      client->inlen = commandlen - 1;
+
+    memcpy (command, client->in, client->inlen);
+    command[client->inlen] = '\0';
+    client->state = CTL_BUSY;
+
+    return idx + 1;
+  }
+
+  return 0;
+} /* End of ctl_poll() */
+
+/***************************************************************************
+ * ctl_read:
+ *
+ * Read available command input from a client, the command is complete
+ * at a newline, at the end of input or when the buffer is full.
+ ***************************************************************************/
+static void
+ctl_read (CtlClient *client)
+{
+  char *newline;
+  ssize_t nrecv;
+
+  while (client->inlen < CTL_INSIZE - 1)
+  {
+    nrecv = read (client->fd, client->in + client->inlen, CTL_INSIZE - 1 - client->inlen);
+
+    if (nrecv < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        ctl_drop (client);
+
+      return;
+    }
+
+    if (nrecv == 0)
+      break;
+
+    client->inlen += nrecv;
+
+    if ((newline = memchr (client->in + client->inlen - nrecv, '\n', nrecv)))
+    {
+      client->inlen = newline - client->in;
+      break;
+    }
+  }
+
+  /* Trim trailing white space */
+  while (client->inlen > 0 && (client->in[client->inlen - 1] == '\r' ||
+                               client->in[client->inlen - 1] == ' ' ||
+                               client->in[client->inlen - 1] == '\t'))
+    client->inlen--;
+
+  client->state = CTL_READY;
+} /* End of ctl_read() */
+
+/***************************************************************************
+ * ctl_reply:
+ *
+ * Add a formatted reply line for a control client to its reply
+ * buffer, a newline is added to the message.  Replies are sent
+ * without blocking, what cannot be sent right away is sent by later
+ * calls to ctl_poll().  Replies that do not fit in the buffer are
+ * truncated.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+int
+ctl_reply (int clientid, const char *fmt, ...)
+{
+  CtlClient *client;
+  va_list argptr;
+  int space;
+  int length;
+
+  if (clientid <= 0 || clientid > CTL_MAXCLIENTS ||
+      clients[clientid - 1].state != CTL_BUSY)
+    return -1;
+
+  client = &clients[clientid - 1];
+  space = CTL_OUTSIZE - client->outlen;
+
+  if (space < 2)
+    return -1;
+
+  va_start (argptr, fmt);
+  length = vsnprintf (client->out + client->outlen, space - 1, fmt, argptr);
+  va_end (argptr);
+
+  if (length < 0)
+    return -1;
+
+  if (length > space - 2)
+    length = space - 2;
+
+  client->outlen += length;
+  client->out[client->outlen++] = '\n';
+
+  if (ctl_flush (client) < 0)
+    return -1;
+
+  return 0;
+} /* End of ctl_reply() */
+
+/***************************************************************************
+ * ctl_done:
+ *
+ * Finish the command of a client, the client is disconnected when all
+ * replies have been sent.
+ ***************************************************************************/
+void
+ctl_done (int clientid)
+{
+  CtlClient *client;
+
+  if (clientid <= 0 || clientid > CTL_MAXCLIENTS ||
+      clients[clientid - 1].state != CTL_BUSY)
+    return;
+
+  client = &clients[clientid - 1];
+  client->state = CTL_DONE;
+  client->start = time (NULL);
+
+  if (ctl_flush (client))
+    ctl_drop (client);
+} /* End of ctl_done() */
+
+/***************************************************************************
+ * ctl_flush:
+ *
+ * Send buffered replies to a client without blocking.
+ *
+ * Return 1 when all replies are sent, 0 when some remain and -1 on
+ * error, in which case the client is disconnected.
+ ***************************************************************************/
+static int
+ctl_flush (CtlClient *client)
+{
+  ssize_t nsent;
+
+  while (client->outsent < client->outlen)
+  {
+    nsent = write (client->fd, client->out + client->outsent,
+                   client->outlen - client->outsent);
+
+    if (nsent < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return 0;
+
+      ctl_drop (client);
+      return -1;
+    }
+
+    client->outsent += nsent;
+  }
+
+  return 1;
+} /* End of ctl_flush() */
+
+/***************************************************************************
+ * ctl_drop:
+ *
+ * Disconnect a client and free its slot.
+ ***************************************************************************/
+static void
+ctl_drop (CtlClient *client)
+{
+  if (client->state != CTL_FREE)
+    close (client->fd);
+
+  client->state = CTL_FREE;
+  client->fd = -1;
+} /* End of ctl_drop() */
+
+/***************************************************************************
+ * ctl_close:
+ *
+ * Close the control socket and remove the socket file.
+ ***************************************************************************/
+void
+ctl_close (int ctlfd, const char *path)
+{
+  int idx;
+
+  for (idx = 0; idx < CTL_MAXCLIENTS; idx++)
+    ctl_drop (&clients[idx]);
+
+  if (ctlfd >= 0)
+    close (ctlfd);
+
+  if (path)
+    unlink (path);
+} /* End of ctl_close() */
@@ -0,0 +1,26 @@
+/***************************************************************************
+ * control.h
+ *
+ * Local control socket defines.
+ *
+ * modified: 2026.291
+ ***************************************************************************/
+
+#ifndef CONTROL_H
+#define CONTROL_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int  ctl_open (const char *path);
+extern int  ctl_poll (int ctlfd, char *command, int commandlen, int timeout);
+extern int  ctl_reply (int clientid, const char *fmt, ...);
+extern void ctl_done (int clientid);
+extern void ctl_close (int ctlfd, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONTROL_H */
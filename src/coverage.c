@@ -0,0 +1,688 @@
+/***************************************************************************
+ * coverage.c
+ *
+ * Compact tracking of the time series coverage of records sent.
+ *
+ * Streams are interned in a hash table by source name and hold their
+ * segments in an array ordered by time.  Records are merged into the
+ * segments following the rules of mstl_addmsr() with the default
+ * tolerances, half a sample period and sample rates within 0.01%, so
+ * the resulting coverage matches an MSTraceList of the same records.
+ * The common case of a record following the last record of the same
+ * stream only compares the stream name of the last stream added to and
+ * extends the last segment.
+ *
+ * modified: 2026.291
+ ***************************************************************************/
+
+#include "coverage.h"
+#include "hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Number of slots in the stream hash table */
+#define COV_HASHSIZE 4096
+
+static CovStream *addstream (Coverage *cov, char *srcname, char *net,
+                             char *sta, char *loc, char *chan);
+static int insertseg (CovStream *stream, int idx, hptime_t starttime, hptime_t endtime,
+                      double samprate, int64_t samplecnt);
+static int streamcmp (const void *a, const void *b);
+
+/***************************************************************************
+ * cov_init:
+ *
+ * Allocate and initialize an empty coverage.
+ *
+ * Returns a pointer to the coverage on success and NULL on error.
+ ***************************************************************************/
+Coverage *
+cov_init (void)
+{
+  Coverage *cov;
+
+  if (!(cov = (Coverage *)calloc (1, sizeof (Coverage))))
+    return NULL;
+
+  if (!(cov->hash = (CovStream **)calloc (COV_HASHSIZE, sizeof (CovStream *))))
+  {
+    free (cov);
+    return NULL;
+  }
+
+  return cov;
+} /* End of cov_init() */
+
+/***************************************************************************
+ * cov_free:
+ *
+ * Free a coverage and all of its streams.
+ ***************************************************************************/
+void
+cov_free (Coverage *cov)
+{
+  CovStream *stream;
+  CovStream *next;
+  int slot;
+
+  if (!cov)
+    return;
+
+  for (slot = 0; slot < COV_HASHSIZE; slot++)
+  {
+    for (stream = cov->hash[slot]; stream; stream = next)
+    {
+      next = stream->hashnext;
+
+      if (stream->segs)
+        free (stream->segs);
+      free (stream);
+    }
+  }
+
+  free (cov->hash);
+  free (cov);
+} /* End of cov_free() */
+
+/***************************************************************************
+ * cov_addmsr:
+ *
+ * Add the coverage of a record to the stream identified by srcname,
+ * the record source name without quality, where endtime is the time
+ * of the last sample of the record.  Both are usually already
+ * determined by the caller.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+cov_addmsr (Coverage *cov, char *srcname, MSRecord *msr, hptime_t endtime)
+{
+  CovStream *stream;
+  CovSeg *segs;
+  CovSeg swap;
+  hptime_t hpdelta;
+  hptime_t hptimetol;
+  hptime_t nhptimetol;
+  hptime_t gap;
+  hptime_t pregap;
+  hptime_t postgap;
+  int segbefore;
+  int segafter;
+  int followseg;
+  int whence;
+  int idx;
+  int seg;
+
+  if (!cov || !srcname || !msr)
+    return -1;
+
+  /* Find the stream, most records continue the last stream added to */
+  if (cov->last && !strcmp (cov->last->srcname, srcname))
+    stream = cov->last;
+  else if (!(stream = cov_findstream (cov, srcname)) &&
+           !(stream = addstream (cov, srcname, msr->network, msr->station,
+                                 msr->location, msr->channel)))
+    return -1;
+
+  cov->last = stream;
+
+  /* First segment of the stream */
+  if (stream->segcount == 0)
+  {
+    if (insertseg (stream, 0, msr->starttime, endtime, msr->samprate, msr->samplecnt))
+      return -1;
+
+    cov->segcount++;
+    stream->earliest = msr->starttime;
+    stream->latest   = endtime;
+
+    return 0;
+  }
+
+  /* Sample period and time tolerance of half a sample period */
+  hpdelta    = (hptime_t) ((msr->samprate) ? (HPTMODULUS / msr->samprate) : 0.0);
+  hptimetol  = (hptime_t) (0.5 * hpdelta);
+  nhptimetol = (hptimetol) ? -hptimetol : 0;
+
+  segs = stream->segs;
+  seg  = stream->segcount - 1;
+  gap  = msr->starttime - segs[seg].endtime - hpdelta;
+
+  /* Record fits at the end of the last segment */
+  if (gap <= hptimetol && gap >= nhptimetol &&
+      MS_ISRATETOLERABLE (msr->samprate, segs[seg].samprate))
+  {
+    segs[seg].endtime = endtime;
+    segs[seg].samplecnt += msr->samplecnt;
+
+    if (endtime > stream->latest)
+      stream->latest = endtime;
+  }
+  /* Record is after the latest coverage */
+  else if ((msr->starttime - hpdelta - hptimetol) > stream->latest)
+  {
+    seg = stream->segcount;
+    if (insertseg (stream, seg, msr->starttime, endtime, msr->samprate, msr->samplecnt))
+      return -1;
+
+    cov->segcount++;
+
+    if (endtime > stream->latest)
+      stream->latest = endtime;
+  }
+  /* Record is before the earliest coverage */
+  else if ((endtime + hpdelta + hptimetol) < stream->earliest)
+  {
+    seg = 0;
+    if (insertseg (stream, seg, msr->starttime, endtime, msr->samprate, msr->samplecnt))
+      return -1;
+
+    cov->segcount++;
+
+    if (msr->starttime < stream->earliest)
+      stream->earliest = msr->starttime;
+  }
+  else
+  {
+    seg = 0;
+    gap = segs[0].starttime - endtime - hpdelta;
+
+    /* Record fits at the beginning of the first segment */
+    if (gap <= hptimetol && gap >= nhptimetol &&
+        MS_ISRATETOLERABLE (msr->samprate, segs[0].samprate))
+    {
+      segs[0].starttime = msr->starttime;
+      segs[0].samplecnt += msr->samplecnt;
+
+      if (msr->starttime < stream->earliest)
+        stream->earliest = msr->starttime;
+    }
+    /* Search for segments the record fits after and before */
+    else
+    {
+      segbefore = -1;
+      segafter  = -1;
+      followseg = -1;
+
+      for (idx = 0; idx < stream->segcount; idx++)
+      {
+        /* Track the last segment starting before the record */
+        if (msr->starttime > segs[idx].starttime)
+          followseg = idx;
+
+        whence = 0;
+
+        postgap = msr->starttime - segs[idx].endtime - hpdelta;
+        if (segbefore < 0 && postgap <= hptimetol && postgap >= nhptimetol)
+          whence = 1;
+
+        pregap = segs[idx].starttime - endtime - hpdelta;
+        if (segafter < 0 && pregap <= hptimetol && pregap >= nhptimetol)
+          whence = 2;
+
+        if (!whence)
+          continue;
+
+        if (!MS_ISRATETOLERABLE (msr->samprate, segs[idx].samprate))
+          continue;
+
+        if (whence == 1)
+          segbefore = idx;
+        else
+          segafter = idx;
+
+        /* Record fills a gap between two segments */
+        if (segbefore >= 0 && segafter >= 0)
+          break;
+      }
+
+      /* Extend the segment before, joining the segment after if any */
+      if (segbefore >= 0)
+      {
+        segs[segbefore].endtime = endtime;
+        segs[segbefore].samplecnt += msr->samplecnt;
+
+        if (segafter >= 0 && segafter != segbefore)
+        {
+          segs[segbefore].endtime = segs[segafter].endtime;
+          segs[segbefore].samplecnt += segs[segafter].samplecnt;
+
+          memmove (&segs[segafter], &segs[segafter + 1],
+                   (stream->segcount - segafter - 1) * sizeof (CovSeg));
+          stream->segcount--;
+          cov->segcount--;
+
+          if (segafter < segbefore)
+            segbefore--;
+        }
+
+        seg = segbefore;
+      }
+      /* Extend the segment after */
+      else if (segafter >= 0)
+      {
+        segs[segafter].starttime = msr->starttime;
+        segs[segafter].samplecnt += msr->samplecnt;
+
+        seg = segafter;
+      }
+      /* Insert a new segment following the last starting before */
+      else
+      {
+        seg = followseg + 1;
+        if (insertseg (stream, seg, msr->starttime, endtime, msr->samprate, msr->samplecnt))
+          return -1;
+
+        cov->segcount++;
+        segs = stream->segs;
+      }
+
+      if (msr->starttime < stream->earliest)
+        stream->earliest = msr->starttime;
+
+      if (endtime > stream->latest)
+        stream->latest = endtime;
+    }
+  }
+
+  /* Keep the segments ordered by start time, then end time */
+  segs = stream->segs;
+  while (seg + 1 < stream->segcount &&
+         (segs[seg].starttime > segs[seg + 1].starttime ||
+          (segs[seg].starttime == segs[seg + 1].starttime &&
+           segs[seg].endtime < segs[seg + 1].endtime)))
+  {
+    swap          = segs[seg];
+    segs[seg]     = segs[seg + 1];
+    segs[seg + 1] = swap;
+    seg++;
+  }
+  while (seg > 0 &&
+         (segs[seg].starttime < segs[seg - 1].starttime ||
+          (segs[seg].starttime == segs[seg - 1].starttime &&
+           segs[seg].endtime > segs[seg - 1].endtime)))
+  {
+    swap          = segs[seg];
+    segs[seg]     = segs[seg - 1];
+    segs[seg - 1] = swap;
+    seg--;
+  }
+
+  return 0;
+} /* End of cov_addmsr() */
+
+/***************************************************************************
+ * cov_addsync:
+ *
+ * Add the segments of a SYNC list, sorted by stream and time as done
+ * by sync_merge(), to a coverage for use as an index of coverage.
+ * Overlapping segments of a stream are joined regardless of sample
+ * rate so the segments of each stream do not overlap.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+cov_addsync (Coverage *cov, SyncList *list)
+{
+  CovStream *stream;
+  CovSeg *last;
+  SyncSeg *seg;
+  char srcname[50];
+  int idx;
+
+  if (!cov || !list)
+    return -1;
+
+  for (idx = 0; idx < list->count; idx++)
+  {
+    seg = &list->segs[idx];
+
+    snprintf (srcname, sizeof (srcname), "%s_%s_%s_%s",
+              seg->network, seg->station, seg->location, seg->channel);
+
+    if (cov->last && !strcmp (cov->last->srcname, srcname))
+      stream = cov->last;
+    else if (!(stream = cov_findstream (cov, srcname)) &&
+             !(stream = addstream (cov, srcname, seg->network, seg->station,
+                                   seg->location, seg->channel)))
+      return -1;
+
+    cov->last = stream;
+
+    if (stream->segcount == 0)
+    {
+      stream->earliest = seg->starttime;
+      stream->latest   = seg->endtime;
+    }
+
+    last = (stream->segcount > 0) ? &stream->segs[stream->segcount - 1] : NULL;
+
+    /* Join segments overlapping the last segment */
+    if (last && seg->starttime <= last->endtime)
+    {
+      if (seg->endtime > last->endtime)
+        last->endtime = seg->endtime;
+
+      last->samplecnt += seg->samplecnt;
+    }
+    else
+    {
+      if (last && seg->starttime < last->starttime)
+        return -1;
+
+      if (insertseg (stream, stream->segcount, seg->starttime, seg->endtime,
+                     seg->samprate, seg->samplecnt))
+        return -1;
+
+      cov->segcount++;
+    }
+
+    if (seg->starttime < stream->earliest)
+      stream->earliest = seg->starttime;
+
+    if (seg->endtime > stream->latest)
+      stream->latest = seg->endtime;
+  }
+
+  return 0;
+} /* End of cov_addsync() */
+
+/***************************************************************************
+ * cov_covers:
+ *
+ * Check if the time range from starttime to endtime of the stream
+ * identified by srcname is within a single segment of a coverage
+ * built by cov_addsync(), allowing tolerance at either end.  The
+ * segment is found with a binary search.
+ *
+ * Returns 1 if covered and 0 otherwise.
+ ***************************************************************************/
+int
+cov_covers (Coverage *cov, char *srcname, hptime_t starttime, hptime_t endtime,
+            hptime_t tolerance)
+{
+  CovStream *stream;
+  int low;
+  int high;
+  int mid;
+
+  if (!cov || !srcname)
+    return 0;
+
+  if (cov->last && !strcmp (cov->last->srcname, srcname))
+    stream = cov->last;
+  else if (!(stream = cov_findstream (cov, srcname)))
+    return 0;
+
+  cov->last = stream;
+
+  if (stream->segcount == 0 ||
+      starttime + tolerance < stream->earliest ||
+      endtime - tolerance > stream->latest)
+    return 0;
+
+  /* Find the last segment starting at or before the start time */
+  low  = 0;
+  high = stream->segcount - 1;
+  while (low < high)
+  {
+    mid = (low + high + 1) / 2;
+
+    if (stream->segs[mid].starttime <= starttime + tolerance)
+      low = mid;
+    else
+      high = mid - 1;
+  }
+
+  if (stream->segs[low].starttime > starttime + tolerance)
+    return 0;
+
+  return (stream->segs[low].endtime + tolerance >= endtime) ? 1 : 0;
+} /* End of cov_covers() */
+
+/***************************************************************************
+ * cov_findstream:
+ *
+ * Find a stream by source name, i.e. NET_STA_LOC_CHAN.
+ *
+ * Returns a pointer to the stream if found and NULL otherwise.
+ ***************************************************************************/
+CovStream *
+cov_findstream (Coverage *cov, char *srcname)
+{
+  CovStream *stream;
+
+  if (!cov || !srcname)
+    return NULL;
+
+  for (stream = cov->hash[hashname (srcname) % COV_HASHSIZE]; stream; stream = stream->hashnext)
+  {
+    if (!strcmp (stream->srcname, srcname))
+      return stream;
+  }
+
+  return NULL;
+} /* End of cov_findstream() */
+
+/***************************************************************************
+ * cov_sortstreams:
+ *
+ * Build an array of the streams of a coverage sorted by source name.
+ * The array is allocated and should be freed by the caller.
+ *
+ * Returns a pointer to the array on success and NULL on error or if
+ * there are no streams.
+ ***************************************************************************/
+CovStream **
+cov_sortstreams (Coverage *cov)
+{
+  CovStream **array;
+  CovStream *stream;
+  int count = 0;
+  int slot;
+
+  if (!cov || cov->streamcount <= 0)
+    return NULL;
+
+  if (!(array = (CovStream **)malloc (cov->streamcount * sizeof (CovStream *))))
+    return NULL;
+
+  for (slot = 0; slot < COV_HASHSIZE; slot++)
+    for (stream = cov->hash[slot]; stream; stream = stream->hashnext)
+      array[count++] = stream;
+
+  qsort (array, count, sizeof (CovStream *), streamcmp);
+
+  return array;
+} /* End of cov_sortstreams() */
+
+/***************************************************************************
+ * cov_tosync:
+ *
+ * Add the segments of a coverage to a SYNC list, ordered by source
+ * name and time.
+ *
+ * Returns the number of segments added on success and -1 on error.
+ ***************************************************************************/
+int
+cov_tosync (Coverage *cov, SyncList *list)
+{
+  CovStream **array;
+  CovStream *stream;
+  SyncSeg syncseg;
+  int count = 0;
+  int sidx;
+  int idx;
+
+  if (!cov || !list)
+    return -1;
+
+  if (cov->streamcount <= 0)
+    return 0;
+
+  if (!(array = cov_sortstreams (cov)))
+    return -1;
+
+  for (sidx = 0; sidx < cov->streamcount; sidx++)
+  {
+    stream = array[sidx];
+
+    memset (&syncseg, 0, sizeof (syncseg));
+    strcpy (syncseg.network, stream->network);
+    strcpy (syncseg.station, stream->station);
+    strcpy (syncseg.location, stream->location);
+    strcpy (syncseg.channel, stream->channel);
+
+    for (idx = 0; idx < stream->segcount; idx++)
+    {
+      syncseg.starttime = stream->segs[idx].starttime;
+      syncseg.endtime   = stream->segs[idx].endtime;
+      syncseg.samprate  = stream->segs[idx].samprate;
+      syncseg.samplecnt = stream->segs[idx].samplecnt;
+
+      if (sync_add (list, &syncseg))
+      {
+        free (array);
+        return -1;
+      }
+
+      count++;
+    }
+  }
+
+  free (array);
+
+  return count;
+} /* End of cov_tosync() */
+
+/***************************************************************************
+ * cov_print:
+ *
+ * Print the segments of a coverage in the format of
+ * mstl_printtracelist() with gaps and sample counts.
+ ***************************************************************************/
+void
+cov_print (Coverage *cov)
+{
+  CovStream **array;
+  CovStream *stream;
+  CovSeg *seg;
+  char stime[30];
+  char etime[30];
+  int sidx;
+  int idx;
+
+  if (!cov)
+    return;
+
+  ms_log (0, "   Source                Start sample             End sample        Hz  Samples\n");
+
+  if ((array = cov_sortstreams (cov)))
+  {
+    for (sidx = 0; sidx < cov->streamcount; sidx++)
+    {
+      stream = array[sidx];
+
+      for (idx = 0; idx < stream->segcount; idx++)
+      {
+        seg = &stream->segs[idx];
+
+        ms_hptime2seedtimestr (seg->starttime, stime, 1);
+        ms_hptime2seedtimestr (seg->endtime, etime, 1);
+
+        ms_log (0, "%-17s %-24s %-24s %-3.3g %-" PRId64 "\n",
+                stream->srcname, stime, etime, seg->samprate, seg->samplecnt);
+      }
+    }
+
+    free (array);
+  }
+
+  ms_log (0, "Total: %d trace(s) with %" PRId64 " segment(s)\n",
+          cov->streamcount, cov->segcount);
+} /* End of cov_print() */
+
+/***************************************************************************
+ * addstream:
+ *
+ * Add a stream identified by srcname with the specified codes to the
+ * stream hash table.
+ *
+ * Returns a pointer to the stream on success and NULL on error.
+ ***************************************************************************/
+static CovStream *
+addstream (Coverage *cov, char *srcname, char *net, char *sta, char *loc, char *chan)
+{
+  CovStream *stream;
+  int slot;
+
+  if (strlen (srcname) >= sizeof (stream->srcname))
+    return NULL;
+
+  if (!(stream = (CovStream *)calloc (1, sizeof (CovStream))))
+    return NULL;
+
+  strncpy (stream->network, net, sizeof (stream->network) - 1);
+  strncpy (stream->station, sta, sizeof (stream->station) - 1);
+  strncpy (stream->location, loc, sizeof (stream->location) - 1);
+  strncpy (stream->channel, chan, sizeof (stream->channel) - 1);
+  strcpy (stream->srcname, srcname);
+
+  slot             = hashname (srcname) % COV_HASHSIZE;
+  stream->hashnext = cov->hash[slot];
+  cov->hash[slot]  = stream;
+  cov->streamcount++;
+
+  return stream;
+} /* End of addstream() */
+
+/***************************************************************************
+ * insertseg:
+ *
+ * Insert a segment at index idx of the segments of a stream, growing
+ * the segment array as needed.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+insertseg (CovStream *stream, int idx, hptime_t starttime, hptime_t endtime,
+           double samprate, int64_t samplecnt)
+{
+  CovSeg *segs;
+  int32_t segmax;
+
+  if (stream->segcount >= stream->segmax)
+  {
+    segmax = (stream->segmax) ? stream->segmax * 2 : 4;
+
+    if (!(segs = (CovSeg *)realloc (stream->segs, segmax * sizeof (CovSeg))))
+      return -1;
+
+    stream->segs   = segs;
+    stream->segmax = segmax;
+  }
+
+  if (idx < stream->segcount)
+    memmove (&stream->segs[idx + 1], &stream->segs[idx],
+             (stream->segcount - idx) * sizeof (CovSeg));
+
+  stream->segs[idx].starttime = starttime;
+  stream->segs[idx].endtime   = endtime;
+  stream->segs[idx].samprate  = samprate;
+  stream->segs[idx].samplecnt = samplecnt;
+  stream->segcount++;
+
+  return 0;
+} /* End of insertseg() */
+
+/***************************************************************************
+ * streamcmp:
+ *
+ * Compare streams by source name for qsort().
+ ***************************************************************************/
+static int
+streamcmp (const void *a, const void *b)
+{
+  return strcmp ((*(CovStream *const *)a)->srcname, (*(CovStream *const *)b)->srcname);
+} /* End of streamcmp() */
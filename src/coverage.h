@@ -0,0 +1,69 @@
+/***************************************************************************
+ * coverage.h
+ *
+ * Compact time series coverage tracking defines.
+ *
+ * modified: 2026.291
+ ***************************************************************************/
+
+#ifndef COVERAGE_H
+#define COVERAGE_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libmseed.h>
+
+#include "sync.h"
+
+/* Contiguous time series segment */
+typedef struct CovSeg_s
+{
+  hptime_t starttime;  /* Time of first sample */
+  hptime_t endtime;    /* Time of last sample */
+  double samprate;     /* Nominal sample rate (Hz) */
+  int64_t samplecnt;   /* Number of samples */
+} CovSeg;
+
+/* Stream and its segments in time order */
+typedef struct CovStream_s
+{
+  struct CovStream_s *hashnext;
+  char network[11];
+  char station[11];
+  char location[11];
+  char channel[11];
+  char srcname[45];    /* Stream as NET_STA_LOC_CHAN */
+  hptime_t earliest;   /* Time of earliest sample */
+  hptime_t latest;     /* Time of latest sample */
+  CovSeg *segs;        /* Array of segments */
+  int32_t segcount;    /* Number of segments */
+  int32_t segmax;      /* Number of segments allocated */
+} CovStream;
+
+/* Coverage of all streams */
+typedef struct Coverage_s
+{
+  CovStream **hash;    /* Hash table of streams by source name */
+  CovStream *last;     /* Stream last added to */
+  int streamcount;     /* Number of streams */
+  int64_t segcount;    /* Number of segments of all streams */
+} Coverage;
+
+extern Coverage  *cov_init (void);
+extern void       cov_free (Coverage *cov);
+extern int        cov_addmsr (Coverage *cov, char *srcname, MSRecord *msr, hptime_t endtime);
+extern int        cov_addsync (Coverage *cov, SyncList *list);
+extern int        cov_covers (Coverage *cov, char *srcname, hptime_t starttime,
+                              hptime_t endtime, hptime_t tolerance);
+extern CovStream *cov_findstream (Coverage *cov, char *srcname);
+extern CovStream **cov_sortstreams (Coverage *cov);
+extern int        cov_tosync (Coverage *cov, SyncList *list);
+extern void       cov_print (Coverage *cov);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COVERAGE_H */
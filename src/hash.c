@@ -0,0 +1,49 @@
+/***************************************************************************
+ * hash.c
+ *
+ * String hashing for the file, stream and quota hash tables and
+ * claim file names.
+ *
+ * modified: 2026.291
+ ***************************************************************************/
+
+#include "hash.h"
+
+/***************************************************************************
+ * hashname:
+ *
+ * Calculate a 32-bit FNV-1a hash of a file or stream name.
+ ***************************************************************************/
+uint32_t
+hashname (const char *name)
+{
+  uint32_t hash = 2166136261U;
+
+  while (*name)
+  {
+    hash ^= (uint8_t)*name++;
+    hash *= 16777619U;
+  }
+
+  return hash;
+} /* End of hashname() */
+
+/***************************************************************************
+ * hashname64:
+ *
+ * Calculate a 64-bit FNV-1a hash of a file name, for names that must
+ * not collide across very many files, e.g. claim files.
+ ***************************************************************************/
+uint64_t
+hashname64 (const char *name)
+{
+  uint64_t hash = 14695981039346656037ULL;
+
+  while (*name)
+  {
+    hash ^= (uint8_t)*name++;
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+} /* End of hashname64() */
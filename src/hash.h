@@ -0,0 +1,25 @@
+/***************************************************************************
+ * hash.h
+ *
+ * String hashing defines.
+ *
+ * modified: 2026.291
+ ***************************************************************************/
+
+#ifndef HASH_H
+#define HASH_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+extern uint32_t hashname (const char *name);
+extern uint64_t hashname64 (const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HASH_H */
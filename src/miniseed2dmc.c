@@ -34,33 +34,111 @@
 #include <libdali.h>
 #include <libmseed.h>
 
+#include "control.h"
+#include "coverage.h"
 #include "edir.h"
+#include "hash.h"
+#include "quota.h"
+#include "sync.h"
 
 #define PACKAGE "miniseed2dmc"
-#define VERSION "2017.017"
+#define VERSION "2026.291"
 
 /* Maximum filename length including path */
 #define MAX_FILENAME_LENGTH 512
 
+/* Size of a coverage database stream log merged into the stream file */
+#define COVDB_COMPACTSIZE 65536
+
+/* Confirm records sent with the servers after this many bytes or seconds */
+#define CONFIRM_BYTES (4 * 1048576)
+#define CONFIRM_INTERVAL 10
+
+/* Delivery state of a file for one destination */
+typedef struct DestState_s
+{
+  off_t ackoffset;      /* File offset after last record acknowledged by the destination */
+  off_t unconfirmed;    /* Offset of first unconfirmed record, -1 if none */
+  off_t missed;         /* Offset of first record not sent while disconnected, -1 if none */
+} DestState;
+
 /* Linkable structure to hold input file list */
 typedef struct FileLink_s
 {
   struct FileLink_s *next;
+  struct FileLink_s *hashnext; /* Next entry in file name hash chain */
   off_t offset;         /* Last file read offset, must be signed */
   off_t size;           /* Total size of file */
+  time_t modtime;       /* Modification time of file */
+  ino_t inode;          /* Inode number of file */
+  uint32_t scan;        /* Scan count when file was last found */
   uint64_t bytecount;   /* Count of bytes sent */
   uint64_t recordcount; /* Count of records sent */
+  off_t ackoffset;      /* File offset after last acknowledged record */
+  int64_t pktid;        /* Server packet ID of last acknowledged record */
+  DestState *dests;     /* Delivery state for each destination, NULL until read */
+  int keyoffset;        /* Offset in name of the shard key, the path relative to the input root */
+  int8_t claim;         /* Shard claim: 0 unknown, 1 this shard, -1 another shard */
   char name[1];         /* File name, complete path to access */
 } FileLink;
 
+/* Linkable structure to hold destination servers */
+typedef struct Destination_s
+{
+  struct Destination_s *next;
+  DLCP *dlconn;         /* Connection to server */
+  int index;            /* Position in destination list */
+  FileLink **pending;   /* Files with records sent but not confirmed */
+  int pendcount;        /* Number of pending files */
+  int pendmax;          /* Number of pending files allocated */
+  uint32_t unacked;     /* Count of records sent since last acknowledgement */
+  uint64_t bytecount;   /* Count of bytes sent */
+  uint64_t recordcount; /* Count of records sent */
+} Destination;
+
+/* Header fields of a record queued for rate quotas */
+typedef struct QueuedHeader_s
+{
+  char network[11];
+  char station[11];
+  char location[11];
+  char channel[11];
+  char srcname[50];     /* Stream as NET_STA_LOC_CHAN */
+  char qsrcname[50];    /* Stream as NET_STA_LOC_CHAN_QUAL */
+  hptime_t starttime;   /* Time of first sample */
+  hptime_t endtime;     /* Time of last sample */
+  double samprate;      /* Nominal sample rate (Hz) */
+  int64_t samplecnt;    /* Number of samples */
+} QueuedHeader;
+
+/* Linkable structure to hold stream routes to destinations */
+typedef struct Route_s
+{
+  struct Route_s *next;
+  Selections *selections; /* Stream selection for route */
+  Destination *dest;      /* Destination for matching streams */
+} Route;
+
 static FileLink *filelist = 0;     /* Linked list of input files */
 static FileLink *lastfile = 0;     /* Last entry of input files list */
+static FileLink *inputlist = 0;    /* Input files, directories and @list files */
+static FileLink **filehash = 0;    /* Hash table of input files by name */
+static int filehashsize = 0;       /* Number of slots in file hash table */
+static int filecount = 0;          /* Number of entries in input files list */
+static uint32_t scancount = 0;     /* Count of input scans */
 static Selections *selections = 0; /* List of data selections */
+static Destination *destlist = 0;  /* Destination servers, first is the default */
+static int destcount = 0;          /* Number of destinations */
+static Route *routes = 0;          /* Stream routes in order of precedence */
 
 static char stopsig = 0;    /* Stop/termination signal */
+static char printsig = 0;   /* Print file list signal */
+static char paused = 0;     /* Transfer paused via control socket */
 static int verbose = 0;     /* Verbosity level */
 static int writeack = 0;    /* Flag to control the request for write acks */
+static int ackinterval = 0; /* Request a write ack every ackinterval records */
 static int64_t maxrate = 0; /* Max rate in bits/sec, 0 to disable  */
+static int failover = 0;    /* Servers with multiple endpoints to fail over to */
 
 static char maxrecur = -1;  /* Maximum level of directory recursion */
 static int filenames = 0;   /* Include file names in streamIDs */
@@ -70,20 +148,72 @@ static int iostatsint = 30; /* Output IO stats interval */
 static int quiet = 0;       /* Quiet mode */
 static int quitonerror = 0; /* Quit program on connection errors */
 static int reconnect = 60;  /* Reconnect delay if not quitting on errors */
+static int draintimeout = 10; /* Maximum wait for confirmation at shutdown */
+static int scaninterval = 0;  /* Daemon mode input rescan interval, 0 to exit when done */
 static int syncfile = 1;    /* SYNC file for writing data coverage */
 static char *workdir = "."; /* Directory to write SYNC and state files */
 static char *statefile = 0; /* State file for saving/restoring time stamps */
+static char *routefile = 0; /* Stream routing file */
+static char *quotafile = 0; /* Stream rate quota file */
+static int quotas = 0;      /* Number of rate quota rules */
+static char *ctlpath = 0;   /* Control socket path */
+static int ctlfd = -1;      /* Control socket descriptor */
+static char *shardname = 0; /* Name of this shard, NULL when not sharding */
+static int shardindex = 0;  /* Index of this shard when sharding by path hash */
+static int shardcount = 0;  /* Number of shards when sharding by path hash */
+static int shardclaim = 0;  /* Claim files with lock files in the workdir */
+static int shardrootlen = 0; /* Length of input directory path being scanned including separator */
+static char *covdbdir = 0;  /* Cumulative coverage database directory */
+static Coverage *reference = 0; /* Reference coverage for gap filling */
 
 static uint64_t inputbytes = 0;   /* Total size for all input files */
 static uint64_t totalbytes = 0;   /* Track count of total bytes sent */
 static uint64_t totalrecords = 0; /* Track count of total records sent */
 static uint64_t totalfiles = 0;   /* Track count of total files sent */
-static MSTraceList *traces = 0;   /* Track all trace segments sent */
+static uint64_t coveredbytes = 0; /* Track count of bytes covered by reference */
+static uint64_t confirmbytes = 0; /* Total bytes sent at last confirmation */
+static time_t confirmtime = 0;    /* Time of last confirmation */
+static Coverage *coverage = 0;    /* Track all trace segments sent */
+
+static struct timeval procstart; /* Processing start time */
+static time_t cyclestart;        /* Start time of current daemon cycle */
+static struct timeval ratestart; /* Reference time for rate limiting */
+static uint64_t ratebytes = 0;   /* Bytes sent before rate reference time */
 
 static void printfilelist (FILE *fd);
-static int writesync (MSTraceList *mstl, time_t start, time_t end);
+static int writesync (Coverage *cov, time_t start, time_t end);
 static int savestate (char *statefile);
 static int recoverstate (char *statefile);
+static int confirmsent (void);
+static void confirmdest (Destination *dest);
+static void dropdest (Destination *dest);
+static int countconnected (void);
+static DestState *getdeststate (FileLink *file);
+static void updateack (FileLink *file);
+static void unpendfile (FileLink *file);
+static int sendrecord (FileLink *file, MSRecord *msr, off_t filepos, char *streamid,
+                       char *srcname, char *qsrcname, hptime_t endtime);
+static int sendqueued (char *record, int reclen, off_t filepos, void *header, void *data);
+static int connectdest (void);
+static Destination *adddest (char *address, char *progname);
+static Destination *finddest (char *srcname);
+static int readroutefile (char *routefile, char *progname);
+static int readquotafile (char *quotafile);
+static int claimfile (FileLink *file);
+static int mergesync (char *outfile, char **syncfiles, int count);
+static int updatecovdb (Coverage *cov, char *dbdir);
+static int updatecovstream (char *dbdir, char *srcname, SyncList *list, int first, int count);
+static int querycovdb (char *dbdir, char *pattern, char *startstr, char *endstr);
+static int printgap (char *srcname, hptime_t from, hptime_t until);
+static int readreference (char *syncfile);
+static void checkcontrol (FileLink *current);
+static void sendkeepalive (time_t *lastkeepalive);
+static int nextcycle (void);
+static int scaninputs (void);
+static FileLink *findfile (char *filename);
+static int hashfile (FileLink *file);
+static int addinput (char *name, int listfile);
+static void controlcommand (int client, char *command, FileLink *current);
 static int processparam (int argcount, char **argvec);
 static char *getoptval (int argcount, char **argvec, int argopt);
 static int64_t calcbitsize (char *sizestr);
@@ -98,29 +228,33 @@ static void lprintf0 (char *message);
 static int lprintf (int level, const char *fmt, ...);
 static void usage ();
 
-static DLCP *dlconn;
-
 int
 main (int argc, char **argv)
 {
   FileLink *file;
+  Destination *dest;
+  DestState *ds;
   Selections *matchsp = 0;
   SelectTime *matchstp = 0;
-  struct timeval procstart;
   struct timeval procend;
   struct timeval filestart;
   struct timeval lastpkt;
   struct timeval iostatsprint;
   struct timeval now;
   struct timespec rcsleep;
+  time_t lastfailover = 0;
   double interval;
+  off_t resume;
   int restart = 0;
   int allsent = 0;
+  int rv;
   int exitval = 0;
   int streamlen;
   char ratestr[50];
+  uint64_t filecovered = 0;
 
   MSRecord *msr = 0;
+  QueuedHeader qheader;
   char srcname[50];
   char qsrcname[50];
   char streamid[100];
@@ -151,10 +285,10 @@ main (int argc, char **argv)
 
   /* Shortcut: check if all input data has already been sent */
   file = filelist;
-  allsent = 1;
+  allsent = (scaninterval) ? 0 : 1;
   while (file)
   {
-    if (file->bytecount != file->size)
+    if (file->bytecount != (uint64_t)file->size && file->claim >= 0)
       allsent = 0;
 
     file = file->next;
@@ -174,7 +308,11 @@ main (int argc, char **argv)
   rcsleep.tv_nsec = 0;
 
   /* Initialize trace segment tracking */
-  traces = mstl_init (traces);
+  if (!(coverage = cov_init ()))
+  {
+    lprintf (0, "Error allocating coverage tracking");
+    return 1;
+  }
 
   /* Initilize transmission rate timer */
   if (maxrate)
@@ -182,6 +320,9 @@ main (int argc, char **argv)
 
   /* Set processing start time */
   gettimeofday (&procstart, NULL);
+  ratestart = procstart;
+  cyclestart = procstart.tv_sec;
+  confirmtime = procstart.tv_sec;
 
   iostatsprint.tv_sec = iostatsprint.tv_usec = 0;
 
@@ -189,38 +330,149 @@ main (int argc, char **argv)
   while (!stopsig)
   {
     file = filelist;
+    restart = 0;
 
-    /* Connect to server */
-    if (!pretend && dl_connect (dlconn) < 0)
+    /* Records queued for rate quotas before a restart are read again */
+    if (quotas)
+      quota_reset ();
+
+    /* Connect to servers */
+    if (!pretend && (rv = connectdest ()) < 0)
     {
+      /* Write permission not granted */
+      if (rv == -2)
+      {
+        stopsig = 1;
+        exitval = 1;
+        break;
+      }
+
       lprintf (0, "Error connecting to server");
     }
     else
     {
-      restart = 0;
+      while (!restart && !stopsig)
+      {
+        /* End of file list, stop or wait for the next scan in daemon mode */
+        if (!file)
+        {
+          /* Send records still queued for rate quotas, from all files */
+          if (quotas && quota_dispatch (maxrate, 1, &stopsig, sendqueued))
+          {
+            restart = 1;
+            break;
+          }
+
+          if (stopsig)
+            break;
 
-      if (!quiet && !pretend)
-        lprintf (0, "Connected to %s", dlconn->addr);
+          /* Confirm records sent before stopping or waiting for the next scan */
+          if (!pretend && confirmsent () < 0 && countconnected () == 0)
+          {
+            restart = 1;
+            break;
+          }
 
-      if (!dlconn->writeperm && !pretend)
-      {
-        lprintf (0, "ERROR Write permission not granted for %s", dlconn->addr);
+          /* Retry disconnected destinations after the reconnect interval */
+          if (!scaninterval && !pretend && countconnected () < destcount)
+          {
+            lprintf (0, "Some servers are not connected, data for them will be sent after reconnecting");
+            restart = 1;
+            break;
+          }
 
-        stopsig = 1;
-        exitval = 1;
-        break;
-      }
+          if (!scaninterval)
+          {
+            stopsig = 1;
+            break;
+          }
+
+          if (nextcycle () < 0)
+          {
+            stopsig = 1;
+            exitval = 1;
+            break;
+          }
+
+          /* Reconnect to destinations disconnected during the cycle */
+          if (!pretend && !stopsig && countconnected () < destcount &&
+              (rv = connectdest ()) < 0)
+          {
+            if (rv == -2)
+            {
+              stopsig = 1;
+              exitval = 1;
+              break;
+            }
+
+            restart = 1;
+            break;
+          }
+
+          file = filelist;
+          continue;
+        }
+
+        if (!getdeststate (file))
+        {
+          stopsig = 1;
+          exitval = 1;
+          break;
+        }
+
+        /* Rewind to the first record not acknowledged by a connected
+         * destination, records for disconnected destinations are not
+         * considered acknowledged until they are sent after reconnecting */
+        resume = file->offset;
+        for (dest = destlist; dest; dest = dest->next)
+        {
+          ds = &file->dests[dest->index];
+          ds->unconfirmed = -1;
+
+          if (!pretend && dest->dlconn->link == -1)
+          {
+            ds->missed = ds->ackoffset;
+          }
+          else
+          {
+            ds->missed = -1;
+
+            if (ds->ackoffset < resume)
+              resume = ds->ackoffset;
+          }
+        }
+
+        if (resume < file->offset)
+        {
+          lprintf (1, "%s: resuming from last acknowledged offset %lld (packet ID %lld)",
+                   file->name, (signed long long int)resume,
+                   (signed long long int)file->pktid);
+          file->offset = resume;
+        }
 
-      while (file && !restart && !stopsig)
-      {
         /* Skip file if already sent */
         if (file->offset == file->size)
         {
-          if (!file->next) /* If that was the last file set the stop signal */
+          file = file->next;
+          continue;
+        }
+
+        /* Skip file if claimed by another shard */
+        if (shardclaim && file->claim == 0)
+        {
+          if ((rv = claimfile (file)) < 0)
+          {
             stopsig = 1;
-          else /* Otherwise increment to the next file in the list */
-            file = file->next;
+            exitval = 1;
+            break;
+          }
 
+          file->claim = (rv) ? 1 : -1;
+        }
+
+        if (file->claim < 0)
+        {
+          file = file->next;
           continue;
         }
 
@@ -236,6 +488,7 @@ main (int argc, char **argv)
         /* Reset byte and record counters */
         file->bytecount = 0;
         file->recordcount = 0;
+        filecovered = 0;
 
         /* Set initial file position if this file has been read from */
         if (file->offset > 0)
@@ -248,11 +501,12 @@ main (int argc, char **argv)
           msr_srcname (msr, srcname, 0);
           endtime = msr_endtime (msr);
 
+          if (selections || routes || quotas)
+            msr_srcname (msr, qsrcname, 1);
+
           /* Check if record is matched by selection */
           if (selections)
           {
-            msr_srcname (msr, qsrcname, 1);
-
             if (!(matchsp = ms_matchselect (selections, qsrcname, msr->starttime, endtime, &matchstp)))
             {
               if (verbose >= 3)
@@ -265,6 +519,32 @@ main (int argc, char **argv)
             }
           }
 
+          /* Skip record if covered by the reference coverage, allowing
+           * half a sample period of tolerance */
+          if (reference &&
+              cov_covers (reference, srcname, msr->starttime, endtime,
+                          (msr->samprate > 0.0) ? (hptime_t) (HPTMODULUS / msr->samprate / 2) : 0))
+          {
+            if (verbose >= 3)
+            {
+              char stime[30];
+              ms_hptime2seedtimestr (msr->starttime, stime, 1);
+              ms_log (1, "Skipping (covered) %s, %s\n", srcname, stime);
+            }
+
+            /* Advance the read position unless records are queued, and
+             * the acknowledged positions up to unconfirmed records */
+            if (!quotas || !quota_queued (file))
+            {
+              file->offset = filepos + msr->reclen;
+              updateack (file);
+            }
+
+            filecovered += msr->reclen;
+            coveredbytes += msr->reclen;
+            continue;
+          }
+
           /* Generate stream ID for this record: [filename::]NET_STA_LOC_CHAN/MSEED */
           if (filenames)
             streamlen = snprintf (streamid, sizeof (streamid), "%s::%s/MSEED", file->name, srcname);
@@ -272,7 +552,7 @@ main (int argc, char **argv)
             streamlen = snprintf (streamid, sizeof (streamid), "%s/MSEED", srcname);
 
           /* Check for stream ID truncation */
-          if (streamlen >= sizeof (streamid))
+          if (streamlen >= (int)sizeof (streamid))
           {
             lprintf (0, "ERROR Resulting stream ID is too long: '%s::%s/MSEED'", file->name, srcname);
 
@@ -281,16 +561,20 @@ main (int argc, char **argv)
             break;
           }
 
-          /* Enforce maximum transmission rate */
-          if (maxrate)
+          /* Process control commands and signals, blocks while paused */
+          if (ctlfd >= 0 || printsig)
+            checkcontrol (file);
+
+          /* Enforce maximum transmission rate, by the scheduler when using quotas */
+          if (maxrate && !quotas)
           {
-            uint64_t totalbits = (totalbytes + msr->reclen) * 8;
+            uint64_t totalbits = (totalbytes - ratebytes + msr->reclen) * 8;
 
             gettimeofday (&now, NULL);
 
-            /* Calculate interval since program start */
+            /* Calculate interval since rate reference time */
             interval = (((double)now.tv_sec + (double)now.tv_usec / 1000000) -
-                        ((double)procstart.tv_sec + (double)procstart.tv_usec / 1000000));
+                        ((double)ratestart.tv_sec + (double)ratestart.tv_usec / 1000000));
 
             /* Sleep if rate would be larger than maximum */
             if (interval == 0.0 || ((double)totalbits / interval) > maxrate)
@@ -305,40 +589,59 @@ main (int argc, char **argv)
               if (rateinterval > 0)
               {
                 struct timespec naptime;
-                naptime.tv_sec = 0;
-                naptime.tv_nsec = (long)(rateinterval * 1.0e9);
+                naptime.tv_sec = (time_t)rateinterval;
+                naptime.tv_nsec = (long)((rateinterval - naptime.tv_sec) * 1.0e9);
                 nanosleep (&naptime, NULL);
               }
             }
           }
 
-          lprintf (4, "Sending %s", streamid);
+          /* Queue record for the quota scheduler, which sends queued
+           * records in fair order as the rate limits allow */
+          if (quotas)
+          {
+            strcpy (qheader.network, msr->network);
+            strcpy (qheader.station, msr->station);
+            strcpy (qheader.location, msr->location);
+            strcpy (qheader.channel, msr->channel);
+            strcpy (qheader.srcname, srcname);
+            strcpy (qheader.qsrcname, qsrcname);
+            qheader.starttime = msr->starttime;
+            qheader.endtime = endtime;
+            qheader.samprate = msr->samprate;
+            qheader.samplecnt = msr->samplecnt;
+
+            if (quota_enqueue (qsrcname, msr->record, msr->reclen, filepos,
+                               &qheader, sizeof (qheader), file))
+            {
+              lprintf (0, "Error queueing record for %s", streamid);
+              stopsig = 1;
+              exitval = 1;
+              break;
+            }
 
+            if (quota_dispatch (maxrate, 0, &stopsig, sendqueued))
+            {
+              restart = 1;
+              break;
+            }
+          }
           /* Send record to server */
-          if (!pretend &&
-              dl_write (dlconn, msr->record, msr->reclen, streamid, msr->starttime, endtime, writeack) < 0)
+          else if (sendrecord (file, msr, filepos, streamid, srcname, qsrcname, endtime))
           {
-            lprintf (0, "Error sending record to %s", dlconn->addr);
             restart = 1;
             break;
           }
-          else
-          {
-            /* Track read position in input file */
-            file->offset = filepos + msr->reclen;
 
-            /* Update counts */
-            file->bytecount += msr->reclen;
-            file->recordcount++;
-
-            totalbytes += msr->reclen;
-            totalrecords++;
-
-            /* Add record to trace coverage */
-            if (traces && !mstl_addmsr (traces, msr, 0, 1, -1.0, -1.0))
-            {
-              lprintf (0, "Error adding %s coverage to trace tracking", streamid);
-            }
+          /* Confirm records sent periodically, limiting the data sent
+           * again after a restart without a round trip for every file */
+          if (!pretend &&
+              (totalbytes - confirmbytes >= CONFIRM_BYTES ||
+               time (NULL) - confirmtime >= CONFIRM_INTERVAL) &&
+              confirmsent () < 0 && countconnected () == 0)
+          {
+            restart = 1;
+            break;
           }
 
           if (maxrate)
@@ -385,10 +688,22 @@ main (int argc, char **argv)
         }
         else
         {
-          if (!quiet)
+          if (!quiet && filecovered)
+            lprintf (0, "%s: sent %llu bytes in %llu records, %llu bytes already covered",
+                     file->name, file->bytecount, file->recordcount,
+                     (unsigned long long)filecovered);
+          else if (!quiet)
             lprintf (0, "%s: sent %llu bytes in %llu records",
                      file->name, file->bytecount, file->recordcount);
 
+          /* Records still queued are sent with those of the following files */
+          if (quotas && quota_queued (file))
+            lprintf (1, "%s: %lld bytes queued for rate quotas",
+                     file->name, (long long int)quota_queued (file));
+
+          /* Covered records count as done for the file */
+          file->bytecount += filecovered;
+
           /* Print IO stats */
           if (iostats)
           {
@@ -406,6 +721,9 @@ main (int argc, char **argv)
           }
         }
 
+        /* Advance acknowledged offsets of destinations without records in the file */
+        updateack (file);
+
         if (restart)
           break;
 
@@ -415,17 +733,44 @@ main (int argc, char **argv)
         if (file->next && statefile)
           savestate (statefile);
 
-        if (!file->next) /* If that was the last file set the stop signal */
-          stopsig = 1;
-        else /* Otherwise increment to the next file in the list */
-          file = file->next;
+        file = file->next;
       } /* End of traversing file list */
+
+      /* Confirm delivery of records sent when shutting down, waiting
+       * no longer than the drain timeout */
+      if (stopsig && !pretend && draintimeout > 0)
+      {
+        for (dest = destlist; dest; dest = dest->next)
+        {
+          if (dest->pendcount == 0 || dest->dlconn->link == -1)
+            continue;
+
+          lprintf (1, "Waiting up to %d seconds for confirmation from %s",
+                   draintimeout, dest->dlconn->addr);
+
+          if (dlp_setsocktimeo (dest->dlconn->link, draintimeout) == 1)
+            dest->dlconn->iotimeout = -draintimeout;
+          else
+            dest->dlconn->iotimeout = draintimeout;
+        }
+
+        confirmsent ();
+      }
     }
 
     /* Quit on connection errors if requested */
     if (!stopsig && quitonerror)
       break;
 
+    /* Fail over to another endpoint right away when a connection is lost,
+     * at most once per reconnect interval */
+    if (!stopsig && restart && failover && time (NULL) - lastfailover >= reconnect)
+    {
+      lprintf (0, "Connection lost, failing over to other server endpoints");
+      lastfailover = time (NULL);
+      continue;
+    }
+
     /* Sleep before reconnecting */
     if (!stopsig)
     {
@@ -452,26 +797,57 @@ main (int argc, char **argv)
              (unsigned long long)totalbytes,
              (unsigned long long)totalrecords,
              (unsigned long long)totalfiles);
+
+    if (reference)
+      lprintf (0, "Skipped %llu bytes already covered by the reference coverage",
+               (unsigned long long)coveredbytes);
   }
 
-  /* Shut down the connection to the server */
-  if (!pretend && dlconn->link != -1)
-    dl_disconnect (dlconn);
+  for (dest = destlist; dest; dest = dest->next)
+  {
+    /* Report counts for each destination when routing streams */
+    if (routes && !quiet)
+      lprintf (0, "Sent %llu bytes in %llu records to %s",
+               (unsigned long long)dest->bytecount,
+               (unsigned long long)dest->recordcount, dest->dlconn->addr);
+
+    /* Shut down the connection to the server */
+    if (!pretend && dest->dlconn->link != -1)
+      dl_disconnect (dest->dlconn);
+  }
+
+  /* Commit state only up to the last confirmed record of each file */
+  file = filelist;
+  while (file)
+  {
+    if (file->ackoffset < file->offset)
+    {
+      lprintf (0, "%s: records after offset %lld were not confirmed and will be re-sent",
+               file->name, (signed long long int)file->ackoffset);
+      file->offset = file->ackoffset;
+    }
+
+    file = file->next;
+  }
 
   /* Save the state file */
   if (statefile)
     savestate (statefile);
 
   /* Write SYNC file listing for coverage sent */
-  if (syncfile && traces->numtraces > 0)
-    writesync (traces, (time_t)procstart.tv_sec, (time_t)procend.tv_sec);
+  if (syncfile && coverage && coverage->streamcount > 0)
+    writesync (coverage, cyclestart, (time_t)procend.tv_sec);
+
+  /* Add coverage sent to the cumulative coverage database */
+  if (covdbdir && !pretend && coverage && coverage->streamcount > 0)
+    updatecovdb (coverage, covdbdir);
 
   /* Check that all input data was sent */
   file = filelist;
   allsent = 1;
   while (file)
   {
-    if (file->bytecount != file->size)
+    if (file->bytecount != (uint64_t)file->size && file->claim >= 0)
       allsent = 0;
 
     file = file->next;
@@ -481,8 +857,12 @@ main (int argc, char **argv)
     lprintf (0, "All data transmitted.");
 
   /* Print trace coverage sent */
-  if (verbose >= 3)
-    mstl_printtracelist (traces, 0, 1, 0);
+  if (verbose >= 3 && coverage)
+    cov_print (coverage);
+
+  /* Remove the control socket */
+  if (ctlfd >= 0)
+    ctl_close (ctlfd, ctlpath);
 
   /* Free the global file list */
   freelist (&filelist);
@@ -499,15 +879,27 @@ static void
 printfilelist (FILE *fp)
 {
   FileLink *file = filelist;
+  int idx;
 
   while (file)
   {
-    fprintf (fp, "%s\t%lld\t%lld\t%llu\t%llu\n",
+    fprintf (fp, "%s\t%lld\t%lld\t%llu\t%llu\t%lld\t%lld",
              file->name,
              (signed long long int)file->offset,
              (signed long long int)file->size,
              (unsigned long long int)file->bytecount,
-             (unsigned long long int)file->recordcount);
+             (unsigned long long int)file->recordcount,
+             (signed long long int)file->ackoffset,
+             (signed long long int)file->pktid);
+
+    /* Acknowledged offset for each destination when there are several */
+    if (destcount > 1)
+    {
+      for (idx = 0; idx < destcount; idx++)
+        fprintf (fp, "\t%lld", (signed long long int)((file->dests) ? file->dests[idx].ackoffset : file->ackoffset));
+    }
+
+    fprintf (fp, "\n");
 
     file = file->next;
   }
@@ -518,35 +910,22 @@ printfilelist (FILE *fp)
 /***************************************************************************
  * writesync:
  *
- * Write trace coverage for the given MSTraceList to a SYNC file.
+ * Write the given trace coverage to a SYNC file.
  *
  * Returns 0 on success and -1 on error.
  ***************************************************************************/
 static int
-writesync (MSTraceList *mstl, time_t start, time_t end)
+writesync (Coverage *cov, time_t start, time_t end)
 {
-  MSTraceID *id;
-  MSTraceSeg *seg;
-  FILE *sf = 0;
-  time_t now;
-  struct tm *nt;
+  SyncList list = {0, 0, 0};
   struct tm *st;
   struct tm *et;
-  char yearday[10];
-  char starttime[50];
-  char endtime[50];
   char filename[MAX_FILENAME_LENGTH];
+  char suffix[100];
 
-  if (!mstl)
+  if (!cov)
     return -1;
 
-  /* Generate current time stamp */
-  now = time (NULL);
-  nt = localtime (&now);
-  nt->tm_year += 1900;
-  nt->tm_yday += 1;
-  snprintf (yearday, sizeof (yearday), "%04d,%03d", nt->tm_year, nt->tm_yday);
-
   /* Generate sync file name */
   st = localtime (&start);
   st->tm_year += 1900;
@@ -554,44 +933,35 @@ writesync (MSTraceList *mstl, time_t start, time_t end)
   et = localtime (&end);
   et->tm_year += 1900;
   et->tm_mon += 1;
+
+  /* Include the shard name when sharding, e.g. name.0.sync */
+  if (shardname)
+    snprintf (suffix, sizeof (suffix), ".%s.sync", shardname);
+  else
+    strcpy (suffix, ".sync");
+
   snprintf (filename, sizeof (filename),
-            "%s/%04d-%02d-%02dT%02d:%02d:%02d--%04d-%02d-%02dT%02d:%02d:%02d.sync", workdir,
+            "%s/%04d-%02d-%02dT%02d:%02d:%02d--%04d-%02d-%02dT%02d:%02d:%02d%s", workdir,
             st->tm_year, st->tm_mon, st->tm_mday, st->tm_hour, st->tm_min, st->tm_sec,
-            et->tm_year, et->tm_mon, et->tm_mday, et->tm_hour, et->tm_min, et->tm_sec);
+            et->tm_year, et->tm_mon, et->tm_mday, et->tm_hour, et->tm_min, et->tm_sec,
+            suffix);
 
-  /* Open sync file */
-  if (!(sf = fopen (filename, "w")))
+  /* Collect segments in stream and time order */
+  if (cov_tosync (cov, &list) < 0)
   {
-    lprintf (0, "Error opening SYNC file %s: %s", filename, strerror (errno));
+    lprintf (0, "Error collecting coverage for SYNC file %s", filename);
+    sync_free (&list);
     return -1;
   }
 
-  /* Print header line */
-  fprintf (sf, "DCC|%s\n", yearday);
-
-  /* Trace MSTrace list and print SYNC lines */
-  id = mstl->traces;
-  while (id)
+  if (sync_write (filename, &list, 0))
   {
-    seg = id->first;
-    while (seg)
-    {
-      ms_hptime2seedtimestr (seg->starttime, starttime, 1);
-      ms_hptime2seedtimestr (seg->endtime, endtime, 1);
-
-      fprintf (sf, "%s|%s|%s|%s|%s|%s||%.2g|%" PRId64 "|||||||%s\n",
-               id->network, id->station, id->location, id->channel,
-               starttime, endtime, seg->samprate, seg->samplecnt,
-               yearday);
-
-      seg = seg->next;
-    }
-
-    id = id->next;
+    lprintf (0, "Error writing SYNC file %s: %s", filename, strerror (errno));
+    sync_free (&list);
+    return -1;
   }
 
-  if (sf)
-    fclose (sf);
+  sync_free (&list);
 
   lprintf (1, "Wrote SYNC file %s", filename);
 
@@ -622,7 +992,7 @@ savestate (char *statefile)
   fnsize = snprintf (tmpstatefile, sizeof (tmpstatefile), "%s.tmp", statefile);
 
   /* Check for truncation */
-  if (fnsize >= sizeof (tmpstatefile))
+  if (fnsize >= (int)sizeof (tmpstatefile))
   {
     lprintf (0, "Error, temporary statefile name too long (%d bytes)",
              fnsize);
@@ -640,115 +1010,1902 @@ savestate (char *statefile)
   /* Write file list to temporary state file */
   printfilelist (fp);
 
-  fclose (fp);
+  fclose (fp);
+
+  /* Rename temporary state file overwriting the current state file */
+  if (rename (tmpstatefile, statefile))
+  {
+    lprintf (0, "Error renaming temporary statefile %s->%s: %s",
+             tmpstatefile, statefile, strerror (errno));
+    return -1;
+  }
+
+  return 0;
+} /* End of savestate() */
+
+/***************************************************************************
+ * recoverstate:
+ *
+ * Recover the state information from the state file.
+ *
+ * Returns 1 when state recovered, 0 when state file does not exist
+ * and -1 on error.
+ ***************************************************************************/
+static int
+recoverstate (char *statefile)
+{
+  FileLink *file;
+  char *line;
+  char *ptr;
+  char *endptr;
+  int linesize;
+  int fields, count;
+  int length, idx;
+  FILE *fp;
+
+  char filename[MAX_FILENAME_LENGTH];
+  signed long long int offset, size;
+  unsigned long long int bytecount, recordcount;
+  signed long long int ackoffset, pktid;
+  off_t *destoffsets;
+
+  if ((fp = fopen (statefile, "r")) == NULL)
+  {
+    /* Only log errors other than file not found */
+    if (errno != ENOENT)
+    {
+      lprintf (0, "Error opening statefile %s: %s", statefile, strerror (errno));
+      return -1;
+    }
+    else
+      return 0;
+  }
+
+  lprintf (1, "Recovering state");
+
+  /* Room for the file name, counters and an offset for each destination */
+  linesize = MAX_FILENAME_LENGTH + 150 + destcount * 21;
+
+  if (!(line = (char *)malloc (linesize)) ||
+      !(destoffsets = (off_t *)malloc (destcount * sizeof (off_t))))
+  {
+    lprintf (0, "Error allocating memory");
+    if (line)
+      free (line);
+    fclose (fp);
+    return -1;
+  }
+
+  count = 1;
+
+  while ((fgets (line, linesize, fp)) != NULL)
+  {
+    length = 0;
+    fields = sscanf (line, "%s %lld %lld %llu %llu %lld %lld%n",
+                     filename, &offset, &size, &bytecount, &recordcount,
+                     &ackoffset, &pktid, &length);
+
+    if (fields < 0)
+      continue;
+
+    if (fields < 5)
+    {
+      lprintf (0, "Could not parse line %d of state file", count);
+      continue;
+    }
+
+    /* State files without acknowledgement tracking, all sent data is confirmed */
+    if (fields < 7)
+    {
+      ackoffset = offset;
+      pktid = 0;
+    }
+
+    /* Acknowledged offset for each destination, ignored if the number
+     * of destinations has changed */
+    idx = 0;
+    if (fields == 7 && destcount > 1)
+    {
+      for (ptr = line + length; idx < destcount; idx++, ptr = endptr)
+      {
+        destoffsets[idx] = (off_t)strtoll (ptr, &endptr, 10);
+
+        if (endptr == ptr)
+          break;
+      }
+
+      if (idx > 0 && idx < destcount)
+        lprintf (1, "%s: destinations have changed, ignoring offsets for each destination", filename);
+    }
+
+    /* Find matching entry in input file list and update offset */
+    if ((file = findfile (filename)))
+    {
+      file->offset = offset;
+      file->bytecount = bytecount;
+      file->recordcount = recordcount;
+      file->ackoffset = ackoffset;
+      file->pktid = pktid;
+
+      if (idx == destcount && destcount > 1)
+      {
+        if (!getdeststate (file))
+          break;
+
+        for (idx = 0; idx < destcount; idx++)
+          file->dests[idx].ackoffset = destoffsets[idx];
+      }
+
+      /* A file that shrank has been replaced, send it from the beginning */
+      if (file->size < size)
+      {
+        lprintf (1, "%s: file has been replaced since last execution (%lld => %lld bytes), sending from beginning",
+                 filename, (signed long long int)size, (signed long long int)file->size);
+
+        file->offset = 0;
+        file->bytecount = 0;
+        file->recordcount = 0;
+        file->ackoffset = 0;
+        file->pktid = 0;
+
+        if (file->dests)
+          free (file->dests);
+        file->dests = 0;
+      }
+      else if (file->size != size)
+        lprintf (2, "%s: size has changed since last execution (%lld => %lld)",
+                 filename, (signed long long int)size, (signed long long int)file->size);
+    }
+    /* Input files may have been removed between daemon mode executions */
+    else if (scaninterval)
+    {
+      lprintf (1, "%s: found in state file but no longer an input file", filename);
+    }
+    else
+    {
+      lprintf (0, "%s: found in state file but not an input file", filename);
+      lprintf (0, "Wrong state file?");
+      free (destoffsets);
+      free (line);
+      fclose (fp);
+      return -1;
+    }
+
+    count++;
+  }
+
+  free (destoffsets);
+  free (line);
+  fclose (fp);
+
+  return 1;
+} /* End of recoverstate() */
+
+/***************************************************************************
+ * confirmsent:
+ *
+ * Confirm that all records sent have been received by the servers.  A
+ * server handles commands from a connection in order, so a reply to
+ * an ID exchange means all previously written packets have been
+ * processed.  A destination that fails is disconnected and its
+ * records are re-sent after reconnecting, the other destinations are
+ * not affected.
+ *
+ * Returns 0 on success and -1 if any destination failed.
+ ***************************************************************************/
+static int
+confirmsent (void)
+{
+  Destination *dest;
+  int retval = 0;
+
+  confirmbytes = totalbytes;
+  confirmtime = time (NULL);
+
+  /* Exchange IDs with each destination with unconfirmed records */
+  for (dest = destlist; dest; dest = dest->next)
+  {
+    if (dest->pendcount == 0)
+      continue;
+
+    if (dest->dlconn->link == -1 || dl_exchangeIDs (dest->dlconn, 0) < 0)
+    {
+      lprintf (0, "Error confirming records sent to %s", dest->dlconn->addr);
+      dropdest (dest);
+      retval = -1;
+      continue;
+    }
+
+    lprintf (3, "Confirmed records sent to %s from %d file(s)",
+             dest->dlconn->addr, dest->pendcount);
+
+    confirmdest (dest);
+  }
+
+  return retval;
+} /* End of confirmsent() */
+
+/***************************************************************************
+ * confirmdest:
+ *
+ * Mark all records sent to a destination as confirmed and advance the
+ * acknowledged offsets of the files they were read from.
+ ***************************************************************************/
+static void
+confirmdest (Destination *dest)
+{
+  FileLink *file;
+  int idx;
+
+  for (idx = 0; idx < dest->pendcount; idx++)
+  {
+    file = dest->pending[idx];
+    file->dests[dest->index].unconfirmed = -1;
+    updateack (file);
+  }
+
+  dest->pendcount = 0;
+  dest->unacked = 0;
+} /* End of confirmdest() */
+
+/***************************************************************************
+ * dropdest:
+ *
+ * Disconnect from a destination after an error.  Records sent to the
+ * destination but not confirmed stay unconfirmed for their files and
+ * are sent again after reconnecting.
+ ***************************************************************************/
+static void
+dropdest (Destination *dest)
+{
+  if (dest->dlconn->link != -1)
+    dl_disconnect (dest->dlconn);
+
+  dest->pendcount = 0;
+  dest->unacked = 0;
+} /* End of dropdest() */
+
+/***************************************************************************
+ * countconnected:
+ *
+ * Returns the number of destinations connected, all destinations in
+ * pretend mode.
+ ***************************************************************************/
+static int
+countconnected (void)
+{
+  Destination *dest;
+  int count = 0;
+
+  for (dest = destlist; dest; dest = dest->next)
+    if (pretend || dest->dlconn->link != -1)
+      count++;
+
+  return count;
+} /* End of countconnected() */
+
+/***************************************************************************
+ * getdeststate:
+ *
+ * Get the delivery state of a file for each destination, allocated on
+ * first use with all destinations at the acknowledged offset of the
+ * file.
+ *
+ * Returns the DestState array on success and NULL on error.
+ ***************************************************************************/
+static DestState *
+getdeststate (FileLink *file)
+{
+  int idx;
+
+  if (file->dests)
+    return file->dests;
+
+  if (!(file->dests = (DestState *)malloc (destcount * sizeof (DestState))))
+  {
+    lprintf (0, "Error allocating memory");
+    return NULL;
+  }
+
+  for (idx = 0; idx < destcount; idx++)
+  {
+    file->dests[idx].ackoffset = file->ackoffset;
+    file->dests[idx].unconfirmed = -1;
+    file->dests[idx].missed = -1;
+  }
+
+  return file->dests;
+} /* End of getdeststate() */
+
+/***************************************************************************
+ * updateack:
+ *
+ * Advance the acknowledged offset of each destination for a file up
+ * to the first record not confirmed by or not sent to the destination.
+ * The acknowledged offset of the file is the lowest of them.
+ ***************************************************************************/
+static void
+updateack (FileLink *file)
+{
+  DestState *ds;
+  off_t ackoffset = file->offset;
+  off_t pos;
+  int idx;
+
+  if (!file->dests)
+    return;
+
+  for (idx = 0; idx < destcount; idx++)
+  {
+    ds = &file->dests[idx];
+    pos = file->offset;
+
+    if (ds->unconfirmed >= 0 && ds->unconfirmed < pos)
+      pos = ds->unconfirmed;
+
+    if (ds->missed >= 0 && ds->missed < pos)
+      pos = ds->missed;
+
+    if (pos > ds->ackoffset)
+      ds->ackoffset = pos;
+
+    if (ds->ackoffset < ackoffset)
+      ackoffset = ds->ackoffset;
+  }
+
+  file->ackoffset = ackoffset;
+} /* End of updateack() */
+
+/***************************************************************************
+ * unpendfile:
+ *
+ * Remove a file from the pending lists of all destinations.
+ ***************************************************************************/
+static void
+unpendfile (FileLink *file)
+{
+  Destination *dest;
+  int idx;
+
+  for (dest = destlist; dest; dest = dest->next)
+  {
+    for (idx = 0; idx < dest->pendcount; idx++)
+    {
+      if (dest->pending[idx] == file)
+        dest->pending[idx--] = dest->pending[--dest->pendcount];
+    }
+  }
+} /* End of unpendfile() */
+
+/***************************************************************************
+ * sendrecord:
+ *
+ * Send a record read from the specified file offset to the server
+ * for its stream and track the transmission for the file.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+sendrecord (FileLink *file, MSRecord *msr, off_t filepos, char *streamid,
+            char *srcname, char *qsrcname, hptime_t endtime)
+{
+  Destination *dest;
+  DestState *ds;
+  FileLink **pending;
+  int64_t pktid = 0;
+  int ack;
+
+  /* Determine destination server for stream */
+  dest = (routes) ? finddest (qsrcname) : destlist;
+
+  ds = &file->dests[dest->index];
+
+  /* Track read position in input file, records queued for rate quotas
+   * are sent out of file order so the position is that of the first
+   * record not yet sent */
+  file->offset = (quotas) ? quota_offset (file) : filepos + msr->reclen;
+
+  /* Skip records already acknowledged by the destination, read again
+   * for another destination */
+  if (filepos < ds->ackoffset)
+  {
+    lprintf (4, "Skipping %s, already acknowledged by %s", streamid,
+             dest->dlconn->addr);
+
+    file->bytecount += msr->reclen;
+    updateack (file);
+    return 0;
+  }
+
+  /* Records for a disconnected destination are sent after reconnecting */
+  if (!pretend && dest->dlconn->link == -1)
+  {
+    if (ds->missed < 0 || filepos < ds->missed)
+      ds->missed = filepos;
+
+    return 0;
+  }
+
+  lprintf (4, "Sending %s to %s", streamid, dest->dlconn->addr);
+
+  /* Request acknowledgement for every record or each ackinterval records */
+  ack = (writeack || (ackinterval && dest->unacked + 1 >= (uint32_t)ackinterval));
+
+  /* Send record to server, on error continue with the other destinations */
+  if (!pretend &&
+      (pktid = dl_write (dest->dlconn, msr->record, msr->reclen, streamid, msr->starttime, endtime, ack)) < 0)
+  {
+    lprintf (0, "Error sending record to %s", dest->dlconn->endpoint);
+    dropdest (dest);
+
+    if (ds->missed < 0 || filepos < ds->missed)
+      ds->missed = filepos;
+
+    return (countconnected () > 0) ? 0 : -1;
+  }
+
+  dest->bytecount += msr->reclen;
+  dest->recordcount++;
+  dest->unacked = (ack) ? 0 : dest->unacked + 1;
+
+  /* An acknowledgement confirms all records sent over the connection,
+   * otherwise track the first unconfirmed record of the file */
+  if (ack)
+  {
+    confirmdest (dest);
+
+    if (!pretend)
+      file->pktid = pktid;
+  }
+  else if (!pretend && ds->unconfirmed < 0)
+  {
+    if (dest->pendcount >= dest->pendmax)
+    {
+      dest->pendmax = (dest->pendmax) ? dest->pendmax * 2 : 8;
+
+      if (!(pending = (FileLink **)realloc (dest->pending, dest->pendmax * sizeof (FileLink *))))
+      {
+        lprintf (0, "Error allocating memory");
+        return -1;
+      }
+
+      dest->pending = pending;
+    }
+
+    dest->pending[dest->pendcount++] = file;
+    ds->unconfirmed = filepos;
+  }
+  else if (!pretend && filepos < ds->unconfirmed)
+  {
+    ds->unconfirmed = filepos;
+  }
+
+  /* Track position of the last acknowledged record, limited to the
+   * first record not confirmed by any destination */
+  if (ack || pretend)
+    updateack (file);
+
+  /* Update counts */
+  file->bytecount += msr->reclen;
+  file->recordcount++;
+
+  totalbytes += msr->reclen;
+  totalrecords++;
+
+  /* Add record to trace coverage */
+  if (coverage && cov_addmsr (coverage, srcname, msr, endtime))
+  {
+    lprintf (0, "Error adding %s coverage to trace tracking", streamid);
+  }
+
+  return 0;
+} /* End of sendrecord() */
+
+/***************************************************************************
+ * sendqueued:
+ *
+ * Send a record released by the quota scheduler, the header is the
+ * QueuedHeader of the record and the data pointer is the file the
+ * record was read from, not necessarily the file being read.  The record is not parsed again, a record
+ * structure is filled in from the queued header fields.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+sendqueued (char *record, int reclen, off_t filepos, void *header, void *data)
+{
+  FileLink *file = (FileLink *)data;
+  QueuedHeader qheader;
+  MSRecord msr;
+  char streamid[100];
+
+  if (!header)
+  {
+    lprintf (0, "Error, queued record from %s has no header", file->name);
+    return -1;
+  }
+
+  /* Copy out of the queue which does not guarantee alignment */
+  memcpy (&qheader, header, sizeof (qheader));
+
+  memset (&msr, 0, sizeof (msr));
+  strcpy (msr.network, qheader.network);
+  strcpy (msr.station, qheader.station);
+  strcpy (msr.location, qheader.location);
+  strcpy (msr.channel, qheader.channel);
+  msr.record = record;
+  msr.reclen = reclen;
+  msr.starttime = qheader.starttime;
+  msr.samprate = qheader.samprate;
+  msr.samplecnt = qheader.samplecnt;
+
+  /* Generate stream ID for this record: [filename::]NET_STA_LOC_CHAN/MSEED */
+  if (filenames)
+    snprintf (streamid, sizeof (streamid), "%s::%s/MSEED", file->name, qheader.srcname);
+  else
+    snprintf (streamid, sizeof (streamid), "%s/MSEED", qheader.srcname);
+
+  return sendrecord (file, &msr, filepos, streamid, qheader.srcname,
+                     qheader.qsrcname, qheader.endtime);
+} /* End of sendqueued() */
+
+/***************************************************************************
+ * connectdest:
+ *
+ * Connect to all destination servers that are not connected.  Servers
+ * that cannot be reached are retried later, data for them is held
+ * back without affecting the other servers.
+ *
+ * Returns 0 if any server is connected, -1 if no server is connected
+ * and -2 if write permission is not granted by a server.
+ ***************************************************************************/
+static int
+connectdest (void)
+{
+  Destination *dest;
+
+  for (dest = destlist; dest; dest = dest->next)
+  {
+    if (dest->dlconn->link != -1)
+      continue;
+
+    if (dl_connect (dest->dlconn) < 0)
+    {
+      lprintf (0, "Error connecting to %s", dest->dlconn->addr);
+      continue;
+    }
+
+    if (!quiet)
+      lprintf (0, "Connected to %s", dest->dlconn->endpoint);
+
+    if (!dest->dlconn->writeperm)
+    {
+      lprintf (0, "ERROR Write permission not granted for %s", dest->dlconn->addr);
+      return -2;
+    }
+  }
+
+  return (countconnected () > 0) ? 0 : -1;
+} /* End of connectdest() */
+
+/***************************************************************************
+ * adddest:
+ *
+ * Find the destination for a server address or add a new destination
+ * to the end of the destination list.
+ *
+ * Returns the Destination on success and NULL on error.
+ ***************************************************************************/
+static Destination *
+adddest (char *address, char *progname)
+{
+  Destination *dest;
+  Destination *last = 0;
+
+  for (dest = destlist; dest; dest = dest->next)
+  {
+    if (!strcmp ((dest->dlconn->addrlist) ? dest->dlconn->addrlist : dest->dlconn->addr, address))
+      return dest;
+
+    last = dest;
+  }
+
+  if (!(dest = (Destination *)calloc (1, sizeof (Destination))))
+  {
+    lprintf (0, "Error allocating memory");
+    return NULL;
+  }
+
+  /* Allocate and initialize a new connection description */
+  if (!(dest->dlconn = dl_newdlcp (address, progname)))
+  {
+    lprintf (0, "Error initializing connection to %s", address);
+    free (dest);
+    return NULL;
+  }
+
+  dest->index = destcount++;
+
+  if (last)
+    last->next = dest;
+  else
+    destlist = dest;
+
+  /* A server with multiple endpoints can be failed over to another endpoint */
+  if (strchr (address, ','))
+    failover = 1;
+
+  return dest;
+} /* End of adddest() */
+
+/***************************************************************************
+ * finddest:
+ *
+ * Find the destination for a stream from the first matching route,
+ * streams not matching any route are sent to the default destination.
+ * The last match is cached as records of a stream are usually
+ * consecutive.
+ *
+ * Returns the Destination for the stream.
+ ***************************************************************************/
+static Destination *
+finddest (char *srcname)
+{
+  static char lastsrcname[50] = "";
+  static Destination *lastdest = 0;
+  Route *route;
+
+  if (lastdest && !strcmp (srcname, lastsrcname))
+    return lastdest;
+
+  lastdest = destlist;
+
+  for (route = routes; route; route = route->next)
+  {
+    if (ms_matchselect (route->selections, srcname, HPTERROR, HPTERROR, NULL))
+    {
+      lastdest = route->dest;
+      break;
+    }
+  }
+
+  strncpy (lastsrcname, srcname, sizeof (lastsrcname) - 1);
+
+  return lastdest;
+} /* End of finddest() */
+
+/***************************************************************************
+ * readroutefile:
+ *
+ * Read a list of stream routes from a file.  Each line contains
+ * network, station, location and channel patterns followed by the
+ * server to send matching streams to:
+ *
+ * #net sta  loc  chan  host:port
+ * IU   *    *    *     host1:16000
+ * II   ANMO 00   BH?   host2:16000
+ *
+ * The patterns may contain globbing characters, a location ID of "--"
+ * matches a blank location.  Routes are matched in the order listed.
+ *
+ * Returns the number of routes read on success and -1 on error.
+ ***************************************************************************/
+static int
+readroutefile (char *routefile, char *progname)
+{
+  FILE *fp;
+  Route *route;
+  Route *last = 0;
+  char line[200];
+  char net[20], sta[20], loc[20], chan[20], address[100];
+  int linecount = 0;
+  int count = 0;
+  int fields;
+
+  if (!(fp = fopen (routefile, "r")))
+  {
+    lprintf (0, "Cannot open route file %s: %s", routefile, strerror (errno));
+    return -1;
+  }
+
+  while (fgets (line, sizeof (line), fp))
+  {
+    linecount++;
+
+    /* Skip empty and comment lines */
+    fields = sscanf (line, "%19s %19s %19s %19s %99s", net, sta, loc, chan, address);
+
+    if (fields <= 0 || net[0] == '#')
+      continue;
+
+    if (fields != 5)
+    {
+      lprintf (0, "Could not parse line %d of route file: %s", linecount, line);
+      fclose (fp);
+      return -1;
+    }
+
+    if (!(route = (Route *)calloc (1, sizeof (Route))))
+    {
+      lprintf (0, "Error allocating memory");
+      fclose (fp);
+      return -1;
+    }
+
+    if (ms_addselect_comp (&route->selections, net, sta, loc, chan, NULL,
+                           HPTERROR, HPTERROR) ||
+        !(route->dest = adddest (address, progname)))
+    {
+      lprintf (0, "Error adding route from line %d of route file", linecount);
+      fclose (fp);
+      return -1;
+    }
+
+    lprintf (2, "Routing %s_%s_%s_%s to %s", net, sta, loc, chan, address);
+
+    if (last)
+      last->next = route;
+    else
+      routes = route;
+
+    last = route;
+    count++;
+  }
+
+  fclose (fp);
+
+  return count;
+} /* End of readroutefile() */
+
+/***************************************************************************
+ * readquotafile:
+ *
+ * Read a list of stream rate quotas from a file.  Each line contains
+ * network, station, location and channel patterns followed by the
+ * maximum rate for all matching streams and an optional weight for
+ * sharing the rate between stations:
+ *
+ * #net sta  loc  chan  maxrate  [weight]
+ * IU   *    *    *     2M
+ * IU   ANMO *    *     500k
+ * II   *    *    *     -        4
+ *
+ * The maximum rate is specified in bits/second with an optional k, M
+ * or G suffix, a rate of "-" or 0 specifies no limit.  A stream
+ * matching multiple quotas is limited by all of them and stations
+ * share the available rate in proportion to the weight of the first
+ * matching quota that specifies one, the default weight is 1.
+ *
+ * Returns the number of quotas read on success and -1 on error.
+ ***************************************************************************/
+static int
+readquotafile (char *quotafile)
+{
+  FILE *fp;
+  char line[200];
+  char net[20], sta[20], loc[20], chan[20], ratestr[30];
+  int64_t rate;
+  int linecount = 0;
+  int count = 0;
+  int weight;
+  int fields;
+
+  if (!(fp = fopen (quotafile, "r")))
+  {
+    lprintf (0, "Cannot open quota file %s: %s", quotafile, strerror (errno));
+    return -1;
+  }
+
+  while (fgets (line, sizeof (line), fp))
+  {
+    linecount++;
+    weight = 0;
+
+    /* Skip empty and comment lines */
+    fields = sscanf (line, "%19s %19s %19s %19s %29s %d", net, sta, loc, chan, ratestr, &weight);
+
+    if (fields <= 0 || net[0] == '#')
+      continue;
+
+    if (fields < 5 || weight < 0)
+    {
+      lprintf (0, "Could not parse line %d of quota file: %s", linecount, line);
+      fclose (fp);
+      return -1;
+    }
+
+    if (!strcmp (ratestr, "-") || !strcmp (ratestr, "0"))
+      rate = 0;
+    else if ((rate = calcbitsize (ratestr)) <= 0)
+    {
+      lprintf (0, "Invalid rate on line %d of quota file: %s", linecount, ratestr);
+      fclose (fp);
+      return -1;
+    }
+
+    if (quota_addrule (net, sta, loc, chan, rate, weight))
+    {
+      lprintf (0, "Error adding quota from line %d of quota file", linecount);
+      fclose (fp);
+      return -1;
+    }
+
+    lprintf (2, "Quota for %s_%s_%s_%s: %s bits/s, weight %d", net, sta, loc, chan,
+             (rate) ? ratestr : "unlimited", (weight) ? weight : 1);
+
+    count++;
+  }
+
+  fclose (fp);
+
+  return count;
+} /* End of readquotafile() */
+
+/***************************************************************************
+ * claimfile:
+ *
+ * Claim an input file for this shard by exclusively creating a claim
+ * file in the claims directory of the workdir.  The claim file is
+ * named by a hash of the input file name and contains the shard name
+ * and the input file name.  Claims are never released, an existing
+ * claim by this shard (e.g. before a restart) is owned by this shard.
+ *
+ * Exclusive file creation is atomic on local file systems and NFS
+ * version 3 and later, so a shared workdir may be used by shards
+ * running on different hosts.
+ *
+ * Returns 1 if the file is claimed by this shard, 0 if claimed by
+ * another shard and -1 on error.
+ ***************************************************************************/
+static int
+claimfile (FileLink *file)
+{
+  char claimpath[MAX_FILENAME_LENGTH];
+  char line[MAX_FILENAME_LENGTH + 100];
+  char *name = 0;
+  FILE *fp;
+  int fd;
+  int len;
+  int rv;
+
+  /* Claims are named by the input file path relative to its input root */
+  snprintf (claimpath, sizeof (claimpath), "%s/claims/%016llx.claim",
+            workdir, (unsigned long long)hashname64 (file->name + file->keyoffset));
+
+  if ((fd = open (claimpath, O_WRONLY | O_CREAT | O_EXCL, 0666)) >= 0)
+  {
+    len = snprintf (line, sizeof (line), "%s\t%s\n", shardname, file->name + file->keyoffset);
+
+    rv = (write (fd, line, len) != len);
+
+    if (close (fd))
+      rv = 1;
+
+    /* Remove a partial claim so the file can be claimed again */
+    if (rv)
+    {
+      lprintf (0, "Error writing claim file %s: %s", claimpath, strerror (errno));
+      unlink (claimpath);
+      return -1;
+    }
+
+    lprintf (1, "%s: claimed by this shard", file->name);
+
+    return 1;
+  }
+
+  if (errno != EEXIST)
+  {
+    lprintf (0, "Error creating claim file %s: %s", claimpath, strerror (errno));
+    return -1;
+  }
+
+  /* Read the shard name and file name of the existing claim */
+  if (!(fp = fopen (claimpath, "r")))
+  {
+    lprintf (0, "Error opening claim file %s: %s", claimpath, strerror (errno));
+    return -1;
+  }
+
+  if (!fgets (line, sizeof (line), fp))
+    line[0] = '\0';
+
+  fclose (fp);
+
+  if ((name = strchr (line, '\t')))
+  {
+    *name++ = '\0';
+    name[strcspn (name, "\n")] = '\0';
+  }
+
+  if (name && !strcmp (line, shardname) && !strcmp (name, file->name + file->keyoffset))
+  {
+    lprintf (1, "%s: previously claimed by this shard", file->name);
+    return 1;
+  }
+
+  lprintf (2, "%s: claimed by shard %s", file->name, (name) ? line : "unknown");
+
+  return 0;
+} /* End of claimfile() */
+
+/***************************************************************************
+ * mergesync:
+ *
+ * Merge SYNC files, e.g. those written by each shard, into a single
+ * SYNC file.  Contiguous segments are joined and duplicates removed.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mergesync (char *outfile, char **syncfiles, int count)
+{
+  SyncList list;
+  int segcount = 0;
+  int rv;
+  int idx;
+
+  memset (&list, 0, sizeof (list));
+
+  for (idx = 0; idx < count; idx++)
+  {
+    if ((rv = sync_read (syncfiles[idx], &list)) < 0)
+    {
+      lprintf (0, "Error reading SYNC file %s: %s", syncfiles[idx], strerror (errno));
+      sync_free (&list);
+      return -1;
+    }
+
+    lprintf (1, "Read %d segments from %s", rv, syncfiles[idx]);
+    segcount += rv;
+  }
+
+  sync_merge (&list, 0);
+
+  if (sync_write (outfile, &list, 0))
+  {
+    lprintf (0, "Error writing SYNC file %s: %s", outfile, strerror (errno));
+    sync_free (&list);
+    return -1;
+  }
+
+  if (!quiet)
+    lprintf (0, "Merged %d segments from %d SYNC file(s) into %d segments in %s",
+             segcount, count, list.count, outfile);
+
+  sync_free (&list);
+
+  return 0;
+} /* End of mergesync() */
+
+/***************************************************************************
+ * updatecovdb:
+ *
+ * Add trace coverage to the cumulative coverage database.  The
+ * database is a directory with the coverage of each stream in a file
+ * named NET_STA_LOC_CHAN, a SYNC listing with contiguous and
+ * overlapping segments joined.  New coverage is appended to a
+ * NET_STA_LOC_CHAN.log file of the stream, which is merged into the
+ * stream file when it is at least COVDB_COMPACTSIZE bytes and as
+ * large as the stream file, so an update only writes the new segments
+ * and occasionally rewrites the files of the streams updated.
+ *
+ * Updates are made while holding a lock on the .lock file of the
+ * directory so multiple processes, e.g. shards, can share a database.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+updatecovdb (Coverage *cov, char *dbdir)
+{
+  SyncList list;
+  SyncSeg *seg;
+  char lockfile[MAX_FILENAME_LENGTH];
+  char srcname[50];
+  int lockfd;
+  int first;
+  int last;
+  int streams = 0;
+  int rv = 0;
+
+  if (!cov || !dbdir)
+    return -1;
+
+  if (snprintf (lockfile, sizeof (lockfile), "%s/.lock", dbdir) >= (int)sizeof (lockfile))
+  {
+    lprintf (0, "Error, coverage database directory name too long: %s", dbdir);
+    return -1;
+  }
+
+  if (mkdir (dbdir, 0777) && errno != EEXIST)
+  {
+    lprintf (0, "Error creating coverage database %s: %s", dbdir, strerror (errno));
+    return -1;
+  }
+
+  if ((lockfd = open (lockfile, O_RDWR | O_CREAT, 0644)) < 0)
+  {
+    lprintf (0, "Error opening coverage database lock file %s: %s", lockfile, strerror (errno));
+    return -1;
+  }
+
+  if (lockf (lockfd, F_LOCK, 0))
+  {
+    lprintf (0, "Error locking coverage database %s: %s", dbdir, strerror (errno));
+    close (lockfd);
+    return -1;
+  }
+
+  memset (&list, 0, sizeof (list));
+
+  if (cov_tosync (cov, &list) < 0)
+  {
+    lprintf (0, "Error collecting coverage for database %s", dbdir);
+    rv = -1;
+  }
+
+  /* Append the segments of each stream to its log */
+  for (first = 0; !rv && first < list.count; first = last)
+  {
+    seg = &list.segs[first];
+
+    for (last = first + 1; last < list.count; last++)
+    {
+      if (strcmp (seg->network, list.segs[last].network) ||
+          strcmp (seg->station, list.segs[last].station) ||
+          strcmp (seg->location, list.segs[last].location) ||
+          strcmp (seg->channel, list.segs[last].channel))
+        break;
+    }
+
+    snprintf (srcname, sizeof (srcname), "%s_%s_%s_%s",
+              seg->network, seg->station, seg->location, seg->channel);
+
+    rv = updatecovstream (dbdir, srcname, &list, first, last - first);
+    streams++;
+  }
+
+  if (!rv)
+    lprintf (1, "Updated coverage database %s, %d segments of %d streams",
+             dbdir, list.count, streams);
+
+  sync_free (&list);
+  close (lockfd);
+
+  return rv;
+} /* End of updatecovdb() */
+
+/***************************************************************************
+ * updatecovstream:
+ *
+ * Append count segments of a list starting at first to the log of a
+ * stream in the coverage database and merge the log into the stream
+ * file when it has grown large enough.  The caller holds the
+ * database lock.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+updatecovstream (char *dbdir, char *srcname, SyncList *list, int first, int count)
+{
+  SyncList merged;
+  struct stat st;
+  char streamfile[MAX_FILENAME_LENGTH];
+  char logfile[MAX_FILENAME_LENGTH];
+  char tmpfile[MAX_FILENAME_LENGTH];
+  off_t streamsize = 0;
+  int idx;
+  int rv = -1;
+
+  if (strchr (srcname, '/') ||
+      snprintf (streamfile, sizeof (streamfile), "%s/%s", dbdir, srcname) >= (int)sizeof (streamfile) ||
+      snprintf (logfile, sizeof (logfile), "%s/%s.log", dbdir, srcname) >= (int)sizeof (logfile) ||
+      snprintf (tmpfile, sizeof (tmpfile), "%s/%s.tmp", dbdir, srcname) >= (int)sizeof (tmpfile))
+  {
+    lprintf (0, "Error, invalid coverage database stream file name: %s/%s", dbdir, srcname);
+    return -1;
+  }
+
+  if (sync_append (logfile, list, first, count))
+  {
+    lprintf (0, "Error writing coverage database %s: %s", logfile, strerror (errno));
+    return -1;
+  }
+
+  if (!stat (streamfile, &st))
+    streamsize = st.st_size;
+
+  if (stat (logfile, &st) || st.st_size < COVDB_COMPACTSIZE || st.st_size < streamsize)
+    return 0;
+
+  /* Merge the log into the stream file */
+  memset (&merged, 0, sizeof (merged));
+
+  if ((sync_read (streamfile, &merged) < 0 && errno != ENOENT) ||
+      sync_read (logfile, &merged) < 0)
+  {
+    lprintf (0, "Error reading coverage database files of %s: %s", srcname, strerror (errno));
+  }
+  else
+  {
+    /* Database rates are written at full precision */
+    for (idx = 0; idx < merged.count; idx++)
+      merged.segs[idx].rounded = 0;
+
+    sync_merge (&merged, 1);
+
+    if (sync_write (tmpfile, &merged, 1))
+      lprintf (0, "Error writing coverage database %s: %s", tmpfile, strerror (errno));
+    else if (rename (tmpfile, streamfile))
+      lprintf (0, "Error renaming coverage database %s->%s: %s", tmpfile, streamfile, strerror (errno));
+    else if (unlink (logfile))
+      lprintf (0, "Error removing coverage database log %s: %s", logfile, strerror (errno));
+    else
+      rv = 0;
+  }
+
+  sync_free (&merged);
+
+  return rv;
+} /* End of updatecovstream() */
+
+/***************************************************************************
+ * querycovdb:
+ *
+ * Print the coverage missing from the cumulative coverage database
+ * between startstr and endstr for streams matching pattern, a
+ * NET_STA_LOC_CHAN glob, e.g. "IU_ANMO_*_BH?".  Streams in the
+ * database without any coverage in the time window are listed as
+ * missing the entire window.  Only the files of matching streams are
+ * read.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+querycovdb (char *dbdir, char *pattern, char *startstr, char *endstr)
+{
+  Selections *selections = NULL;
+  DIR *dir;
+  struct dirent *de;
+  SyncList list;
+  SyncSeg *seg;
+  SyncSeg *stream = NULL;
+  hptime_t start;
+  hptime_t end;
+  hptime_t from = 0;
+  hptime_t period = 0;
+  char srcname[50];
+  char path[MAX_FILENAME_LENGTH];
+  size_t namelen;
+  int gapcount = 0;
+  int lockfd;
+  int idx;
+
+  start = ms_seedtimestr2hptime (startstr);
+  end   = ms_seedtimestr2hptime (endstr);
+
+  if (start == HPTERROR || end == HPTERROR || end <= start)
+  {
+    lprintf (0, "Invalid coverage query time window: %s to %s", startstr, endstr);
+    return -1;
+  }
+
+  if (ms_addselect (&selections, pattern, HPTERROR, HPTERROR))
+  {
+    lprintf (0, "Cannot add coverage query pattern: %s", pattern);
+    return -1;
+  }
+
+  if (snprintf (path, sizeof (path), "%s/.lock", dbdir) >= (int)sizeof (path) ||
+      (lockfd = open (path, O_RDWR)) < 0)
+  {
+    lprintf (0, "Error opening coverage database %s: %s", dbdir, strerror (errno));
+    ms_freeselections (selections);
+    return -1;
+  }
+
+  /* Wait for updates in progress so stream files are complete */
+  if (lockf (lockfd, F_LOCK, 0) || !(dir = opendir (dbdir)))
+  {
+    lprintf (0, "Error opening coverage database %s: %s", dbdir, strerror (errno));
+    ms_freeselections (selections);
+    close (lockfd);
+    return -1;
+  }
+
+  memset (&list, 0, sizeof (list));
+
+  /* Read the stream and log files of matching streams */
+  while ((de = readdir (dir)))
+  {
+    if (de->d_name[0] == '.')
+      continue;
+
+    namelen = strlen (de->d_name);
+
+    if (namelen > 4 && !strcmp (de->d_name + namelen - 4, ".tmp"))
+      continue;
+
+    if (namelen > 4 && !strcmp (de->d_name + namelen - 4, ".log"))
+      namelen -= 4;
+
+    if (namelen >= sizeof (srcname))
+      continue;
+
+    memcpy (srcname, de->d_name, namelen);
+    srcname[namelen] = '\0';
+
+    if (!ms_matchselect (selections, srcname, HPTERROR, HPTERROR, NULL))
+      continue;
+
+    if (snprintf (path, sizeof (path), "%s/%s", dbdir, de->d_name) >= (int)sizeof (path) ||
+        sync_read (path, &list) < 0)
+    {
+      lprintf (0, "Error reading coverage database %s: %s", path, strerror (errno));
+      closedir (dir);
+      close (lockfd);
+      ms_freeselections (selections);
+      sync_free (&list);
+      return -1;
+    }
+  }
+
+  closedir (dir);
+  close (lockfd);
+  ms_freeselections (selections);
+
+  /* Database rates are written at full precision */
+  for (idx = 0; idx < list.count; idx++)
+    list.segs[idx].rounded = 0;
+
+  sync_merge (&list, 1);
+
+  printf ("   Source                Missing from             Missing until            Duration\n");
+
+  /* Walk the segments of each stream in time order, tracking the time
+   * of the next expected sample from the start of the window */
+  for (idx = 0; idx < list.count; idx++)
+  {
+    seg = &list.segs[idx];
+
+    /* Start of a stream, finish the window of the previous stream */
+    if (!stream ||
+        strcmp (seg->network, stream->network) || strcmp (seg->station, stream->station) ||
+        strcmp (seg->location, stream->location) || strcmp (seg->channel, stream->channel))
+    {
+      if (stream && end - from > period / 2)
+        gapcount += printgap (srcname, from, end);
+
+      stream = seg;
+      from   = start;
+      period = 0;
+      snprintf (srcname, sizeof (srcname), "%s_%s_%s_%s",
+                seg->network, seg->station, seg->location, seg->channel);
+    }
+
+    /* Skip segments outside of the window or already covered */
+    if (seg->endtime < from || seg->starttime >= end)
+      continue;
+
+    period = (seg->samprate > 0.0) ? (hptime_t) (HPTMODULUS / seg->samprate) : 0;
+
+    if (seg->starttime - from > period / 2)
+      gapcount += printgap (srcname, from, seg->starttime);
+
+    if (seg->endtime + period > from)
+      from = seg->endtime + period;
+  }
+
+  if (stream && end - from > period / 2)
+    gapcount += printgap (srcname, from, end);
+
+  printf ("Total: %d gap(s)\n", gapcount);
+
+  sync_free (&list);
+
+  return 0;
+} /* End of querycovdb() */
+
+/***************************************************************************
+ * printgap:
+ *
+ * Print a time range missing from a stream for querycovdb(), the
+ * duration is formatted as in mstl_printgaplist().
+ *
+ * Returns 1 for counting printed gaps.
+ ***************************************************************************/
+static int
+printgap (char *srcname, hptime_t from, hptime_t until)
+{
+  char fromstr[30];
+  char untilstr[30];
+  char gapstr[20];
+  double gap;
+
+  ms_hptime2seedtimestr (from, fromstr, 1);
+  ms_hptime2seedtimestr (until, untilstr, 1);
+
+  gap = (double)(until - from) / HPTMODULUS;
+
+  if (gap >= 86400.0)
+    snprintf (gapstr, sizeof (gapstr), "%-3.1fd", gap / 86400.0);
+  else if (gap >= 3600.0)
+    snprintf (gapstr, sizeof (gapstr), "%-3.1fh", gap / 3600.0);
+  else
+    snprintf (gapstr, sizeof (gapstr), "%-4.4g", gap);
+
+  printf ("%-17s %-24s %-24s %s\n", srcname, fromstr, untilstr, gapstr);
+
+  return 1;
+} /* End of printgap() */
+
+/***************************************************************************
+ * readreference:
+ *
+ * Read a reference SYNC file, e.g. a listing of data held by the DMC,
+ * into the reference coverage used to skip data already covered.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+readreference (char *syncfile)
+{
+  SyncList list;
+  int rv;
+
+  memset (&list, 0, sizeof (list));
+
+  if ((rv = sync_read (syncfile, &list)) < 0)
+  {
+    lprintf (0, "Error reading reference SYNC file %s: %s", syncfile, strerror (errno));
+    sync_free (&list);
+    return -1;
+  }
+
+  /* Sort and join segments for the reference coverage */
+  sync_merge (&list, 1);
+
+  if ((!reference && !(reference = cov_init ())) ||
+      cov_addsync (reference, &list))
+  {
+    lprintf (0, "Error building reference coverage from %s", syncfile);
+    sync_free (&list);
+    return -1;
+  }
+
+  lprintf (1, "Read %d reference segments from %s, %d streams", rv, syncfile,
+           reference->streamcount);
+
+  sync_free (&list);
+
+  return 0;
+} /* End of readreference() */
+
+/***************************************************************************
+ * checkcontrol:
+ *
+ * Handle pending signal requests and commands from the control
+ * socket.  While the transfer is paused this routine blocks, waiting
+ * for commands and keeping the server connection alive, until the
+ * transfer is resumed or the program is stopped.
+ ***************************************************************************/
+static void
+checkcontrol (FileLink *current)
+{
+  char command[256];
+  time_t lastkeepalive = time (NULL);
+  int client;
+
+  do
+  {
+    /* Print file list as requested by signal */
+    if (printsig)
+    {
+      printsig = 0;
+      fprintf (stderr, "Filename\tOffset\tSize\tBytes\tRecords\tAckOffset\tPacketID\n");
+      printfilelist (stderr);
+    }
+
+    if (ctlfd < 0)
+      break;
+
+    /* Handle all pending commands, waiting up to a second while paused */
+    while ((client = ctl_poll (ctlfd, command, sizeof (command), (paused) ? 1000 : 0)) > 0)
+    {
+      lprintf (2, "Control command: %s", command);
+      controlcommand (client, command, current);
+      ctl_done (client);
+    }
+
+    if (client < 0)
+    {
+      lprintf (0, "Error with control socket, disabling: %s", strerror (errno));
+      ctl_close (ctlfd, ctlpath);
+      ctlfd = -1;
+      paused = 0;
+    }
+
+    /* Keep an idle connection alive while paused */
+    if (paused)
+      sendkeepalive (&lastkeepalive);
+  } while (paused && !stopsig);
+} /* End of checkcontrol() */
+
+/***************************************************************************
+ * sendkeepalive:
+ *
+ * Exchange IDs with the server to keep an idle connection alive if
+ * the keepalive interval has passed since the last keepalive time,
+ * which is updated.
+ ***************************************************************************/
+static void
+sendkeepalive (time_t *lastkeepalive)
+{
+  Destination *dest;
+  time_t now = time (NULL);
+  int sent = 0;
+
+  if (pretend)
+    return;
+
+  for (dest = destlist; dest; dest = dest->next)
+  {
+    if (dest->dlconn->link == -1 || dest->dlconn->keepalive <= 0 ||
+        (now - *lastkeepalive) < dest->dlconn->keepalive)
+      continue;
+
+    lprintf (2, "Sending keepalive to %s", dest->dlconn->addr);
+
+    /* Disconnect on errors, records for the destination are then marked
+     * as missed and it is reconnected by the main loop at the end of the
+     * file list, after the scan interval in daemon mode */
+    if (dl_exchangeIDs (dest->dlconn, 0) < 0)
+    {
+      lprintf (0, "Error sending keepalive to %s", dest->dlconn->addr);
+      dropdest (dest);
+    }
+
+    sent = 1;
+  }
+
+  if (sent)
+    *lastkeepalive = now;
+} /* End of sendkeepalive() */
+
+/***************************************************************************
+ * nextcycle:
+ *
+ * Complete a daemon mode cycle: write a SYNC file for the data sent
+ * during the cycle, save the state file, wait for the scan interval
+ * while keeping the server connection alive and rescan the inputs.
+ *
+ * Returns 0 on success and -1 if coverage tracking cannot be reset.
+ ***************************************************************************/
+static int
+nextcycle (void)
+{
+  struct timespec naptime;
+  time_t now = time (NULL);
+  time_t lastkeepalive = now;
+  time_t scantime = now + scaninterval;
+
+  /* Write SYNC file for the cycle and reset coverage tracking */
+  if (coverage && coverage->streamcount > 0)
+  {
+    if (syncfile)
+      writesync (coverage, cyclestart, now);
+
+    if (covdbdir && !pretend)
+      updatecovdb (coverage, covdbdir);
+
+    cov_free (coverage);
+
+    if (!(coverage = cov_init ()))
+    {
+      lprintf (0, "Error allocating coverage tracking");
+      return -1;
+    }
+  }
+
+  if (statefile)
+    savestate (statefile);
+
+  lprintf (2, "Next input scan in %d seconds", scaninterval);
+
+  naptime.tv_sec = 1;
+  naptime.tv_nsec = 0;
+
+  while (!stopsig && time (NULL) < scantime)
+  {
+    nanosleep (&naptime, NULL);
+
+    if (ctlfd >= 0 || printsig)
+      checkcontrol (NULL);
+
+    sendkeepalive (&lastkeepalive);
+  }
+
+  if (stopsig)
+    return 0;
+
+  cyclestart = time (NULL);
+
+  lprintf (2, "Scanning input files");
+
+  if (scaninputs () < 0)
+    lprintf (0, "Error scanning input files, will retry next scan");
+
+  return 0;
+} /* End of nextcycle() */
+
+/***************************************************************************
+ * scaninputs:
+ *
+ * Scan all input files, directories and list files.  New files are
+ * added to the input list, the size and modification time of known
+ * files are updated and files no longer found are removed.  Input
+ * files and directories are scanned before list files.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+scaninputs (void)
+{
+  FileLink *input;
+  FileLink *file;
+  FileLink *prev;
+  FileLink *next;
+  FileLink **chain;
+  int listfiles;
+
+  scancount++;
+
+  for (listfiles = 0; listfiles <= 1; listfiles++)
+  {
+    for (input = inputlist; input; input = input->next)
+    {
+      if ((input->name[0] == '@') != listfiles)
+        continue;
+
+      if (listfiles && addlistfile (input->name + 1) < 0)
+      {
+        lprintf (0, "Error processing list file %s", input->name + 1);
+        return -1;
+      }
+      else if (!listfiles && addfile (NULL, input->name, NULL) < 0)
+      {
+        lprintf (0, "Error adding input file %s", input->name);
+        return -1;
+      }
+    }
+  }
+
+  /* Remove files that were not found, only done after a complete scan */
+  prev = 0;
+  for (file = filelist; file; file = next)
+  {
+    next = file->next;
+
+    if (file->scan == scancount)
+    {
+      prev = file;
+      continue;
+    }
+
+    lprintf (1, "%s: no longer found, removing from input list", file->name);
+
+    /* Remove from hash table chain */
+    chain = &filehash[hashname (file->name) % filehashsize];
+    while (*chain != file)
+      chain = &(*chain)->hashnext;
+    *chain = file->hashnext;
+
+    /* Remove from input list */
+    if (prev)
+      prev->next = next;
+    else
+      filelist = next;
+
+    inputbytes -= file->size;
+    filecount--;
+    unpendfile (file);
+    if (file->dests)
+      free (file->dests);
+    free (file);
+  }
+
+  lastfile = prev;
+
+  return 0;
+} /* End of scaninputs() */
+
+/***************************************************************************
+ * findfile:
+ *
+ * Find an entry in the global input file list by name.
+ *
+ * Returns the matching FileLink or NULL if not found.
+ ***************************************************************************/
+static FileLink *
+findfile (char *filename)
+{
+  FileLink *file;
+
+  if (!filehashsize)
+    return NULL;
+
+  file = filehash[hashname (filename) % filehashsize];
+
+  while (file && strcmp (file->name, filename))
+    file = file->hashnext;
+
+  return file;
+} /* End of findfile() */
+
+/***************************************************************************
+ * hashfile:
+ *
+ * Add an entry of the global input file list to the file name hash
+ * table, the table is doubled in size when full.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+hashfile (FileLink *file)
+{
+  FileLink **newhash;
+  FileLink *entry;
+  FileLink *next;
+  uint32_t slot;
+  int newsize;
+  int idx;
+
+  if (filecount >= filehashsize)
+  {
+    newsize = (filehashsize) ? filehashsize * 2 : 1024;
+
+    if (!(newhash = (FileLink **)calloc (newsize, sizeof (FileLink *))))
+    {
+      lprintf (0, "Error allocating memory");
+      return -1;
+    }
+
+    /* Move all entries to the new table */
+    for (idx = 0; idx < filehashsize; idx++)
+    {
+      for (entry = filehash[idx]; entry; entry = next)
+      {
+        next = entry->hashnext;
+        slot = hashname (entry->name) % newsize;
+        entry->hashnext = newhash[slot];
+        newhash[slot] = entry;
+      }
+    }
+
+    if (filehash)
+      free (filehash);
 
-  /* Rename temporary state file overwriting the current state file */
-  if (rename (tmpstatefile, statefile))
-  {
-    lprintf (0, "Error renaming temporary statefile %s->%s: %s",
-             tmpstatefile, statefile, strerror (errno));
-    return -1;
+    filehash = newhash;
+    filehashsize = newsize;
   }
 
+  slot = hashname (file->name) % filehashsize;
+  file->hashnext = filehash[slot];
+  filehash[slot] = file;
+  filecount++;
+
   return 0;
-} /* End of savestate() */
+} /* End of hashfile() */
 
 /***************************************************************************
- * recoverstate:
+ * controlcommand:
  *
- * Recover the state information from the state file.
+ * Execute a command received on the control socket and reply to the
+ * client.  Recognized commands:
  *
- * Returns 1 when state recovered, 0 when state file does not exist
- * and -1 on error.
+ * status          : report transfer progress
+ * rate <maxrate>  : set maximum transmission rate, 0 to disable
+ * pause           : pause the transfer
+ * resume          : resume a paused transfer
+ * priority <file> : send the specified input file next
+ * checkpoint      : confirm records sent and save the state file
  ***************************************************************************/
-static int
-recoverstate (char *statefile)
+static void
+controlcommand (int client, char *command, FileLink *current)
 {
   FileLink *file;
-  char line[MAX_FILENAME_LENGTH + 30];
-  int fields, count;
-  FILE *fp;
-  flag found;
-
-  char filename[MAX_FILENAME_LENGTH];
-  signed long long int offset, size;
-  unsigned long long int bytecount, recordcount;
+  FileLink *prev;
+  struct timeval now;
+  char verb[32];
+  char ratestr[50];
+  char *arg;
+  int argoffset = 0;
+  double interval;
+  uint64_t inflight = 0;
+  uint64_t remaining = 0;
+  int remainingfiles = 0;
+  int rv;
 
-  if ((fp = fopen (statefile, "r")) == NULL)
+  verb[0] = '\0';
+  if (sscanf (command, "%31s %n", verb, &argoffset) < 1)
   {
-    /* Only log errors other than file not found */
-    if (errno != ENOENT)
-    {
-      lprintf (0, "Error opening statefile %s: %s", statefile, strerror (errno));
-      return -1;
-    }
-    else
-      return 0;
+    ctl_reply (client, "ERROR empty command");
+    return;
   }
+  arg = command + argoffset;
 
-  lprintf (1, "Recovering state");
+  if (!strcasecmp (verb, "status"))
+  {
+    gettimeofday (&now, NULL);
+    interval = (((double)now.tv_sec + (double)now.tv_usec / 1000000) -
+                ((double)procstart.tv_sec + (double)procstart.tv_usec / 1000000));
 
-  count = 1;
+    for (file = filelist; file; file = file->next)
+    {
+      inflight += file->offset - file->ackoffset;
 
-  while ((fgets (line, sizeof (line), fp)) != NULL)
-  {
-    fields = sscanf (line, "%s %lld %lld %llu %llu\n",
-                     filename, &offset, &size, &bytecount, &recordcount);
+      if (file->offset < file->size)
+      {
+        remaining += file->size - file->offset;
+        remainingfiles++;
+      }
+    }
 
-    if (fields < 0)
-      continue;
+    ctl_reply (client, "State: %s", (paused) ? "paused" : "running");
 
-    if (fields < 5)
+    if (maxrate)
     {
-      lprintf (0, "Could not parse line %d of state file", count);
-      continue;
+      makeratestr (ratestr, sizeof (ratestr), maxrate);
+      ctl_reply (client, "Maximum rate: %s", ratestr);
+    }
+    else
+    {
+      ctl_reply (client, "Maximum rate: none");
     }
 
-    /* Find matching entry in input file list */
-    found = 0;
-    file = filelist;
-    while (file)
+    makeratestr (ratestr, sizeof (ratestr), 8 * ((interval > 0) ? (totalbytes / interval) : 0));
+    ctl_reply (client, "Sent: %llu bytes in %llu records from %llu file(s) (%s)",
+               (unsigned long long)totalbytes, (unsigned long long)totalrecords,
+               (unsigned long long)totalfiles, ratestr);
+    ctl_reply (client, "In-flight: %llu bytes not yet confirmed",
+               (unsigned long long)inflight);
+    ctl_reply (client, "Remaining: %llu bytes in %d file(s)",
+               (unsigned long long)remaining, remainingfiles);
+
+    if (quotas)
+      ctl_reply (client, "Queued: %lld bytes waiting for rate quotas",
+                 (long long int)quota_queued (NULL));
+
+    if (totalbytes > 0 && interval > 0)
+      ctl_reply (client, "ETA: %.0f seconds", remaining / (totalbytes / interval));
+    else
+      ctl_reply (client, "ETA: unknown");
+
+    /* Progress of current and partially sent files */
+    for (file = filelist; file; file = file->next)
+    {
+      if (file == current || (file->offset > 0 && file->offset < file->size))
+        ctl_reply (client, "%s %s: %lld of %lld bytes (%d%%)",
+                   (file == current) ? "Sending" : "Partial", file->name,
+                   (signed long long int)file->offset, (signed long long int)file->size,
+                   (file->size) ? (int)(100.0 * file->offset / file->size) : 100);
+    }
+  }
+  else if (!strcasecmp (verb, "rate"))
+  {
+    if (!strcmp (arg, "0"))
+    {
+      maxrate = 0;
+    }
+    else
     {
-      /* Shortcut if this entry has already been updated */
-      if (file->offset > 0)
+      int64_t newrate = calcbitsize (arg);
+
+      if (!newrate)
       {
-        file = file->next;
-        continue;
+        ctl_reply (client, "ERROR cannot parse rate: '%s'", arg);
+        return;
       }
 
-      /* Compare file names and update offset if match found */
-      if (!strcmp (filename, file->name))
-      {
-        file->offset = offset;
-        file->bytecount = bytecount;
-        file->recordcount = recordcount;
+      maxrate = newrate;
+    }
+
+    /* Restart rate limiting from the current time */
+    gettimeofday (&ratestart, NULL);
+    ratebytes = totalbytes;
 
-        if (file->size != size)
-          lprintf (2, "%s: size has changed since last execution (%lld => %lld)",
-                   filename, (signed long long int)size, (signed long long int)file->size);
+    lprintf (0, "Maximum rate set to %s by control command", (*arg) ? arg : "0");
+    ctl_reply (client, "OK");
+  }
+  else if (!strcasecmp (verb, "pause"))
+  {
+    if (!paused)
+      lprintf (0, "Transfer paused by control command");
+
+    paused = 1;
+    ctl_reply (client, "OK");
+  }
+  else if (!strcasecmp (verb, "resume"))
+  {
+    if (paused)
+    {
+      lprintf (0, "Transfer resumed by control command");
+
+      /* Restart rate limiting so the pause is not made up in a burst */
+      gettimeofday (&ratestart, NULL);
+      ratebytes = totalbytes;
+    }
 
-        found = 1;
+    paused = 0;
+    ctl_reply (client, "OK");
+  }
+  else if (!strcasecmp (verb, "priority"))
+  {
+    /* Find the file and the entry before it */
+    for (prev = 0, file = filelist; file; prev = file, file = file->next)
+      if (!strcmp (file->name, arg))
         break;
-      }
 
-      file = file->next;
+    if (!file)
+    {
+      ctl_reply (client, "ERROR not an input file: '%s'", arg);
+      return;
     }
 
-    if (!found)
+    if (file == current || file->offset == file->size)
     {
-      lprintf (0, "%s: found in state file but not an input file", filename);
-      lprintf (0, "Wrong state file?");
-      fclose (fp);
-      return -1;
+      ctl_reply (client, "ERROR file is being sent or already sent: '%s'", arg);
+      return;
     }
 
-    count++;
-  }
+    if ((current && current->next != file) || (!current && prev))
+    {
+      /* Remove file from the list */
+      if (prev)
+        prev->next = file->next;
+      else
+        filelist = file->next;
 
-  fclose (fp);
+      if (lastfile == file)
+        lastfile = prev;
 
-  return 1;
-} /* End of recoverstate() */
+      /* Insert file after the current file or at the beginning between scans */
+      if (current)
+      {
+        file->next = current->next;
+        current->next = file;
+      }
+      else
+      {
+        file->next = filelist;
+        filelist = file;
+      }
+
+      if (!file->next)
+        lastfile = file;
+    }
+
+    lprintf (0, "%s: will be sent next by control command", file->name);
+    ctl_reply (client, "OK");
+  }
+  else if (!strcasecmp (verb, "checkpoint"))
+  {
+    /* The state is saved up to the confirmed records even if some
+     * servers fail to confirm */
+    rv = (!pretend) ? confirmsent () : 0;
+
+    if (!statefile || savestate (statefile))
+      ctl_reply (client, "ERROR cannot save state file");
+    else if (rv < 0)
+      ctl_reply (client, "ERROR cannot confirm records sent with all servers, state saved up to confirmed records");
+    else
+      ctl_reply (client, "OK");
+  }
+  else
+  {
+    ctl_reply (client, "ERROR unrecognized command: '%s'", verb);
+  }
+} /* End of controlcommand() */
 
 /***************************************************************************
  * processparam:
@@ -760,7 +2917,6 @@ recoverstate (char *statefile)
 static int
 processparam (int argcount, char **argvec)
 {
-  FileLink *listfiles = 0;
   char *selectfile = 0;
   char *address = 0;
   char *tptr;
@@ -811,6 +2967,30 @@ processparam (int argcount, char **argvec)
     {
       writeack = 1;
     }
+    else if (strcmp (argvec[optind], "-ACKI") == 0)
+    {
+      ackinterval = strtol (getoptval (argcount, argvec, optind++), NULL, 10);
+
+      if (ackinterval <= 0)
+      {
+        lprintf (0, "Error parsing acknowledgement interval");
+        exit (1);
+      }
+    }
+    else if (strcmp (argvec[optind], "-dt") == 0)
+    {
+      draintimeout = strtol (getoptval (argcount, argvec, optind++), NULL, 10);
+    }
+    else if (strcmp (argvec[optind], "-D") == 0)
+    {
+      scaninterval = strtol (getoptval (argcount, argvec, optind++), NULL, 10);
+
+      if (scaninterval <= 0)
+      {
+        lprintf (0, "Error parsing daemon mode scan interval");
+        exit (1);
+      }
+    }
     else if (strcmp (argvec[optind], "-mr") == 0)
     {
       maxrate = calcbitsize (getoptval (argcount, argvec, optind++));
@@ -838,9 +3018,83 @@ processparam (int argcount, char **argvec)
     {
       statefile = getoptval (argcount, argvec, optind++);
     }
+    else if (strcmp (argvec[optind], "-shard") == 0)
+    {
+      shardname = getoptval (argcount, argvec, optind++);
+
+      /* Claim files by name: claim:name, or shard by path hash: index/count */
+      if (!strncmp (shardname, "claim:", 6) && shardname[6])
+      {
+        shardname += 6;
+        shardclaim = 1;
+      }
+      else if (sscanf (shardname, "%d/%d", &shardindex, &shardcount) != 2 ||
+               shardcount < 1 || shardindex < 0 || shardindex >= shardcount)
+      {
+        lprintf (0, "Invalid shard specification: %s", shardname);
+        exit (1);
+      }
+      else
+      {
+        *strchr (shardname, '/') = '\0';
+      }
+
+      if (strchr (shardname, '/'))
+      {
+        lprintf (0, "Shard name cannot contain '/': %s", shardname);
+        exit (1);
+      }
+    }
+    else if (strcmp (argvec[optind], "-CD") == 0)
+    {
+      covdbdir = getoptval (argcount, argvec, optind++);
+    }
+    else if (strcmp (argvec[optind], "-GF") == 0)
+    {
+      if (readreference (getoptval (argcount, argvec, optind++)))
+        exit (1);
+    }
+    else if (strcmp (argvec[optind], "-CQ") == 0)
+    {
+      /* Query a coverage database for missing data */
+      if (optind + 4 >= argcount)
+      {
+        lprintf (0, "Option -CQ requires a database directory, stream pattern, start and end time");
+        exit (1);
+      }
+
+      exit ((querycovdb (argvec[optind + 1], argvec[optind + 2],
+                         argvec[optind + 3], argvec[optind + 4]))
+                ? 1
+                : 0);
+    }
+    else if (strcmp (argvec[optind], "-MS") == 0)
+    {
+      /* Merge SYNC files, all remaining arguments are input SYNC files */
+      if (optind + 2 >= argcount)
+      {
+        lprintf (0, "Option -MS requires an output file and input SYNC files");
+        exit (1);
+      }
+
+      exit ((mergesync (argvec[optind + 1], &argvec[optind + 2], argcount - optind - 2)) ? 1 : 0);
+    }
+    else if (strcmp (argvec[optind], "-C") == 0)
+    {
+      ctlpath = getoptval (argcount, argvec, optind++);
+    }
     else if (strcmp (argvec[optind], "-l") == 0)
     {
-      addfile (&listfiles, getoptval (argcount, argvec, optind++), NULL);
+      if (addinput (getoptval (argcount, argvec, optind++), 1) < 0)
+        exit (1);
+    }
+    else if (strcmp (argvec[optind], "-R") == 0)
+    {
+      routefile = getoptval (argcount, argvec, optind++);
+    }
+    else if (strcmp (argvec[optind], "-Q") == 0)
+    {
+      quotafile = getoptval (argcount, argvec, optind++);
     }
     else if (strcmp (argvec[optind], "-s") == 0)
     {
@@ -863,20 +3117,14 @@ processparam (int argcount, char **argvec)
       /* Otherwise check for an input file list */
       else if (tptr[0] == '@')
       {
-        if (addfile (&listfiles, tptr + 1, NULL) < 0)
-        {
-          lprintf (0, "Error adding list file %s", tptr + 1);
+        if (addinput (tptr + 1, 1) < 0)
           exit (1);
-        }
       }
       /* Otherwise this is an input file */
       else
       {
-        if (addfile (NULL, tptr, NULL) < 0)
-        {
-          lprintf (0, "Error adding input file %s", tptr + 1);
+        if (addinput (tptr, 0) < 0)
           exit (1);
-        }
       }
     }
   }
@@ -900,8 +3148,9 @@ processparam (int argcount, char **argvec)
     exit (1);
   }
 
-  /* Allocate and initialize a new connection description */
-  dlconn = dl_newdlcp (address, argvec[0]);
+  /* Allocate and initialize the default destination */
+  if (!adddest (address, argvec[0]))
+    exit (1);
 
   /* Initialize the verbosity for the ms_log and dl_log functions */
   ms_loginit (&lprintf0, "", &lprintf0, "");
@@ -914,24 +3163,22 @@ processparam (int argcount, char **argvec)
   if (pretend)
     lprintf (0, "Pretend mode");
 
-  /* Process any list files and free the list of lists */
-  if (listfiles)
-  {
-    FileLink *listfile = listfiles;
-    while (listfile)
-    {
-      lprintf (1, "Reading list file: %s", listfile->name);
-
-      if (addlistfile (listfile->name) < 0)
-      {
-        lprintf (0, "Error processing list file %s", listfile);
-        exit (1);
-      }
+  /* Scan input files, directories and list files */
+  if (scaninputs () < 0)
+    exit (1);
 
-      listfile = listfile->next;
-    }
+  /* Read stream routing file */
+  if (routefile && readroutefile (routefile, argvec[0]) < 0)
+  {
+    lprintf (0, "Cannot read stream routing file");
+    exit (1);
+  }
 
-    freelist (&listfile);
+  /* Read stream rate quota file */
+  if (quotafile && (quotas = readquotafile (quotafile)) < 0)
+  {
+    lprintf (0, "Cannot read stream rate quota file");
+    exit (1);
   }
 
   /* Read data selection file */
@@ -946,23 +3193,52 @@ processparam (int argcount, char **argvec)
     }
   }
 
-  /* Make sure input files/dirs specified */
-  if (filelist == 0)
+  /* Make sure input files/dirs specified, may be empty in daemon mode */
+  if (filelist == 0 && (!scaninterval || !inputlist))
   {
     lprintf (0, "No input files or directories were specified");
     exit (1);
   }
 
-  /* Setup default state file as "workdir/statefile" */
+  /* Setup default state file as "workdir/statefile" or "workdir/statefile.shard" */
   if (!statefile)
   {
     char sfile[256];
 
-    snprintf (sfile, sizeof (sfile), "%s/statefile", workdir);
+    if (shardname)
+      snprintf (sfile, sizeof (sfile), "%s/statefile.%s", workdir, shardname);
+    else
+      snprintf (sfile, sizeof (sfile), "%s/statefile", workdir);
 
     statefile = strdup (sfile);
   }
 
+  /* Create the directory for shard claims */
+  if (shardclaim)
+  {
+    char claimdir[MAX_FILENAME_LENGTH];
+
+    snprintf (claimdir, sizeof (claimdir), "%s/claims", workdir);
+
+    if (mkdir (claimdir, 0777) && errno != EEXIST)
+    {
+      lprintf (0, "Error creating claim directory %s: %s", claimdir, strerror (errno));
+      exit (1);
+    }
+  }
+
+  /* Open control socket */
+  if (ctlpath)
+  {
+    if ((ctlfd = ctl_open (ctlpath)) < 0)
+    {
+      lprintf (0, "Error opening control socket %s: %s", ctlpath, strerror (errno));
+      exit (1);
+    }
+
+    lprintf (1, "Listening for control commands on %s", ctlpath);
+  }
+
   /* Attempt to recover state */
   recovery = recoverstate (statefile);
 
@@ -1144,6 +3420,8 @@ addfile (FileLink **list, char *filename, struct stat *stp)
   FileLink *newfile;
   FileLink *last;
   struct stat st;
+  char *cp;
+  int keyoffset;
   int filelen;
 
   if (!filename)
@@ -1178,17 +3456,80 @@ addfile (FileLink **list, char *filename, struct stat *stp)
     stp = &st;
   }
 
-  /* If the file is actually a directory add files it contains recursively */
+  /* If the file is actually a directory add files it contains recursively,
+   * shard keys of the files are their paths relative to the directory */
   if (S_ISDIR (stp->st_mode))
   {
+    shardrootlen = strlen (filename) + 1;
+
     if (adddir (filename, filename, maxrecur))
     {
+      shardrootlen = 0;
       return -1;
     }
+
+    shardrootlen = 0;
   }
   /* If the file is a regular file add it to the input list */
   else if (S_ISREG (stp->st_mode))
   {
+    /* Shard key: the path relative to the input directory or, for
+     * files specified directly, the file name without directory, so
+     * shards given different paths to the same data agree */
+    if (shardrootlen > 0 && shardrootlen < filelen)
+      keyoffset = shardrootlen;
+    else if ((cp = strrchr (filename, '/')))
+      keyoffset = cp - filename + 1;
+    else
+      keyoffset = 0;
+
+    /* Skip input files owned by other shards when sharding by path hash */
+    if (shardcount && (!list || list == &filelist) &&
+        hashname (filename + keyoffset) % (uint32_t)shardcount != (uint32_t)shardindex)
+      return 0;
+
+    /* Update an existing entry of the global input list when rescanning */
+    if ((!list || list == &filelist) && (newfile = findfile (filename)))
+    {
+      newfile->scan = scancount;
+
+      if (stp->st_size == newfile->size && stp->st_mtime == newfile->modtime &&
+          stp->st_ino == newfile->inode)
+        return 0;
+
+      /* Send a replaced file from the beginning: a new inode, or a file
+       * modified without growing, appending data only grows a file */
+      if (stp->st_ino != newfile->inode || stp->st_size <= newfile->size)
+      {
+        lprintf (1, "%s: file has been replaced (%lld => %lld bytes), sending from beginning",
+                 filename, (signed long long int)newfile->size,
+                 (signed long long int)stp->st_size);
+
+        newfile->offset = 0;
+        newfile->ackoffset = 0;
+        newfile->pktid = 0;
+        newfile->bytecount = 0;
+        newfile->recordcount = 0;
+
+        unpendfile (newfile);
+        if (newfile->dests)
+          free (newfile->dests);
+        newfile->dests = 0;
+      }
+      else
+      {
+        lprintf (2, "%s: file has changed (%lld => %lld)", filename,
+                 (signed long long int)newfile->size, (signed long long int)stp->st_size);
+      }
+
+      inputbytes += stp->st_size - newfile->size;
+      newfile->size = stp->st_size;
+      newfile->modtime = stp->st_mtime;
+      newfile->inode = stp->st_ino;
+
+      return 0;
+    }
+
     /* Create the new FileLink */
     if (!(newfile = (FileLink *)malloc (sizeof (FileLink) + filelen + 1)))
     {
@@ -1197,10 +3538,19 @@ addfile (FileLink **list, char *filename, struct stat *stp)
     }
 
     newfile->next = 0;
+    newfile->hashnext = 0;
     newfile->offset = 0;
     newfile->size = stp->st_size;
+    newfile->modtime = stp->st_mtime;
+    newfile->inode = stp->st_ino;
+    newfile->scan = scancount;
     newfile->bytecount = 0;
     newfile->recordcount = 0;
+    newfile->ackoffset = 0;
+    newfile->pktid = 0;
+    newfile->dests = 0;
+    newfile->keyoffset = keyoffset;
+    newfile->claim = 0;
     memcpy (newfile->name, filename, filelen + 1);
 
     inputbytes += stp->st_size;
@@ -1214,6 +3564,9 @@ addfile (FileLink **list, char *filename, struct stat *stp)
         lastfile->next = newfile;
 
       lastfile = newfile;
+
+      if (hashfile (newfile) < 0)
+        return -1;
     }
     /* Otherwise insert the new FileLink at the end of the specified list */
     else
@@ -1311,7 +3664,7 @@ adddir (char *targetdir, char *basedir, int level)
                             "%s/%s", basedir, de->d_name);
 
     /* Make sure the filename was not truncated */
-    if (filenamelen >= sizeof (filename))
+    if (filenamelen >= (int)sizeof (filename))
     {
       lprintf (0, "File name beyond maximum of %d characters:", sizeof (filename));
       lprintf (0, "  %s", filename);
@@ -1373,6 +3726,54 @@ adddir (char *targetdir, char *basedir, int level)
   return 0;
 } /* End of adddir() */
 
+/***************************************************************************
+ * addinput:
+ *
+ * Add an input file, directory or list file as specified by the user
+ * to the list of inputs (inputlist), list files are stored with a
+ * '@' prefix.  The inputs are read by scaninputs().
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+addinput (char *name, int listfile)
+{
+  FileLink *newinput;
+  FileLink *last;
+  int namelen = strlen (name);
+
+  if (namelen > MAX_FILENAME_LENGTH)
+  {
+    lprintf (0, "File name longer than maximum allowd (%d): '%s'",
+             MAX_FILENAME_LENGTH, name);
+    return -1;
+  }
+
+  if (!(newinput = (FileLink *)calloc (1, sizeof (FileLink) + namelen + 1)))
+  {
+    lprintf (0, "Error allocating memory");
+    return -1;
+  }
+
+  if (listfile)
+    newinput->name[0] = '@';
+
+  memcpy (newinput->name + ((listfile) ? 1 : 0), name, namelen + 1);
+
+  if (!inputlist)
+  {
+    inputlist = newinput;
+  }
+  else
+  {
+    for (last = inputlist; last->next; last = last->next)
+      ;
+    last->next = newinput;
+  }
+
+  return 0;
+} /* End of addinput() */
+
 /***************************************************************************
  * addlistfile:
  *
@@ -1385,7 +3786,7 @@ addlistfile (char *filename)
 {
   FILE *fp;
   char filelistent[MAX_FILENAME_LENGTH];
-  int filecount = 0;
+  int count = 0;
   int rv;
 
   lprintf (1, "Reading list file '%s'", filename);
@@ -1418,16 +3819,16 @@ addlistfile (char *filename)
 
     if (rv < 0)
     {
-      filecount = rv;
+      count = rv;
       break;
     }
 
-    filecount += rv;
+    count += rv;
   }
 
   fclose (fp);
 
-  return filecount;
+  return count;
 } /* End of addlistfile() */
 
 /***************************************************************************
@@ -1450,12 +3851,26 @@ freelist (FileLink **list)
   while (file)
   {
     next = file->next;
+    if (file->dests)
+      free (file->dests);
     free (file);
     file = next;
   }
 
   *list = 0;
 
+  /* Free the file name hash table of the global input list */
+  if (list == &filelist)
+  {
+    if (filehash)
+      free (filehash);
+
+    filehash = 0;
+    filehashsize = 0;
+    filecount = 0;
+    lastfile = 0;
+  }
+
   return 0;
 } /* End of freelist() */
 
@@ -1472,8 +3887,7 @@ term_handler (int sig)
 static void
 print_handler (int sig)
 {
-  fprintf (stderr, "Filename\tInode\tOffset\tModtime\n");
-  printfilelist (stderr);
+  printsig = 1;
 }
 
 /***************************************************************************
@@ -1513,6 +3927,10 @@ lprintf (int level, const char *fmt, ...)
   struct tm *tp;
   time_t curtime;
 
+  /* Local time string of the last message, rebuilt when the second changes */
+  static time_t lasttime = -1;
+  static char timestr[80];
+
   char *day[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
   char *month[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul",
                    "Aug", "Sep", "Oct", "Nov", "Dec"};
@@ -1521,16 +3939,23 @@ lprintf (int level, const char *fmt, ...)
   {
     /* Build local time string and generate final output */
     curtime = time (NULL);
-    tp = localtime (&curtime);
+
+    if (curtime != lasttime)
+    {
+      tp = localtime (&curtime);
+
+      snprintf (timestr, sizeof (timestr), "%3.3s %3.3s %2.2d %2.2d:%2.2d:%2.2d %4.4d",
+                day[tp->tm_wday], month[tp->tm_mon], tp->tm_mday,
+                tp->tm_hour, tp->tm_min, tp->tm_sec, tp->tm_year + 1900);
+
+      lasttime = curtime;
+    }
 
     va_start (argptr, fmt);
     rv = vsnprintf (message, sizeof (message), fmt, argptr);
     va_end (argptr);
 
-    printf ("%3.3s %3.3s %2.2d %2.2d:%2.2d:%2.2d %4.4d - %s: %s\n",
-            day[tp->tm_wday], month[tp->tm_mon], tp->tm_mday,
-            tp->tm_hour, tp->tm_min, tp->tm_sec, tp->tm_year + 1900,
-            PACKAGE, message);
+    printf ("%s - %s: %s\n", timestr, PACKAGE, message);
 
     fflush (stdout);
   }
@@ -1560,14 +3985,32 @@ usage ()
                    " -q             Be quiet, do not print diagnostics or transmission summary\n"
                    " -NS            Do not write a SYNC file after sending data\n"
                    " -ACK           Require acknowledgements from the server for each record (slow)\n"
+                   " -ACKI count    Require an acknowledgement every count records, resume from last\n"
+                   " -dt timeout    Seconds to wait for confirmation at shutdown (default: %d)\n"
+                   " -D interval    Daemon mode, rescan inputs every interval seconds and send new data\n"
                    " -mr rate       Maximum transmission rate in bits/second, no limit by default\n"
                    " -I             Print transfer rate during transmission\n"
                    " -It interval   Interval in seconds to print transfer statistics (default: %d)\n"
                    " -w workdir     Location to write SYNC and (default) state file\n"
                    " -S statefile   File to track transfer status, default is workdir/statefile\n"
+                   " -C ctlsocket   Listen for control commands on a local socket\n"
                    " -l listfile    File containing a list of input files and/or directories\n"
                    " -s file        Specify a file containing data selection criteria\n"
+                   " -R routefile   Specify a file of stream routes to other servers\n"
+                   " -Q quotafile   Specify a file of stream rate quotas\n"
+                   " -shard spec    Send a shard of the input files: index/count by path hash\n"
+                   "                  or claim:name to claim files in a shared workdir\n"
+                   " -MS out files  Merge SYNC files (e.g. of shards) into a single SYNC file and exit\n"
+                   " -CD dbdir      Add coverage sent to a cumulative coverage database directory\n"
+                   " -CQ dbdir pattern start end\n"
+                   "                Print coverage missing from a database for NET_STA_LOC_CHAN\n"
+                   "                  pattern streams between start and end times and exit\n"
+                   " -GF syncfile   Gap fill, only send data not covered by a reference SYNC file\n"
+                   "\n"
+                   "The server may be a comma separated list of host:port endpoints, the\n"
+                   "fastest to connect is used and others are failed over to on errors.\n"
+                   "IPv6 addresses must be enclosed in brackets, e.g. [::1]:16000\n"
                    "\n",
-           iostatsint);
+           draintimeout, iostatsint);
   exit (1);
 } /* End of usage() */
@@ -0,0 +1,626 @@
+/***************************************************************************
+ * quota.c
+ *
+ * Stream rate quotas and fair sharing of the transmission rate.
+ *
+ * Quota rules match streams by network, station, location and channel
+ * patterns and limit the rate of all streams they match, a stream
+ * matching multiple rules is limited by all of them.  This allows a
+ * hierarchy of limits, e.g. a cap for a network and a lower cap for
+ * one of its stations, under the global maximum rate.
+ *
+ * Records are queued by station and released by a self-clocked fair
+ * queueing scheduler: each record is tagged with a virtual finish
+ * time advanced by its size divided by the station weight and the
+ * record with the lowest tag among the stations whose limits allow
+ * sending is released next.  Records of a station, and therefore of
+ * each stream, are always released in the order queued.
+ *
+ * Records stay queued from one input file to the next so the rate is
+ * shared between the stations of all files being sent.  Queued
+ * records are also listed by their owner, the input file passed with
+ * them, in the order read to track the offset up to which each file
+ * has been sent.
+ *
+ * modified: 2026.291
+ ***************************************************************************/
+
+#include "quota.h"
+#include "hash.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+/* Maximum bytes of queued records before reading waits for sending */
+#define QUOTA_WINDOW (64 * 1024 * 1024)
+
+/* Seconds of unused rate that may be accumulated for a burst */
+#define QUOTA_BURST 1.0
+
+/* Number of slots in the stream and station hash tables */
+#define QUOTA_HASHSIZE 1024
+
+/* Rate limit, for a rule or the global maximum rate */
+typedef struct QuotaRule_s
+{
+  struct QuotaRule_s *next;
+  Selections *selections; /* Stream selection for rule */
+  int64_t maxrate;        /* Maximum rate in bits/second, 0 for no limit */
+  int weight;             /* Weight of matching stations, 0 if not specified */
+  double tokens;          /* Bits that may be sent, negative when overdrawn */
+  double filltime;        /* Time tokens were last added */
+} QuotaRule;
+
+/* Queued record */
+typedef struct QuotaRecord_s
+{
+  struct QuotaRecord_s *next;
+  struct QuotaRecord_s *ownernext; /* Next queued record of owner */
+  struct QuotaRecord_s *ownerprev; /* Previous queued record of owner */
+  struct QuotaOwner_s *owner;      /* Owner of record */
+  struct QuotaStream_s *stream;    /* Stream of record */
+  double finish;                /* Virtual finish time */
+  off_t filepos;                /* Offset of record in input file */
+  int reclen;                   /* Length of record */
+  int headerlen;                /* Length of caller header data following record */
+  char record[1];               /* Record and header data, allocated to reclen + headerlen */
+} QuotaRecord;
+
+/* Station queue of records */
+typedef struct QuotaStation_s
+{
+  struct QuotaStation_s *hashnext;
+  struct QuotaStation_s *activenext; /* Next station with queued records */
+  char name[24];                     /* Station as NET_STA */
+  int weight;                        /* Share of rate relative to other stations */
+  double finish;                     /* Virtual finish time of last queued record */
+  QuotaRecord *head;                 /* First queued record */
+  QuotaRecord *tail;                 /* Last queued record */
+} QuotaStation;
+
+/* Owner of queued records, e.g. an input file */
+typedef struct QuotaOwner_s
+{
+  struct QuotaOwner_s *hashnext;
+  void *data;           /* Caller data passed to the send routine */
+  QuotaRecord *first;   /* First queued record in read order */
+  QuotaRecord *last;    /* Last queued record in read order */
+  int64_t queued;       /* Bytes of queued records */
+  off_t readend;        /* Offset after the last record queued */
+} QuotaOwner;
+
+/* Stream and the rules that apply to it */
+typedef struct QuotaStream_s
+{
+  struct QuotaStream_s *hashnext;
+  QuotaStation *station; /* Station queue of stream */
+  QuotaRule **rules;     /* Matching rules with rate limits */
+  int rulecount;         /* Number of matching rules with rate limits */
+  char name[50];         /* Stream as NET_STA_LOC_CHAN_QUAL */
+} QuotaStream;
+
+static QuotaRule *rules = 0;                 /* Rules in order of precedence */
+static QuotaRule global;                     /* Global maximum rate */
+static QuotaStream *streams[QUOTA_HASHSIZE]; /* Hash table of streams */
+static QuotaStation *stations[QUOTA_HASHSIZE]; /* Hash table of stations */
+static QuotaOwner *owners[QUOTA_HASHSIZE];   /* Hash table of owners with queued records */
+static QuotaStation *active = 0;             /* Stations with queued records */
+static double vclock = 0.0;                  /* Virtual time of last released record */
+static int64_t queued = 0;                   /* Bytes of queued records */
+
+static QuotaStream *findstream (char *srcname);
+static QuotaOwner *findowner (void *data, int add);
+static void freeowner (QuotaOwner *owner);
+static void filltokens (QuotaRule *rule, int64_t maxrate, double now);
+static double recordwait (QuotaRecord *rec);
+static double dtime (void);
+
+/***************************************************************************
+ * quota_addrule:
+ *
+ * Add a rate limit rule for streams matching the specified patterns.
+ * A maxrate of 0 does not limit the rate, a weight of 0 does not
+ * set the weight of matching stations.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+quota_addrule (char *net, char *sta, char *loc, char *chan,
+               int64_t maxrate, int weight)
+{
+  QuotaRule *rule;
+  QuotaRule **last = &rules;
+
+  if (!(rule = (QuotaRule *)calloc (1, sizeof (QuotaRule))))
+    return -1;
+
+  if (ms_addselect_comp (&rule->selections, net, sta, loc, chan, NULL,
+                         HPTERROR, HPTERROR))
+  {
+    free (rule);
+    return -1;
+  }
+
+  rule->maxrate  = maxrate;
+  rule->weight   = weight;
+  rule->tokens   = maxrate * QUOTA_BURST;
+  rule->filltime = dtime ();
+
+  while (*last)
+    last = &(*last)->next;
+
+  *last = rule;
+
+  return 0;
+} /* End of quota_addrule() */
+
+/***************************************************************************
+ * quota_enqueue:
+ *
+ * Add a copy of a record to the queue of its station, srcname is the
+ * stream as NET_STA_LOC_CHAN_QUAL.  A copy of the header data, if
+ * any, and the owner data, e.g. the input file, are passed with the
+ * record when it is sent so the caller does not need to parse the
+ * record again.  Records of an owner must be queued in read order.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+quota_enqueue (char *srcname, char *record, int reclen, off_t filepos,
+               void *header, int headerlen, void *data)
+{
+  QuotaStream *stream;
+  QuotaStation *station;
+  QuotaOwner *owner;
+  QuotaRecord *rec;
+  double start;
+
+  if (!(stream = findstream (srcname)))
+    return -1;
+
+  if (!(owner = findowner (data, 1)))
+    return -1;
+
+  if (!header)
+    headerlen = 0;
+
+  if (!(rec = (QuotaRecord *)malloc (sizeof (QuotaRecord) + reclen + headerlen)))
+    return -1;
+
+  station = stream->station;
+
+  /* Tag with virtual finish time, starting from the later of the
+   * current virtual time and the finish of the previous record */
+  start = (station->finish > vclock) ? station->finish : vclock;
+
+  rec->next    = 0;
+  rec->owner   = owner;
+  rec->stream  = stream;
+  rec->finish  = start + (double)reclen * 8 / station->weight;
+  rec->filepos = filepos;
+  rec->reclen  = reclen;
+  rec->headerlen = headerlen;
+  memcpy (rec->record, record, reclen);
+  if (headerlen)
+    memcpy (rec->record + reclen, header, headerlen);
+
+  station->finish = rec->finish;
+
+  if (station->tail)
+  {
+    station->tail->next = rec;
+  }
+  else
+  {
+    station->head       = rec;
+    station->activenext = active;
+    active              = station;
+  }
+
+  station->tail = rec;
+
+  /* Add to the records of the owner in read order */
+  rec->ownernext = 0;
+  rec->ownerprev = owner->last;
+
+  if (owner->last)
+    owner->last->ownernext = rec;
+  else
+    owner->first = rec;
+
+  owner->last = rec;
+  owner->queued += reclen;
+  owner->readend = filepos + reclen;
+
+  queued += reclen;
+
+  return 0;
+} /* End of quota_enqueue() */
+
+/***************************************************************************
+ * quota_dispatch:
+ *
+ * Send queued records in fair order as long as the rate limits allow,
+ * each record is passed to the send routine with its owner data.
+ *
+ * If flush is set all queued records are sent, otherwise records are
+ * only waited for when the queue is larger than QUOTA_WINDOW.  Waiting
+ * ends early if the stop flag is set.
+ *
+ * Returns 0 on success and -1 if sending a record failed.
+ ***************************************************************************/
+int
+quota_dispatch (int64_t maxrate, int flush, char *stop, QuotaSend sendrecord)
+{
+  QuotaStation *station;
+  QuotaStation **best;
+  QuotaStation **pp;
+  QuotaOwner *owner;
+  QuotaRecord *rec;
+  int rv;
+  QuotaRule *rule;
+  struct timespec naptime;
+  double now;
+  double wait;
+  double minwait;
+  int idx;
+
+  /* The global limit may be changed while running */
+  global.maxrate = maxrate;
+
+  while (active)
+  {
+    now = dtime ();
+
+    /* Add tokens accumulated since the last dispatch */
+    filltokens (&global, global.maxrate, now);
+    for (rule = rules; rule; rule = rule->next)
+      filltokens (rule, rule->maxrate, now);
+
+    /* Find the lowest finish time of records that may be sent now */
+    best    = 0;
+    minwait = -1.0;
+    for (pp = &active; *pp; pp = &(*pp)->activenext)
+    {
+      wait = recordwait ((*pp)->head);
+
+      if (wait > 0.0)
+      {
+        if (minwait < 0.0 || wait < minwait)
+          minwait = wait;
+      }
+      else if (!best || (*pp)->head->finish < (*best)->head->finish)
+      {
+        best = pp;
+      }
+    }
+
+    if (best)
+    {
+      station = *best;
+      rec     = station->head;
+
+      /* Remove record from station queue and station from active list if empty */
+      if (!(station->head = rec->next))
+      {
+        station->tail = 0;
+        *best         = station->activenext;
+      }
+
+      /* Remove record from the records of the owner */
+      owner = rec->owner;
+
+      if (rec->ownerprev)
+        rec->ownerprev->ownernext = rec->ownernext;
+      else
+        owner->first = rec->ownernext;
+
+      if (rec->ownernext)
+        rec->ownernext->ownerprev = rec->ownerprev;
+      else
+        owner->last = rec->ownerprev;
+
+      owner->queued -= rec->reclen;
+      queued -= rec->reclen;
+      vclock = rec->finish;
+
+      if (global.maxrate > 0)
+        global.tokens -= rec->reclen * 8;
+      for (idx = 0; idx < rec->stream->rulecount; idx++)
+        rec->stream->rules[idx]->tokens -= rec->reclen * 8;
+
+      rv = sendrecord (rec->record, rec->reclen, rec->filepos,
+                       (rec->headerlen) ? rec->record + rec->reclen : NULL, owner->data);
+
+      free (rec);
+
+      /* The owner is kept until its last record has been sent */
+      if (!owner->first)
+        freeowner (owner);
+
+      if (rv)
+        return -1;
+
+      continue;
+    }
+
+    /* Wait for the rate limits only when flushing or the queue is full */
+    if ((!flush && queued < QUOTA_WINDOW) || (stop && *stop))
+      break;
+
+    /* Sleep until the next record may be sent, at most a second */
+    if (minwait > 1.0)
+      minwait = 1.0;
+
+    naptime.tv_sec  = (time_t)minwait;
+    naptime.tv_nsec = (long)((minwait - naptime.tv_sec) * 1.0e9);
+    nanosleep (&naptime, NULL);
+  }
+
+  return 0;
+} /* End of quota_dispatch() */
+
+/***************************************************************************
+ * quota_offset:
+ *
+ * Return the input file offset up to which all records of an owner
+ * have been sent: the offset of its earliest queued record or, while
+ * its last record is being sent, the offset after that record.  Only
+ * valid for owners with queued records and from the send routine.
+ ***************************************************************************/
+off_t
+quota_offset (void *data)
+{
+  QuotaOwner *owner;
+
+  if (!(owner = findowner (data, 0)))
+    return 0;
+
+  return (owner->first) ? owner->first->filepos : owner->readend;
+} /* End of quota_offset() */
+
+/***************************************************************************
+ * quota_reset:
+ *
+ * Discard all queued records of all owners.
+ ***************************************************************************/
+void
+quota_reset (void)
+{
+  QuotaStation *station;
+  QuotaRecord *rec;
+  int slot;
+
+  while ((station = active))
+  {
+    while ((rec = station->head))
+    {
+      station->head = rec->next;
+      free (rec);
+    }
+
+    station->tail = 0;
+    active        = station->activenext;
+  }
+
+  for (slot = 0; slot < QUOTA_HASHSIZE; slot++)
+    while (owners[slot])
+      freeowner (owners[slot]);
+
+  queued = 0;
+} /* End of quota_reset() */
+
+/***************************************************************************
+ * quota_queued:
+ *
+ * Return the number of bytes of queued records of an owner, or of all
+ * owners if data is NULL.
+ ***************************************************************************/
+int64_t
+quota_queued (void *data)
+{
+  QuotaOwner *owner;
+
+  if (!data)
+    return queued;
+
+  return ((owner = findowner (data, 0))) ? owner->queued : 0;
+} /* End of quota_queued() */
+
+/***************************************************************************
+ * findstream:
+ *
+ * Find a stream in the stream hash table or add it, matching the
+ * rules and finding or adding its station.  The weight of a new
+ * station is the weight of the first matching rule that sets one.
+ *
+ * Returns the stream on success and NULL on error.
+ ***************************************************************************/
+static QuotaStream *
+findstream (char *srcname)
+{
+  QuotaStream *stream;
+  QuotaStation *station;
+  QuotaRule *rule;
+  char name[24];
+  char *cp;
+  uint32_t slot;
+  int weight = 0;
+
+  slot = hashname (srcname) % QUOTA_HASHSIZE;
+
+  for (stream = streams[slot]; stream; stream = stream->hashnext)
+    if (!strcmp (stream->name, srcname))
+      return stream;
+
+  if (!(stream = (QuotaStream *)calloc (1, sizeof (QuotaStream))))
+    return NULL;
+
+  strncpy (stream->name, srcname, sizeof (stream->name) - 1);
+
+  /* Collect the matching rules that limit the rate */
+  for (rule = rules; rule; rule = rule->next)
+  {
+    if (!ms_matchselect (rule->selections, srcname, HPTERROR, HPTERROR, NULL))
+      continue;
+
+    if (!weight && rule->weight > 0)
+      weight = rule->weight;
+
+    if (rule->maxrate <= 0)
+      continue;
+
+    if (!(stream->rules = (QuotaRule **)realloc (stream->rules, (stream->rulecount + 1) * sizeof (QuotaRule *))))
+      return NULL;
+
+    stream->rules[stream->rulecount++] = rule;
+  }
+
+  /* Station name is the NET_STA portion of the stream */
+  strncpy (name, srcname, sizeof (name) - 1);
+  name[sizeof (name) - 1] = '\0';
+  if ((cp = strchr (name, '_')) && (cp = strchr (cp + 1, '_')))
+    *cp = '\0';
+
+  slot = hashname (name) % QUOTA_HASHSIZE;
+
+  for (station = stations[slot]; station; station = station->hashnext)
+    if (!strcmp (station->name, name))
+      break;
+
+  if (!station)
+  {
+    if (!(station = (QuotaStation *)calloc (1, sizeof (QuotaStation))))
+      return NULL;
+
+    strcpy (station->name, name);
+    station->weight   = (weight > 0) ? weight : 1;
+    station->hashnext = stations[slot];
+    stations[slot]    = station;
+  }
+
+  stream->station = station;
+
+  slot              = hashname (srcname) % QUOTA_HASHSIZE;
+  stream->hashnext  = streams[slot];
+  streams[slot]     = stream;
+
+  return stream;
+} /* End of findstream() */
+
+/***************************************************************************
+ * findowner:
+ *
+ * Find an owner of queued records in the owner hash table, adding it
+ * if not found and add is set.
+ *
+ * Returns the owner on success and NULL if not found or on error.
+ ***************************************************************************/
+static QuotaOwner *
+findowner (void *data, int add)
+{
+  QuotaOwner *owner;
+  uint32_t slot;
+
+  slot = (uint32_t) (((uintptr_t)data >> 4) % QUOTA_HASHSIZE);
+
+  for (owner = owners[slot]; owner; owner = owner->hashnext)
+    if (owner->data == data)
+      return owner;
+
+  if (!add || !(owner = (QuotaOwner *)calloc (1, sizeof (QuotaOwner))))
+    return NULL;
+
+  owner->data     = data;
+  owner->hashnext = owners[slot];
+  owners[slot]    = owner;
+
+  return owner;
+} /* End of findowner() */
+
+/***************************************************************************
+ * freeowner:
+ *
+ * Remove an owner from the owner hash table and free it, its records
+ * must already be removed.
+ ***************************************************************************/
+static void
+freeowner (QuotaOwner *owner)
+{
+  QuotaOwner **pp;
+
+  pp = &owners[((uintptr_t)owner->data >> 4) % QUOTA_HASHSIZE];
+
+  while (*pp != owner)
+    pp = &(*pp)->hashnext;
+
+  *pp = owner->hashnext;
+
+  free (owner);
+} /* End of freeowner() */
+
+/***************************************************************************
+ * filltokens:
+ *
+ * Add the tokens accumulated at the specified rate since the last
+ * fill, limited to QUOTA_BURST seconds of the rate.
+ ***************************************************************************/
+static void
+filltokens (QuotaRule *rule, int64_t maxrate, double now)
+{
+  if (maxrate > 0)
+  {
+    rule->tokens += maxrate * (now - rule->filltime);
+
+    if (rule->tokens > maxrate * QUOTA_BURST)
+      rule->tokens = maxrate * QUOTA_BURST;
+  }
+
+  rule->filltime = now;
+} /* End of filltokens() */
+
+/***************************************************************************
+ * recordwait:
+ *
+ * Return the seconds until all rate limits for a record allow it to
+ * be sent, 0 if it may be sent now.  A limit allows sending while its
+ * tokens are not negative, the record may overdraw them.
+ ***************************************************************************/
+static double
+recordwait (QuotaRecord *rec)
+{
+  QuotaRule *rule;
+  double wait = 0.0;
+  int idx;
+
+  if (global.maxrate > 0 && global.tokens < 0.0)
+    wait = -global.tokens / global.maxrate;
+
+  for (idx = 0; idx < rec->stream->rulecount; idx++)
+  {
+    rule = rec->stream->rules[idx];
+
+    if (rule->tokens < 0.0 && -rule->tokens / rule->maxrate > wait)
+      wait = -rule->tokens / rule->maxrate;
+  }
+
+  return wait;
+} /* End of recordwait() */
+
+/***************************************************************************
+ * dtime:
+ *
+ * Return the current time in seconds as a double.
+ ***************************************************************************/
+static double
+dtime (void)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+
+  return (double)now.tv_sec + (double)now.tv_usec / 1000000;
+} /* End of dtime() */
@@ -0,0 +1,38 @@
+/***************************************************************************
+ * quota.h
+ *
+ * Stream rate quota and fair sharing scheduler defines.
+ *
+ * modified: 2026.291
+ ***************************************************************************/
+
+#ifndef QUOTA_H
+#define QUOTA_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+#include <libmseed.h>
+
+/* Routine called to send a record released by the scheduler with the
+ * header and owner data queued with it */
+typedef int (*QuotaSend) (char *record, int reclen, off_t filepos,
+                          void *header, void *data);
+
+extern int     quota_addrule (char *net, char *sta, char *loc, char *chan,
+                              int64_t maxrate, int weight);
+extern int     quota_enqueue (char *srcname, char *record, int reclen, off_t filepos,
+                              void *header, int headerlen, void *data);
+extern int     quota_dispatch (int64_t maxrate, int flush, char *stop,
+                               QuotaSend sendrecord);
+extern off_t   quota_offset (void *data);
+extern void    quota_reset (void);
+extern int64_t quota_queued (void *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QUOTA_H */
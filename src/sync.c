@@ -0,0 +1,465 @@
+/***************************************************************************
+ * sync.c
+ *
+ * Routines to read, merge and write SYNC listings of time series
+ * coverage.  A SYNC listing is a header line followed by one line per
+ * segment with '|' separated fields:
+ *
+ * DCC|2026,291
+ * NET|STA|LOC|CHAN|START|END||SAMPRATE|SAMPLECNT|||||||DATE
+ *
+ * where times are in SEED time string format.
+ *
+ * modified: 2026.291
+ ***************************************************************************/
+
+#include "sync.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Number of segments added to a list allocation at a time */
+#define SYNC_ALLOCSTEP 1024
+
+static int segcmp (const void *a, const void *b);
+static int ratematch (SyncSeg *seg1, SyncSeg *seg2);
+static double syncrate (double samprate);
+static char *syncyearday (char *yearday, size_t size);
+static void writesegs (FILE *fp, SyncList *list, int first, int count, int precise,
+                       char *yearday);
+static void copyfield (char *dest, size_t destsize, char *src);
+
+/***************************************************************************
+ * sync_read:
+ *
+ * Read the segments of a SYNC file and add them to a list.  The
+ * header and lines that cannot be parsed are skipped.
+ *
+ * Returns the number of segments read on success and -1 on error
+ * with errno set.
+ ***************************************************************************/
+int
+sync_read (char *filename, SyncList *list)
+{
+  return sync_readselect (filename, list, NULL);
+} /* End of sync_read() */
+
+/***************************************************************************
+ * sync_readselect:
+ *
+ * Read the segments of a SYNC file for streams matching selections,
+ * matched against NET_STA_LOC_CHAN, and add them to a list.  The
+ * times of segments are only parsed for matching streams so large
+ * files can be searched quickly.  If selections is NULL all segments
+ * are read.
+ *
+ * Rates of SYNC files have two significant digits, segments are marked
+ * as rounded unless a rate read from the file has more digits, as in
+ * the coverage database.
+ *
+ * Returns the number of segments read on success and -1 on error
+ * with errno set.
+ ***************************************************************************/
+int
+sync_readselect (char *filename, SyncList *list, Selections *selections)
+{
+  FILE *fp;
+  SyncSeg seg;
+  int first = list->count;
+  int precise = 0;
+  int idx;
+  char line[400];
+  char srcname[50];
+  char *fields[10];
+  char *cp;
+  int fieldcount;
+  int count = 0;
+
+  if (!(fp = fopen (filename, "r")))
+    return -1;
+
+  while (fgets (line, sizeof (line), fp))
+  {
+    /* Split the first fields of the line */
+    fieldcount = 0;
+    fields[fieldcount++] = line;
+    for (cp = line; *cp && fieldcount < 10; cp++)
+    {
+      if (*cp == '|')
+      {
+        *cp = '\0';
+        fields[fieldcount++] = cp + 1;
+      }
+    }
+
+    if (fieldcount < 9)
+      continue;
+
+    memset (&seg, 0, sizeof (seg));
+    copyfield (seg.network, sizeof (seg.network), fields[0]);
+    copyfield (seg.station, sizeof (seg.station), fields[1]);
+    copyfield (seg.location, sizeof (seg.location), fields[2]);
+    copyfield (seg.channel, sizeof (seg.channel), fields[3]);
+
+    if (selections)
+    {
+      snprintf (srcname, sizeof (srcname), "%s_%s_%s_%s",
+                seg.network, seg.station, seg.location, seg.channel);
+
+      if (!ms_matchselect (selections, srcname, HPTERROR, HPTERROR, NULL))
+        continue;
+    }
+
+    seg.starttime = ms_seedtimestr2hptime (fields[4]);
+    seg.endtime   = ms_seedtimestr2hptime (fields[5]);
+    seg.samprate  = strtod (fields[7], NULL);
+    seg.samplecnt = strtoll (fields[8], NULL, 10);
+    seg.rounded   = (seg.samprate == syncrate (seg.samprate));
+
+    if (!seg.rounded)
+      precise = 1;
+
+    if (seg.starttime == HPTERROR || seg.endtime == HPTERROR)
+      continue;
+
+    if (sync_add (list, &seg))
+    {
+      fclose (fp);
+      return -1;
+    }
+
+    count++;
+  }
+
+  fclose (fp);
+
+  /* Rates of a file with any precise rate were not rounded */
+  if (precise)
+  {
+    for (idx = first; idx < list->count; idx++)
+      list->segs[idx].rounded = 0;
+  }
+
+  return count;
+} /* End of sync_readselect() */
+
+/***************************************************************************
+ * sync_add:
+ *
+ * Add a copy of a segment to a list.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+sync_add (SyncList *list, SyncSeg *seg)
+{
+  SyncSeg *segs;
+
+  if (list->count >= list->maxcount)
+  {
+    if (!(segs = (SyncSeg *)realloc (list->segs, (list->maxcount + SYNC_ALLOCSTEP) * sizeof (SyncSeg))))
+      return -1;
+
+    list->segs = segs;
+    list->maxcount += SYNC_ALLOCSTEP;
+  }
+
+  list->segs[list->count++] = *seg;
+
+  return 0;
+} /* End of sync_add() */
+
+/***************************************************************************
+ * sync_merge:
+ *
+ * Sort the segments of a list by stream and time and merge segments
+ * that are contiguous, i.e. the next segment starts one sample period
+ * after the end of the previous within a tolerance of half a sample
+ * period and the sample rates match.  Sample rates match if they are
+ * within the libmseed rate tolerance or, when one was read from a SYNC
+ * file written with two significant digits, equal at that precision,
+ * so coverage read from SYNC files merges with coverage of the same
+ * streams from data.  Duplicate segments and segments
+ * contained in the previous segment are removed.  If overlaps is true
+ * segments overlapping the previous are also joined, counting the
+ * overlapping samples once, so the result is the union of coverage.
+ ***************************************************************************/
+void
+sync_merge (SyncList *list, int overlaps)
+{
+  SyncSeg *prev;
+  SyncSeg *seg;
+  hptime_t period;
+  hptime_t expected;
+  int64_t overlap;
+  int idx;
+  int count;
+
+  if (list->count < 2)
+    return;
+
+  qsort (list->segs, list->count, sizeof (SyncSeg), segcmp);
+
+  count = 1;
+  for (idx = 1; idx < list->count; idx++)
+  {
+    prev = &list->segs[count - 1];
+    seg  = &list->segs[idx];
+
+    if (!strcmp (prev->network, seg->network) && !strcmp (prev->station, seg->station) &&
+        !strcmp (prev->location, seg->location) && !strcmp (prev->channel, seg->channel) &&
+        ratematch (prev, seg))
+    {
+      /* Keep the rate that was not rounded */
+      if (prev->rounded && !seg->rounded)
+      {
+        prev->samprate = seg->samprate;
+        prev->rounded  = 0;
+      }
+
+      /* Contained in previous segment */
+      if (seg->endtime <= prev->endtime)
+        continue;
+
+      period = (prev->samprate > 0.0) ? (hptime_t) (HPTMODULUS / prev->samprate) : 0;
+      expected = prev->endtime + period;
+
+      /* Contiguous with previous segment */
+      if (period > 0 && seg->starttime >= expected - period / 2 &&
+          seg->starttime <= expected + period / 2)
+      {
+        prev->endtime = seg->endtime;
+        prev->samplecnt += seg->samplecnt;
+        continue;
+      }
+
+      /* Overlapping previous segment */
+      if (overlaps && period > 0 && seg->starttime < expected - period / 2)
+      {
+        overlap = (prev->endtime - seg->starttime + period / 2) / period + 1;
+
+        prev->endtime = seg->endtime;
+        prev->samplecnt += (seg->samplecnt > overlap) ? seg->samplecnt - overlap : 0;
+        continue;
+      }
+    }
+
+    list->segs[count++] = *seg;
+  }
+
+  list->count = count;
+} /* End of sync_merge() */
+
+/***************************************************************************
+ * sync_write:
+ *
+ * Write the segments of a list to a SYNC file in the format written
+ * for data sent, with the current day as the modification date.
+ * Sample rates are written with two significant digits as expected
+ * by the DMC unless precise is true, e.g. for the coverage database,
+ * when they are written with up to 10 significant digits.
+ *
+ * Returns 0 on success and -1 on error with errno set.
+ ***************************************************************************/
+int
+sync_write (char *filename, SyncList *list, int precise)
+{
+  FILE *fp;
+  char yearday[24];
+
+  if (!(fp = fopen (filename, "w")))
+    return -1;
+
+  fprintf (fp, "DCC|%s\n", syncyearday (yearday, sizeof (yearday)));
+
+  writesegs (fp, list, 0, list->count, precise, yearday);
+
+  if (fclose (fp))
+    return -1;
+
+  return 0;
+} /* End of sync_write() */
+
+/***************************************************************************
+ * sync_append:
+ *
+ * Append count segments of a list starting at first to a file, creating
+ * it if needed, as SYNC lines without a header and with sample rates
+ * written with up to 10 significant digits.
+ *
+ * Returns 0 on success and -1 on error with errno set.
+ ***************************************************************************/
+int
+sync_append (char *filename, SyncList *list, int first, int count)
+{
+  FILE *fp;
+  char yearday[24];
+
+  if (!(fp = fopen (filename, "a")))
+    return -1;
+
+  writesegs (fp, list, first, count, 1, syncyearday (yearday, sizeof (yearday)));
+
+  if (fclose (fp))
+    return -1;
+
+  return 0;
+} /* End of sync_append() */
+
+/***************************************************************************
+ * sync_free:
+ *
+ * Free the segments of a list.
+ ***************************************************************************/
+void
+sync_free (SyncList *list)
+{
+  if (list->segs)
+    free (list->segs);
+
+  list->segs     = 0;
+  list->count    = 0;
+  list->maxcount = 0;
+} /* End of sync_free() */
+
+/***************************************************************************
+ * segcmp:
+ *
+ * Compare segments by stream, start time and end time for qsort().
+ ***************************************************************************/
+static int
+segcmp (const void *a, const void *b)
+{
+  const SyncSeg *sa = (const SyncSeg *)a;
+  const SyncSeg *sb = (const SyncSeg *)b;
+  int cmp;
+
+  if ((cmp = strcmp (sa->network, sb->network)) ||
+      (cmp = strcmp (sa->station, sb->station)) ||
+      (cmp = strcmp (sa->location, sb->location)) ||
+      (cmp = strcmp (sa->channel, sb->channel)))
+    return cmp;
+
+  if (sa->starttime != sb->starttime)
+    return (sa->starttime < sb->starttime) ? -1 : 1;
+
+  if (sa->endtime != sb->endtime)
+    return (sa->endtime < sb->endtime) ? -1 : 1;
+
+  return 0;
+} /* End of segcmp() */
+
+/***************************************************************************
+ * ratematch:
+ *
+ * Check if the sample rates of two segments match, within the libmseed
+ * rate tolerance or, if one of the rates was read from a SYNC file and
+ * may have been rounded to two significant digits, when the other rate
+ * rounds to it.
+ *
+ * Returns 1 if the rates match and 0 otherwise.
+ ***************************************************************************/
+static int
+ratematch (SyncSeg *seg1, SyncSeg *seg2)
+{
+  if (seg1->samprate == seg2->samprate)
+    return 1;
+
+  if (seg1->samprate <= 0.0 || seg2->samprate <= 0.0)
+    return 0;
+
+  if (MS_ISRATETOLERABLE (seg1->samprate, seg2->samprate))
+    return 1;
+
+  return ((seg1->rounded && !seg2->rounded && seg1->samprate == syncrate (seg2->samprate)) ||
+          (seg2->rounded && !seg1->rounded && seg2->samprate == syncrate (seg1->samprate)));
+} /* End of ratematch() */
+
+/***************************************************************************
+ * syncrate:
+ *
+ * Round a sample rate to the two significant digits written in SYNC
+ * files.
+ *
+ * Returns the rounded sample rate.
+ ***************************************************************************/
+static double
+syncrate (double samprate)
+{
+  char ratestr[30];
+
+  snprintf (ratestr, sizeof (ratestr), "%.2g", samprate);
+
+  return strtod (ratestr, NULL);
+} /* End of syncrate() */
+
+/***************************************************************************
+ * syncyearday:
+ *
+ * Format the current day as the modification date of SYNC lines.
+ *
+ * Returns the formatted date.
+ ***************************************************************************/
+static char *
+syncyearday (char *yearday, size_t size)
+{
+  time_t now;
+  struct tm *nt;
+
+  now = time (NULL);
+  nt  = localtime (&now);
+  snprintf (yearday, size, "%04d,%03d", nt->tm_year + 1900, nt->tm_yday + 1);
+
+  return yearday;
+} /* End of syncyearday() */
+
+/***************************************************************************
+ * writesegs:
+ *
+ * Write count segments of a list starting at first as SYNC lines.
+ ***************************************************************************/
+static void
+writesegs (FILE *fp, SyncList *list, int first, int count, int precise, char *yearday)
+{
+  MSTimeStrCache startcache;
+  MSTimeStrCache endcache;
+  SyncSeg *seg;
+  char starttime[50];
+  char endtime[50];
+  int idx;
+
+  memset (&startcache, 0, sizeof (startcache));
+  memset (&endcache, 0, sizeof (endcache));
+  for (idx = first; idx < first + count && idx < list->count; idx++)
+  {
+    seg = &list->segs[idx];
+
+    ms_hptime2seedtimestr_cached (seg->starttime, starttime, 1, &startcache);
+    ms_hptime2seedtimestr_cached (seg->endtime, endtime, 1, &endcache);
+
+    fprintf (fp, (precise) ? "%s|%s|%s|%s|%s|%s||%.10g|%" PRId64 "|||||||%s\n"
+                           : "%s|%s|%s|%s|%s|%s||%.2g|%" PRId64 "|||||||%s\n",
+             seg->network, seg->station, seg->location, seg->channel,
+             starttime, endtime, seg->samprate, seg->samplecnt,
+             yearday);
+  }
+} /* End of writesegs() */
+
+/***************************************************************************
+ * copyfield:
+ *
+ * Copy a field into a fixed size string, truncating if needed.
+ ***************************************************************************/
+static void
+copyfield (char *dest, size_t destsize, char *src)
+{
+  size_t length = strlen (src);
+
+  if (length > destsize - 1)
+    length = destsize - 1;
+
+  memcpy (dest, src, length);
+  dest[length] = '\0';
+} /* End of copyfield() */
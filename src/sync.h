@@ -0,0 +1,52 @@
+/***************************************************************************
+ * sync.h
+ *
+ * SYNC listing reading, merging and writing defines.
+ *
+ * modified: 2026.291
+ ***************************************************************************/
+
+#ifndef SYNC_H
+#define SYNC_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libmseed.h>
+
+/* Time series segment of a SYNC listing */
+typedef struct SyncSeg_s
+{
+  char network[11];
+  char station[11];
+  char location[11];
+  char channel[11];
+  hptime_t starttime;  /* Time of first sample */
+  hptime_t endtime;    /* Time of last sample */
+  double samprate;     /* Nominal sample rate (Hz) */
+  int64_t samplecnt;   /* Number of samples */
+  int rounded;         /* Rate read from a file, may be rounded to 2 digits */
+} SyncSeg;
+
+/* List of SYNC segments */
+typedef struct SyncList_s
+{
+  SyncSeg *segs;       /* Array of segments */
+  int count;           /* Number of segments */
+  int maxcount;        /* Number of segments allocated */
+} SyncList;
+
+extern int  sync_read (char *filename, SyncList *list);
+extern int  sync_readselect (char *filename, SyncList *list, Selections *selections);
+extern int  sync_add (SyncList *list, SyncSeg *seg);
+extern void sync_merge (SyncList *list, int overlaps);
+extern int  sync_write (char *filename, SyncList *list, int precise);
+extern int  sync_append (char *filename, SyncList *list, int first, int count);
+extern void sync_free (SyncList *list);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SYNC_H */